@@ -5,20 +5,45 @@
 
 #include "entity/native/async.h"
 
+#include <stdint.h>
+
+#include "alloc/alloc.h"
+#include "alloc/arena/intern.h"
+#include "entity/array/array.h"
 #include "entity/class/classes.h"
+#include "entity/native/error.h"
 #include "entity/native/native.h"
+#include "entity/string/string_helper.h"
+#include "entity/tuple/tuple.h"
+#include "struct/map.h"
+#include "struct/struct_defaults.h"
+#include "util/sync/mutex.h"
+#include "util/sync/thread.h"
+#include "util/sync/timer_wheel.h"
 #include "vm/intern.h"
+#include "vm/process/process.h"
 #include "vm/process/task.h"
+#include "vm/vm.h"
+
+static Class *Class_Completer;
 
 struct _Future {
   Task *task;
-  bool _is_complete, _is_result_set;
+  bool _is_complete, _is_result_set, _is_error;
 };
 
+// Completes its future when told to. The future is bound to a task that is
+// never run, so waiting on it is the same as waiting on any other task.
+typedef struct {
+  Task *task;
+  bool is_complete;
+} _Completer;
+
 void _future_init(Object *obj) {
   Future *f = ALLOC2(Future);
   f->_is_complete = false;
   f->_is_result_set = false;
+  f->_is_error = false;
   f->task = NULL;
   obj->_internal_obj = f;
 }
@@ -66,7 +91,508 @@ const Entity *future_get_value(Heap *heap, Object *obj) {
 
 inline Task *future_get_task(Future *f) { return f->task; }
 
+inline bool future_is_error(Future *f) {
+  return f->_is_error ||
+         (NULL != f->task && NULL != f->task->cancel_error &&
+          TASK_ERROR == f->task->state);
+}
+
+void future_set_error(Object *obj) {
+  ((Future *)obj->_internal_obj)->_is_error = true;
+}
+
+void _completer_init(Object *obj) {
+  _Completer *c = ALLOC2(_Completer);
+  c->task = NULL;
+  c->is_complete = false;
+  obj->_internal_obj = c;
+}
+
+void _completer_delete(Object *obj) { DEALLOC(obj->_internal_obj); }
+
+Entity _completer_constructor(Task *task, Context *ctx, Object *obj,
+                              Entity *args) {
+  Process *process = task->parent_process;
+  _Completer *c = (_Completer *)obj->_internal_obj;
+  c->task = process_create_unqueued_task(process);
+  Entity future = entity_object(future_create(c->task));
+  object_set_member(process->heap, obj, intern("$future"), &future);
+  object_set_member(process->heap, obj, intern("completed"), &NONE_ENTITY);
+  return entity_object(obj);
+}
+
+Entity _completer_finish(Task *task, Context *ctx, Object *obj,
+                         const Entity *result, bool is_error) {
+  Process *process = task->parent_process;
+  _Completer *c = (_Completer *)obj->_internal_obj;
+  // Whoever waited on it has already been told it was cancelled.
+  if (NULL != c->task->cancel_error) {
+    return NONE_ENTITY;
+  }
+  if (c->is_complete) {
+    return raise_error(task, ctx, "Completer is already complete.");
+  }
+  c->is_complete = true;
+  *task_mutable_resval(c->task) = (NULL == result) ? NONE_ENTITY : *result;
+  c->task->state = is_error ? TASK_ERROR : TASK_COMPLETE;
+  if (is_error) {
+    Object *future_obj = object_get(obj, intern("$future"))->obj;
+    ((Future *)future_obj->_internal_obj)->_is_error = true;
+  }
+  Entity completed = entity_int(1);
+  object_set_member(process->heap, obj, intern("completed"), &completed);
+  process_complete_task(process, c->task, is_error);
+  return NONE_ENTITY;
+}
+
+Entity _completer_complete(Task *task, Context *ctx, Object *obj,
+                           Entity *args) {
+  return _completer_finish(task, ctx, obj, args, /*is_error=*/false);
+}
+
+Entity _completer_complete_error(Task *task, Context *ctx, Object *obj,
+                                 Entity *args) {
+  if (!IS_CLASS(args, Class_Error)) {
+    return raise_error(task, ctx, "complete_error() expects an Error.");
+  }
+  return _completer_finish(task, ctx, obj, args, /*is_error=*/true);
+}
+
+Entity _completer_as_future(Task *task, Context *ctx, Object *obj,
+                            Entity *args) {
+  return *object_get(obj, intern("$future"));
+}
+
+typedef enum {
+  COMBINE_ALL,
+  COMBINE_ANY,
+  COMBINE_TIMEOUT,
+} _CombineKind;
+
+// State of the task behind a future returned by all(), any() or
+// with_timeout(). The task never runs. It waits on the tasks of the input
+// futures and completes, waking whoever waits on it, exactly once.
+typedef struct {
+  _CombineKind kind;
+  // Array or Tuple of the inputs to all() or any().
+  Object *inputs;
+  // The input to with_timeout().
+  Object *input;
+  Object *future;
+  // Input tasks of all() that have not completed.
+  uint32_t num_remaining;
+  // Completed by the VM's timer wheel when with_timeout() runs out.
+  Task *timer;
+  TimerId timer_id;
+  Object *timeout_error;
+} _Combinator;
+
+bool _future_failed(Future *f) {
+  return f->_is_error || (NULL != f->task && TASK_ERROR == f->task->state);
+}
+
+void _combinator_finish(Task *task, const Entity *result, bool is_error) {
+  _Combinator *comb = (_Combinator *)task->dependency_arg;
+  Process *process = task->parent_process;
+  Heap *heap = process->heap;
+  task->on_dependency_complete = NULL;
+  task->dependency_arg = NULL;
+  if (0 != comb->timer_id) {
+    // Fails harmlessly if the timer is what finished it.
+    if (timer_wheel_cancel(process->vm->timers, comb->timer_id)) {
+      process_drop_completion(process);
+    }
+  }
+
+  Future *f = (Future *)comb->future->_internal_obj;
+  // Kept on the future since the task is not a GC root.
+  object_set_member(heap, comb->future, RESULT_VAL, result);
+  f->_is_result_set = true;
+  f->_is_error = is_error;
+  *task_mutable_resval(task) = *result;
+  task->state = is_error ? TASK_ERROR : TASK_COMPLETE;
+  process_complete_task(process, task, is_error);
+
+  heap_dec_edge(heap, task->_reflection, comb->future);
+  DEALLOC(comb);
+}
+
+const Entity *_input_value(Heap *heap, const Entity *input) {
+  return IS_CLASS(input, Class_Future) ? future_get_value(heap, input->obj)
+                                       : input;
+}
+
+uint32_t _inputs_size(Object *inputs) {
+  return Class_Array == inputs->_class
+             ? Array_size((Array *)inputs->_internal_obj)
+             : tuple_size((Tuple *)inputs->_internal_obj);
+}
+
+const Entity *_inputs_get(Object *inputs, uint32_t i) {
+  return Class_Array == inputs->_class
+             ? Array_get_ref((Array *)inputs->_internal_obj, i)
+             : tuple_get((Tuple *)inputs->_internal_obj, i);
+}
+
+void _combinator_finish_all(Task *task) {
+  _Combinator *comb = (_Combinator *)task->dependency_arg;
+  Heap *heap = task->parent_process->heap;
+  Object *results = heap_new(heap, Class_Array);
+  uint32_t i, num_inputs = _inputs_size(comb->inputs);
+  for (i = 0; i < num_inputs; ++i) {
+    array_add(heap, results, _input_value(heap, _inputs_get(comb->inputs, i)));
+  }
+  Entity results_e = entity_object(results);
+  _combinator_finish(task, &results_e, /*is_error=*/false);
+}
+
+void _combinator_on_dependency_complete(Task *task, Task *dependency) {
+  _Combinator *comb = (_Combinator *)task->dependency_arg;
+  if (COMBINE_TIMEOUT == comb->kind && dependency == comb->timer) {
+    Entity error = entity_object(comb->timeout_error);
+    _combinator_finish(task, &error, /*is_error=*/true);
+    return;
+  }
+  bool is_error = TASK_ERROR == dependency->state;
+  if (COMBINE_ALL == comb->kind && !is_error) {
+    if (0 == --comb->num_remaining) {
+      _combinator_finish_all(task);
+    }
+    return;
+  }
+  // any(), with_timeout() and the first error of all() finish right away.
+  _combinator_finish(task, task_get_resval(dependency), is_error);
+}
+
+Object *_combinator_create(Task *task, _CombineKind kind, Task **comb_task) {
+  Process *process = task->parent_process;
+  Task *c_task = process_create_unqueued_task(process);
+  _Combinator *comb = ALLOC2(_Combinator);
+  comb->kind = kind;
+  comb->inputs = NULL;
+  comb->input = NULL;
+  comb->num_remaining = 0;
+  comb->timer = NULL;
+  comb->timer_id = 0;
+  comb->timeout_error = NULL;
+  comb->future = future_create(c_task);
+  // Keeps the future alive until it completes, even if it is not awaited.
+  heap_inc_edge(process->heap, c_task->_reflection, comb->future);
+  c_task->on_dependency_complete = _combinator_on_dependency_complete;
+  c_task->dependency_arg = comb;
+  *comb_task = c_task;
+  return comb->future;
+}
+
+// Makes [c_task] wait on [input] if it is a future that is not complete.
+// Returns the input if it is complete, otherwise NULL.
+const Entity *_combinator_wait_on(Task *c_task, const Entity *input,
+                                  Map *waited_on) {
+  if (!IS_CLASS(input, Class_Future)) {
+    return input;
+  }
+  Future *f = (Future *)input->obj->_internal_obj;
+  if (future_is_complete(f)) {
+    return input;
+  }
+  Task *input_task = future_get_task(f);
+  if (NULL == map_lookup(waited_on, input_task)) {
+    map_insert(waited_on, input_task, input_task);
+    set_insert(&input_task->dependent_tasks, c_task);
+    ((_Combinator *)c_task->dependency_arg)->num_remaining++;
+  }
+  return NULL;
+}
+
+Entity _combine(Task *task, Context *ctx, Entity *args, _CombineKind kind) {
+  if (!IS_CLASS(args, Class_Array) && !IS_CLASS(args, Class_Tuple)) {
+    return raise_error(task, ctx, "Expected an Array or Tuple of Futures.");
+  }
+  Heap *heap = task->parent_process->heap;
+  Task *c_task;
+  Object *future = _combinator_create(task, kind, &c_task);
+  _Combinator *comb = (_Combinator *)c_task->dependency_arg;
+  comb->inputs = args->obj;
+  Entity inputs_e = *args;
+  object_set_member(heap, future, intern("$inputs"), &inputs_e);
+
+  const Entity *done = NULL;
+  Map waited_on;
+  map_init_default(&waited_on);
+  uint32_t i, num_inputs = _inputs_size(comb->inputs);
+  for (i = 0; i < num_inputs; ++i) {
+    const Entity *input = _inputs_get(comb->inputs, i);
+    const Entity *complete_input = _combinator_wait_on(c_task, input,
+                                                       &waited_on);
+    if (NULL == complete_input) {
+      continue;
+    }
+    bool is_error = IS_CLASS(complete_input, Class_Future) &&
+                    _future_failed((Future *)complete_input->obj->_internal_obj);
+    // Only the first input that settles any(), or fails all(), counts.
+    if (NULL == done && (COMBINE_ANY == kind || is_error)) {
+      done = complete_input;
+    }
+  }
+  map_finalize(&waited_on);
+
+  if (NULL != done) {
+    bool is_error = IS_CLASS(done, Class_Future) &&
+                    _future_failed((Future *)done->obj->_internal_obj);
+    _combinator_finish(c_task, _input_value(heap, done), is_error);
+  } else if (COMBINE_ALL == kind && 0 == comb->num_remaining) {
+    _combinator_finish_all(c_task);
+  } else if (COMBINE_ANY == kind && 0 == comb->num_remaining) {
+    // any() of nothing.
+    _combinator_finish(c_task, &NONE_ENTITY, /*is_error=*/false);
+  }
+  return entity_object(future);
+}
+
+Entity _async_all(Task *task, Context *ctx, Object *obj, Entity *args) {
+  return _combine(task, ctx, args, COMBINE_ALL);
+}
+
+Entity _async_any(Task *task, Context *ctx, Object *obj, Entity *args) {
+  return _combine(task, ctx, args, COMBINE_ANY);
+}
+
+void _timer_fire(void *arg) {
+  Task *timer = (Task *)arg;
+  process_post_completion(timer->parent_process, timer);
+}
+
+Task *async_timer_create(Process *process, uint64_t delay_ms, TimerId *id) {
+  Task *timer = process_create_unqueued_task(process);
+  *task_mutable_resval(timer) = NONE_ENTITY;
+  process_expect_completion(process);
+  *id = timer_wheel_add(process->vm->timers, delay_ms, _timer_fire, timer);
+  return timer;
+}
+
+bool async_duration_ms(const Entity *duration, uint64_t *ms) {
+  double duration_sec;
+  if (IS_INT(duration)) {
+    duration_sec = pint(&duration->pri);
+  } else if (IS_FLOAT(duration)) {
+    duration_sec = pfloat(&duration->pri);
+  } else {
+    return false;
+  }
+  *ms = duration_sec <= 0 ? 0 : (uint64_t)(duration_sec * 1000 + 0.5);
+  return true;
+}
+
+Entity _async_with_timeout(Task *task, Context *ctx, Object *obj,
+                           Entity *args) {
+  if (!IS_TUPLE(args) || 2 != tuple_size((Tuple *)args->obj->_internal_obj)) {
+    return raise_error(task, ctx,
+                       "with_timeout() expects a Future and a duration.");
+  }
+  Tuple *t = (Tuple *)args->obj->_internal_obj;
+  const Entity *input = tuple_get(t, 0);
+  const Entity *duration = tuple_get(t, 1);
+  uint64_t duration_ms;
+  if (!async_duration_ms(duration, &duration_ms)) {
+    return raise_error(task, ctx, "with_timeout() duration must be a number.");
+  }
+  Process *process = task->parent_process;
+  Heap *heap = process->heap;
+  Task *c_task;
+  Object *future = _combinator_create(task, COMBINE_TIMEOUT, &c_task);
+  _Combinator *comb = (_Combinator *)c_task->dependency_arg;
+  comb->input = IS_OBJECT(input) ? input->obj : NULL;
+  object_set_member(heap, future, intern("$inputs"), input);
+
+  Map waited_on;
+  map_init_default(&waited_on);
+  const Entity *complete_input = _combinator_wait_on(c_task, input, &waited_on);
+  map_finalize(&waited_on);
+  if (NULL != complete_input) {
+    bool is_error = IS_CLASS(complete_input, Class_Future) &&
+                    _future_failed((Future *)complete_input->obj->_internal_obj);
+    _combinator_finish(c_task, _input_value(heap, complete_input), is_error);
+    return entity_object(future);
+  }
+
+  // Created now while there is a stack to attach to it.
+  const char msg[] = "Timed out.";
+  comb->timeout_error =
+      error_new(task, ctx, string_new(heap, msg, sizeof(msg) - 1));
+  Entity error_e = entity_object(comb->timeout_error);
+  object_set_member(heap, future, intern("$timeout_error"), &error_e);
+
+  // The dependency is added before the timer can fire since completions are
+  // only drained by this process's heap owner, which is running this task.
+  comb->timer = async_timer_create(process, duration_ms, &comb->timer_id);
+  set_insert(&comb->timer->dependent_tasks, c_task);
+  return entity_object(future);
+}
+
+void _task_cancel(Process *process, Task *task, Object *error);
+
+// Stops [c_task] waiting on an input and cancels the input if nothing else
+// waits on it.
+void _combinator_cancel_input(Process *process, Task *c_task,
+                              const Entity *input, Object *error) {
+  if (!IS_CLASS(input, Class_Future)) {
+    return;
+  }
+  Future *f = (Future *)input->obj->_internal_obj;
+  if (future_is_complete(f)) {
+    return;
+  }
+  Task *input_task = future_get_task(f);
+  set_remove(&input_task->dependent_tasks, c_task);
+  if (0 == set_size(&input_task->dependent_tasks)) {
+    _task_cancel(process, input_task, error);
+  }
+}
+
+void _combinator_cancel(Process *process, Task *c_task, Object *error) {
+  _Combinator *comb = (_Combinator *)c_task->dependency_arg;
+  if (NULL != comb->inputs) {
+    uint32_t i, num_inputs = _inputs_size(comb->inputs);
+    for (i = 0; i < num_inputs; ++i) {
+      _combinator_cancel_input(process, c_task, _inputs_get(comb->inputs, i),
+                               error);
+    }
+  } else if (NULL != comb->input) {
+    Entity input = entity_object(comb->input);
+    _combinator_cancel_input(process, c_task, &input, error);
+  }
+  Entity error_e = entity_object(error);
+  _combinator_finish(c_task, &error_e, /*is_error=*/true);
+}
+
+// Cancels [task] and the tasks it waits on that nothing else waits on.
+//
+// A waiting task is resumed right away and raises [error] where it waited. A
+// task that is queued raises it when it starts. A background native is
+// interrupted if it is blocked and its task fails with [error] once the native
+// returns. Tasks that never run, like those behind a Completer or all(), fail
+// with [error] right away.
+void _task_cancel(Process *process, Task *task, Object *error) {
+  if (TASK_COMPLETE == task->state || TASK_ERROR == task->state ||
+      NULL != task->cancel_error) {
+    return;
+  }
+  task->cancel_error = error;
+  heap_inc_edge(process->heap, task->_reflection, error);
+  atomic_store(&task->is_cancelled, true);
+
+  if (TASK_WAITING == task->state && NULL != task->waiting_on) {
+    Task *waiting_on = task->waiting_on;
+    task->waiting_on = NULL;
+    set_remove(&waiting_on->dependent_tasks, task);
+    if (0 == set_size(&waiting_on->dependent_tasks)) {
+      _task_cancel(process, waiting_on, error);
+    }
+    *task_mutable_resval(task) = entity_object(error);
+    task->child_task_has_error = true;
+    task->is_cancel_raised = true;
+    process_resume_task(process, task);
+    return;
+  }
+  if (NULL != task->_background_fn) {
+    // Only interrupt the native while it is still running this task.
+    SYNCHRONIZED(process->vm->interrupt_lock, {
+      if (atomic_load(&task->_in_background)) {
+        thread_interrupt(task->_background_thread);
+      }
+    });
+    return;
+  }
+  if (NULL != task->current) {
+    // Queued, or the task cancelling itself.
+    return;
+  }
+  if (_combinator_on_dependency_complete == task->on_dependency_complete) {
+    _combinator_cancel(process, task, error);
+    return;
+  }
+  if (NULL != task->on_cancel) {
+    task->on_cancel(task);
+  }
+  *task_mutable_resval(task) = entity_object(error);
+  task->state = TASK_ERROR;
+  process_complete_task(process, task, /*is_error=*/true);
+}
+
+// Returns True if the future was cancelled, or False if it had already
+// completed.
+Entity _future_cancel(Task *task, Context *ctx, Object *obj, Entity *args) {
+  Future *f = (Future *)obj->_internal_obj;
+  if (NULL == f->task || future_is_complete(f)) {
+    return NONE_ENTITY;
+  }
+  if (NULL == f->task->cancel_error) {
+    _task_cancel(task->parent_process, f->task, cancelled_error_new(task, ctx));
+  }
+  return entity_int(1);
+}
+
+Entity _async_now(Task *task, Context *ctx, Object *obj, Entity *args) {
+  return entity_float(timer_wheel_now_ms() / 1000.0);
+}
+
+Entity _async_priority(Task *task, Context *ctx, Object *obj, Entity *args) {
+  return entity_int(task->priority);
+}
+
+// Applies to the calling task and the tasks it starts from then on.
+Entity _async_set_priority(Task *task, Context *ctx, Object *obj,
+                           Entity *args) {
+  if (NULL == args || !IS_INT(args) || pint(&args->pri) < 0 ||
+      pint(&args->pri) >= NUM_TASK_PRIORITIES) {
+    return raise_error(task, ctx,
+                       "set_priority() expects HIGH, NORMAL or LOW.");
+  }
+  task->priority = (TaskPriority)pint(&args->pri);
+  return NONE_ENTITY;
+}
+
+Entity _async_deadline(Task *task, Context *ctx, Object *obj, Entity *args) {
+  return 0 == task->deadline_ms ? NONE_ENTITY
+                                : entity_float(task->deadline_ms / 1000.0);
+}
+
+Entity _async_set_deadline(Task *task, Context *ctx, Object *obj,
+                           Entity *args) {
+  if (NULL == args || NONE == args->type) {
+    task->deadline_ms = 0;
+    return NONE_ENTITY;
+  }
+  uint64_t deadline_ms;
+  if (!async_duration_ms(args, &deadline_ms)) {
+    return raise_error(task, ctx,
+                       "set_deadline() expects a time from now() or None.");
+  }
+  // 0 means no deadline.
+  task->deadline_ms = 0 == deadline_ms ? 1 : deadline_ms;
+  return NONE_ENTITY;
+}
+
 void async_add_native(ModuleManager *mm, Module *async) {
   Class_Future = native_class(async, FUTURE_NAME, _future_init, _future_delete);
   native_function(async, VALUE_KEY, _future_value);
+  native_method(Class_Future, intern("cancel"), _future_cancel);
+
+  Class_Completer = native_class(async, intern("Completer"), _completer_init,
+                                 _completer_delete);
+  native_method(Class_Completer, CONSTRUCTOR_KEY, _completer_constructor);
+  native_method(Class_Completer, intern("complete"), _completer_complete);
+  native_method(Class_Completer, intern("complete_error"),
+                _completer_complete_error);
+  native_method(Class_Completer, intern("as_future"), _completer_as_future);
+
+  native_function(async, intern("all"), _async_all);
+  native_function(async, intern("any"), _async_any);
+  native_function(async, intern("with_timeout"), _async_with_timeout);
+
+  native_function(async, intern("now"), _async_now);
+  native_function(async, intern("priority"), _async_priority);
+  native_function(async, intern("set_priority"), _async_set_priority);
+  native_function(async, intern("deadline"), _async_deadline);
+  native_function(async, intern("set_deadline"), _async_set_deadline);
 }
\ No newline at end of file
@@ -6,8 +6,13 @@
 #ifndef ENTITY_NATIVE_ASYNC_H_
 #define ENTITY_NATIVE_ASYNC_H_
 
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "entity/entity.h"
 #include "entity/object.h"
 #include "heap/heap.h"
+#include "util/sync/timer_wheel.h"
 #include "vm/module_manager.h"
 #include "vm/process/processes.h"
 
@@ -18,6 +23,18 @@ Object *future_create(Task *task);
 bool future_is_complete(Future *f);
 const Entity *future_get_value(Heap *heap, Object *obj);
 Task *future_get_task(Future *f);
+// Whether awaiting [f] raises its value, e.g. after Completer.complete_error().
+bool future_is_error(Future *f);
+// Makes awaiting [obj], a Future, raise its value once its task completes.
+void future_set_error(Object *obj);
+
+// Converts a duration in seconds (Int or Float) to milliseconds, rounding to
+// the nearest one. Negative durations are 0. Returns false if [duration] is
+// not a number.
+bool async_duration_ms(const Entity *duration, uint64_t *ms);
+// Creates a task that never runs and completes with None once [delay_ms] have
+// passed. [id] is set to the timer that completes it.
+Task *async_timer_create(Process *process, uint64_t delay_ms, TimerId *id);
 
 void async_add_native(ModuleManager *mm, Module *async);
 
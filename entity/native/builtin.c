@@ -18,12 +18,17 @@
 #include "entity/string/string_helper.h"
 #include "entity/tuple/tuple.h"
 #include "heap/heap.h"
+#include "heap/heap_dump.h"
+#include "struct/keyed_list.h"
 #include "struct/map.h"
 #include "struct/struct_defaults.h"
 #include "util/file/file_info.h"
 #include "util/string.h"
+#include "util/sync/mutex.h"
+#include "util/sync/threadpool.h"
 #include "util/util.h"
 #include "vm/intern.h"
+#include "vm/process/process.h"
 #include "vm/process/processes.h"
 #include "vm/process/task.h"
 #include "vm/vm.h"
@@ -43,6 +48,11 @@ typedef struct {
   int32_t inc;
 } _Range;
 
+Entity _raise_frozen(Task *task, Context *ctx, Object *obj) {
+  return raise_error(task, ctx, "Cannot modify a frozen %s.",
+                     obj->_class->_name);
+}
+
 bool _str_to_int64(String *str, int64_t *result) {
   char *cstr = strndup(str->table, String_size(str));
   char *endptr;
@@ -230,45 +240,254 @@ void _task_dec_all_context(Heap *heap, Task *task) {
   }
 }
 
-Entity _collect_garbage(Task *task, Context *ctx, Object *obj, Entity *args) {
-  Process *process = task->parent_process;
+void _queued_task_inc_all_context(Task *task, void *heap) {
+  _task_inc_all_context((Heap *)heap, task);
+}
+
+void _queued_task_dec_all_context(Task *task, void *heap) {
+  _task_dec_all_context((Heap *)heap, task);
+}
+
+void _process_dedup_strings(Process *process);
+
+// Must be called by the heap owner, which keeps tasks from being queued or
+// leaving the waiting list during collection.
+uint32_t collect_garbage(Process *process) {
   Heap *heap = process->heap;
   uint32_t deleted_nodes_count;
 
-  SYNCHRONIZED(process->task_queue_lock, {
-    _task_inc_all_context(heap, process->current_task);
-    Q_iter queued_tasks = Q_iterator(&process->queued_tasks);
-    for (; Q_has(&queued_tasks); Q_inc(&queued_tasks)) {
-      Task *queued_task = (Task *)Q_value(&queued_tasks);
-      _task_inc_all_context(heap, queued_task);
-    }
-    M_iter waiting_tasks = set_iter(&process->waiting_tasks);
-    for (; has(&waiting_tasks); inc(&waiting_tasks)) {
-      Task *waiting_task = (Task *)value(&waiting_tasks);
-      _task_inc_all_context(heap, waiting_task);
+  _task_inc_all_context(heap, process->current_task);
+  process_for_each_queued_task(process, _queued_task_inc_all_context, heap);
+  process_for_each_waiting_task(process, _queued_task_inc_all_context, heap);
+
+  _process_dedup_strings(process);
+  deleted_nodes_count = heap_collect_garbage(heap);
+
+  _task_dec_all_context(heap, process->current_task);
+  process_for_each_queued_task(process, _queued_task_dec_all_context, heap);
+  process_for_each_waiting_task(process, _queued_task_dec_all_context, heap);
+
+  // M_iter completed_tasks = set_iter(&process->completed_tasks);
+  // for (; has(&completed_tasks); inc(&completed_tasks)) {
+  //   Task *completed_task = (Task *)value(&completed_tasks);
+  //   task_finalize(completed_task);
+  // }
+  return deleted_nodes_count;
+}
+
+Entity _collect_garbage(Task *task, Context *ctx, Object *obj, Entity *args) {
+  return entity_int(collect_garbage(task->parent_process));
+}
+
+void _task_add_heap_roots(AList *roots, Task *task) {
+  AL_iter stack = alist_iter(&task->entity_stack);
+  for (; al_has(&stack); al_inc(&stack)) {
+    Entity *e = al_value(&stack);
+    if (OBJECT == e->type) {
+      heap_roots_add(roots, e->obj, HEAP_ROOT_TASK_STACK, NULL);
     }
+  }
+  if (OBJECT == task->resval.type) {
+    heap_roots_add(roots, task->resval.obj, HEAP_ROOT_TASK_RESVAL, NULL);
+  }
+  Context *ctx = task->current;
+  while (NULL != ctx) {
+    heap_roots_add(roots, ctx->member_obj, HEAP_ROOT_TASK_CONTEXT,
+                   NULL == ctx->func ? NULL : ctx->func->_name);
+    ctx = ctx->previous_context;
+  }
+}
 
-    deleted_nodes_count = heap_collect_garbage(heap);
+void _queued_task_add_heap_roots(Task *task, void *roots) {
+  _task_add_heap_roots((AList *)roots, task);
+}
 
-    _task_dec_all_context(heap, process->current_task);
-    queued_tasks = Q_iterator(&process->queued_tasks);
-    for (; Q_has(&queued_tasks); Q_inc(&queued_tasks)) {
-      Task *queued_task = (Task *)Q_value(&queued_tasks);
-      _task_dec_all_context(heap, queued_task);
+void _add_heap_root(Object *obj, void *arg) {
+  AList *roots = (AList *)arg;
+  AL_iter listed = alist_iter(roots);
+  for (; al_has(&listed); al_inc(&listed)) {
+    if (obj == ((HeapRoot *)al_value(&listed))->obj) {
+      return;
     }
-    waiting_tasks = set_iter(&process->waiting_tasks);
-    for (; has(&waiting_tasks); inc(&waiting_tasks)) {
-      Task *waiting_task = (Task *)value(&waiting_tasks);
-      _task_dec_all_context(heap, waiting_task);
+  }
+  heap_roots_add(roots, obj, HEAP_ROOT_HEAP, NULL);
+}
+
+void _process_add_heap_roots(AList *roots, Process *process) {
+  heap_roots_add(roots, process->_reflection, HEAP_ROOT_PROCESS, NULL);
+  // Module reflections only live on the heap that loaded them.
+  ModuleManager *mm = vm_module_manager(process->vm);
+  if (mm->_heap == process->heap) {
+    KL_iter modules = keyedlist_iter(&mm->_modules);
+    for (; kl_has(&modules); kl_inc(&modules)) {
+      Module *module = module_info_module((ModuleInfo *)kl_value(&modules));
+      if (NULL != module) {
+        heap_roots_add(roots, module->_reflection, HEAP_ROOT_MODULE,
+                       module->_name);
+      }
     }
+  }
+  // Stats can be taken between tasks.
+  if (NULL != process->current_task) {
+    _task_add_heap_roots(roots, process->current_task);
+  }
+  process_for_each_queued_task(process, _queued_task_add_heap_roots, roots);
+  process_for_each_waiting_task(process, _queued_task_add_heap_roots, roots);
+  heap_for_each_root(process->heap, _add_heap_root, roots);
+}
+
+typedef struct {
+  Process *process;
+  StringDedup dedup;
+} _StringDedupPass;
 
-    // M_iter completed_tasks = set_iter(&process->completed_tasks);
-    // for (; has(&completed_tasks); inc(&completed_tasks)) {
-    //   Task *completed_task = (Task *)value(&completed_tasks);
-    //   task_finalize(completed_task);
-    // }
-  });
-  return entity_int(deleted_nodes_count);
+void _dedup_string(Object *obj, void *arg) {
+  // Frozen strings are shared with other processes and must not change.
+  if (Class_String != obj->_class || NULL == obj->_internal_obj ||
+      object_is_frozen(obj)) {
+    return;
+  }
+  _StringDedupPass *pass = (_StringDedupPass *)arg;
+  uint32_t freed = string_dedup_add(&pass->dedup, (String *)obj->_internal_obj);
+  if (freed > 0) {
+    heap_charge(pass->process->heap, obj, -(int64_t)freed);
+    pass->process->strings_deduped++;
+    pass->process->string_bytes_saved += freed;
+  }
+}
+
+// Makes equal live strings share storage. Strings copy their storage before
+// being modified, so sharing is invisible to programs.
+//
+// Skipped while background natives are running, since they may be reading
+// storage this would free, e.g. the Strings given to a blocking send(). A
+// later collection catches up.
+void _process_dedup_strings(Process *process) {
+  if (0 != atomic_load(&process->num_background_calls)) {
+    return;
+  }
+  AList roots;
+  alist_init(&roots, HeapRoot, DEFAULT_ARRAY_SZ);
+  _process_add_heap_roots(&roots, process);
+  _StringDedupPass pass = {.process = process};
+  string_dedup_init(&pass.dedup);
+  heap_walk(process->heap, &roots, _dedup_string, &pass);
+  string_dedup_finalize(&pass.dedup);
+  alist_finalize(&roots);
+}
+
+Entity _clamped_int(uint64_t value) {
+  return entity_int(value > INT32_MAX ? INT32_MAX : (int32_t)value);
+}
+
+Entity _string_stats(Task *task, Context *ctx, Object *obj, Entity *args) {
+  Process *process = task->parent_process;
+  Heap *heap = process->heap;
+  Object *stats = heap_new(heap, Class_Object);
+  Entity interned = entity_int(process->strings_interned);
+  Entity deduped = entity_int(process->strings_deduped);
+  Entity bytes_saved = _clamped_int(process->string_bytes_saved);
+  object_set_member(heap, stats, intern("interned"), &interned);
+  object_set_member(heap, stats, intern("deduped"), &deduped);
+  object_set_member(heap, stats, intern("bytes_saved"), &bytes_saved);
+  return entity_object(stats);
+}
+
+void _add_lock_stats(Heap *heap, Object *stats, const char name[],
+                     LockStats lock_stats) {
+  Object *lock = heap_new(heap, Class_Object);
+  Entity acquisitions = _clamped_int(lock_stats.acquisitions);
+  Entity contentions = _clamped_int(lock_stats.contentions);
+  object_set_member(heap, lock, intern("acquisitions"), &acquisitions);
+  object_set_member(heap, lock, intern("contentions"), &contentions);
+  Entity lock_e = entity_object(lock);
+  object_set_member(heap, stats, intern(name), &lock_e);
+}
+
+// Reports how often each scheduling lock of the current Process was taken and
+// how often a thread had to wait for it.
+Entity _lock_stats(Task *task, Context *ctx, Object *obj, Entity *args) {
+  Process *process = task->parent_process;
+  Heap *heap = process->heap;
+  Object *stats = heap_new(heap, Class_Object);
+  _add_lock_stats(heap, stats, "heap_owner",
+                  mutex_stats(process->heap_owner_lock));
+  _add_lock_stats(heap, stats, "task_create",
+                  mutex_stats(process->task_create_lock));
+  _add_lock_stats(heap, stats, "task_waiting",
+                  mutex_stats(process->task_waiting_lock));
+  _add_lock_stats(heap, stats, "task_queue",
+                  mutex_stats(process->task_queue.lock));
+  Scheduler *scheduler = process->vm->scheduler;
+  if (NULL != scheduler) {
+    _add_lock_stats(heap, stats, "scheduler", scheduler_lock_stats(scheduler));
+  }
+  return entity_object(stats);
+}
+
+void _add_pool_stats(Heap *heap, Object *stats, const char name[],
+                     ThreadPoolStats pool_stats) {
+  Object *pool = heap_new(heap, Class_Object);
+  uint64_t num_started = pool_stats.submitted - pool_stats.queue_depth;
+  uint64_t num_completed = pool_stats.completed;
+  Entity threads = _clamped_int(pool_stats.num_threads);
+  Entity submitted = _clamped_int(pool_stats.submitted);
+  Entity completed = _clamped_int(num_completed);
+  Entity stolen = _clamped_int(pool_stats.stolen);
+  Entity queue_depth = _clamped_int(pool_stats.queue_depth);
+  Entity max_queue_depth = _clamped_int(pool_stats.max_queue_depth);
+  Entity avg_wait_us = _clamped_int(
+      0 == num_started ? 0 : pool_stats.total_wait_ns / num_started / 1000);
+  Entity max_wait_us = _clamped_int(pool_stats.max_wait_ns / 1000);
+  Entity avg_run_us = _clamped_int(
+      0 == num_completed ? 0 : pool_stats.total_run_ns / num_completed / 1000);
+  object_set_member(heap, pool, intern("threads"), &threads);
+  object_set_member(heap, pool, intern("submitted"), &submitted);
+  object_set_member(heap, pool, intern("completed"), &completed);
+  object_set_member(heap, pool, intern("stolen"), &stolen);
+  object_set_member(heap, pool, intern("queue_depth"), &queue_depth);
+  object_set_member(heap, pool, intern("max_queue_depth"), &max_queue_depth);
+  object_set_member(heap, pool, intern("avg_wait_us"), &avg_wait_us);
+  object_set_member(heap, pool, intern("max_wait_us"), &max_wait_us);
+  object_set_member(heap, pool, intern("avg_run_us"), &avg_run_us);
+  Entity pool_e = entity_object(pool);
+  object_set_member(heap, stats, intern(name), &pool_e);
+}
+
+// Reports the queue depth and latency of the pools running background
+// natives. Times are in microseconds.
+Entity _background_stats(Task *task, Context *ctx, Object *obj,
+                         Entity *args) {
+  VM *vm = task->parent_process->vm;
+  Heap *heap = task->parent_process->heap;
+  Object *stats = heap_new(heap, Class_Object);
+  _add_pool_stats(heap, stats, "io", threadpool_stats(vm->io_pool));
+  _add_pool_stats(heap, stats, "cpu", threadpool_stats(vm->cpu_pool));
+  return entity_object(stats);
+}
+
+Entity _heap_dump(Task *task, Context *ctx, Object *obj, Entity *args) {
+  if (NULL == args || OBJECT != args->type ||
+      Class_String != args->obj->_class) {
+    return raise_error(task, ctx, "heap_dump() expects a file path.");
+  }
+  String *path = (String *)args->obj->_internal_obj;
+  char *fn = strndup(path->table, String_size(path));
+  FILE *file = fopen(fn, "wb");
+  free(fn);
+  if (NULL == file) {
+    return raise_error(task, ctx, "Could not open '%.*s' for writing.",
+                       String_size(path), path->table);
+  }
+  Process *process = task->parent_process;
+  HeapDumpStats stats;
+  AList roots;
+  alist_init(&roots, HeapRoot, DEFAULT_ARRAY_SZ);
+  _process_add_heap_roots(&roots, process);
+  heap_dump(process->heap, &roots, file, &stats);
+  alist_finalize(&roots);
+  fclose(file);
+  return entity_int(stats.num_objects);
 }
 
 Entity _stringify(Task *task, Context *ctx, Object *obj, Entity *args) {
@@ -293,13 +512,18 @@ Entity _stringify(Task *task, Context *ctx, Object *obj, Entity *args) {
 }
 
 Entity _string_extend(Task *task, Context *ctx, Object *obj, Entity *args) {
+  if (object_is_frozen(obj)) {
+    return _raise_frozen(task, ctx, obj);
+  }
   if (NULL == args || OBJECT != args->type ||
       Class_String != args->obj->_class) {
     return raise_error(task, ctx,
                        "Cannot extend a string with something not a string.");
   }
-  String_append((String *)obj->_internal_obj,
-                (String *)args->obj->_internal_obj);
+  String *str = (String *)obj->_internal_obj;
+  size_t footprint = String_footprint(str);
+  String_append(str, (String *)args->obj->_internal_obj);
+  string_recharge(task->parent_process->heap, obj, footprint);
   return entity_object(obj);
 }
 
@@ -318,13 +542,23 @@ Entity _string_cmp(Task *task, Context *ctx, Object *obj, Entity *args) {
 }
 
 Entity _string_eq(Task *task, Context *ctx, Object *obj, Entity *args) {
-  Primitive p = _string_cmp(task, ctx, obj, args).pri;
-  return pint(&p) == 0 ? entity_int(1) : NONE_ENTITY;
+  if (!IS_CLASS(args, Class_String)) {
+    return NONE_ENTITY;
+  }
+  return String_equals((String *)obj->_internal_obj,
+                       (String *)args->obj->_internal_obj)
+             ? entity_int(1)
+             : NONE_ENTITY;
 }
 
 Entity _string_neq(Task *task, Context *ctx, Object *obj, Entity *args) {
-  Primitive p = _string_cmp(task, ctx, obj, args).pri;
-  return pint(&p) != 0 ? entity_int(1) : NONE_ENTITY;
+  if (!IS_CLASS(args, Class_String)) {
+    return entity_int(1);
+  }
+  return String_equals((String *)obj->_internal_obj,
+                       (String *)args->obj->_internal_obj)
+             ? NONE_ENTITY
+             : entity_int(1);
 }
 
 Entity _string_index(Task *task, Context *ctx, Object *obj, Entity *args) {
@@ -342,7 +576,23 @@ Entity _string_index(Task *task, Context *ctx, Object *obj, Entity *args) {
 
 Entity _string_hash(Task *task, Context *ctx, Object *obj, Entity *args) {
   String *str = (String *)obj->_internal_obj;
-  return entity_int(string_hasher_len(str->table, String_size(str)));
+  return entity_int(object_is_frozen(obj) ? String_hash_uncached(str)
+                                          : String_hash(str));
+}
+
+Entity _string_intern(Task *task, Context *ctx, Object *obj, Entity *args) {
+  // Frozen strings are shared with other processes and must not change.
+  if (object_is_frozen(obj)) {
+    return entity_object(obj);
+  }
+  int32_t freed = String_intern((String *)obj->_internal_obj);
+  // Only counted when the string actually moved to the intern table.
+  if (freed >= 0) {
+    heap_charge(task->parent_process->heap, obj, -(int64_t)freed);
+    task->parent_process->strings_interned++;
+    task->parent_process->string_bytes_saved += freed;
+  }
+  return entity_object(obj);
 }
 
 Entity _string_len(Task *task, Context *ctx, Object *obj, Entity *args) {
@@ -351,6 +601,9 @@ Entity _string_len(Task *task, Context *ctx, Object *obj, Entity *args) {
 }
 
 Entity _string_set(Task *task, Context *ctx, Object *obj, Entity *args) {
+  if (object_is_frozen(obj)) {
+    return _raise_frozen(task, ctx, obj);
+  }
   String *str = (String *)obj->_internal_obj;
   if (!IS_TUPLE(args)) {
     return raise_error(task, ctx, "Expected tuple input.");
@@ -368,6 +621,7 @@ Entity _string_set(Task *task, Context *ctx, Object *obj, Entity *args) {
     return raise_error(task, ctx,
                        "Cannot index a string with something not an int.");
   }
+  size_t footprint = String_footprint(str);
   if (NULL != val && PRIMITIVE == val->type && CHAR == ptype(&val->pri)) {
     String_set(str, pint(&index->pri), pchar(&val->pri));
   } else if (NULL != val && OBJECT == val->type &&
@@ -378,6 +632,7 @@ Entity _string_set(Task *task, Context *ctx, Object *obj, Entity *args) {
   } else {
     return raise_error(task, ctx, "Bad string index.");
   }
+  string_recharge(task->parent_process->heap, obj, footprint);
   return NONE_ENTITY;
 }
 
@@ -515,6 +770,9 @@ Entity _string_copy(Task *task, Context *ctx, Object *obj, Entity *args) {
 }
 
 Entity _string_ltrim(Task *task, Context *ctx, Object *obj, Entity *args) {
+  if (object_is_frozen(obj)) {
+    return _raise_frozen(task, ctx, obj);
+  }
   String *str = (String *)obj->_internal_obj;
   int i = 0;
   while (is_any_space(str->table[i])) {
@@ -525,6 +783,9 @@ Entity _string_ltrim(Task *task, Context *ctx, Object *obj, Entity *args) {
 }
 
 Entity _string_rtrim(Task *task, Context *ctx, Object *obj, Entity *args) {
+  if (object_is_frozen(obj)) {
+    return _raise_frozen(task, ctx, obj);
+  }
   String *str = (String *)obj->_internal_obj;
   int i = 0;
   while (is_any_space(str->table[String_size(str) - 1 - i])) {
@@ -535,6 +796,9 @@ Entity _string_rtrim(Task *task, Context *ctx, Object *obj, Entity *args) {
 }
 
 Entity _string_trim(Task *task, Context *ctx, Object *obj, Entity *args) {
+  if (object_is_frozen(obj)) {
+    return _raise_frozen(task, ctx, obj);
+  }
   String *str = (String *)obj->_internal_obj;
   int i = 0;
   while (is_any_space(str->table[i])) {
@@ -550,6 +814,9 @@ Entity _string_trim(Task *task, Context *ctx, Object *obj, Entity *args) {
 }
 
 Entity _string_lshrink(Task *task, Context *ctx, Object *obj, Entity *args) {
+  if (object_is_frozen(obj)) {
+    return _raise_frozen(task, ctx, obj);
+  }
   String *str = (String *)obj->_internal_obj;
   if (NULL == args || PRIMITIVE != args->type || INT != ptype(&args->pri)) {
     return raise_error(task, ctx, "Trimming String with something not an Int.");
@@ -563,6 +830,9 @@ Entity _string_lshrink(Task *task, Context *ctx, Object *obj, Entity *args) {
 }
 
 Entity _string_rshrink(Task *task, Context *ctx, Object *obj, Entity *args) {
+  if (object_is_frozen(obj)) {
+    return _raise_frozen(task, ctx, obj);
+  }
   String *str = (String *)obj->_internal_obj;
   if (NULL == args || PRIMITIVE != args->type || INT != ptype(&args->pri)) {
     return raise_error(task, ctx, "Trimming String with something not an Int.");
@@ -576,6 +846,9 @@ Entity _string_rshrink(Task *task, Context *ctx, Object *obj, Entity *args) {
 }
 
 Entity _string_clear(Task *task, Context *ctx, Object *obj, Entity *args) {
+  if (object_is_frozen(obj)) {
+    return _raise_frozen(task, ctx, obj);
+  }
   String *str = (String *)obj->_internal_obj;
   String_clear(str);
   return entity_object(obj);
@@ -645,11 +918,17 @@ Entity _array_len(Task *task, Context *ctx, Object *obj, Entity *args) {
 }
 
 Entity _array_append(Task *task, Context *ctx, Object *obj, Entity *args) {
+  if (object_is_frozen(obj)) {
+    return _raise_frozen(task, ctx, obj);
+  }
   array_add(task->parent_process->heap, obj, args);
   return entity_object(obj);
 }
 
 Entity _array_remove(Task *task, Context *ctx, Object *obj, Entity *args) {
+  if (object_is_frozen(obj)) {
+    return _raise_frozen(task, ctx, obj);
+  }
   return array_remove(task->parent_process->heap, obj, pint(&args->pri));
 }
 
@@ -836,6 +1115,9 @@ Entity _class_fields(Task *task, Context *ctx, Object *obj, Entity *args) {
 }
 
 Entity _set_member(Task *task, Context *ctx, Object *obj, Entity *args) {
+  if (object_is_frozen(obj)) {
+    return _raise_frozen(task, ctx, obj);
+  }
   if (!IS_TUPLE(args)) {
     return raise_error(task, ctx, "$set() can only be called with a Tuple.");
   }
@@ -917,6 +1199,7 @@ void _builtin_add_string(Module *builtin) {
   native_method(Class_String, intern("__find_all"), _string_find_all);
   native_method(Class_String, intern("len"), _string_len);
   native_method(Class_String, HASH_KEY, _string_hash);
+  native_method(Class_String, intern("intern"), _string_intern);
   native_method(Class_String, intern("__substr"), _string_substr);
   native_method(Class_String, intern("copy"), _string_copy);
   native_method(Class_String, intern("ltrim"), _string_ltrim);
@@ -957,6 +1240,10 @@ void builtin_add_native(ModuleManager *mm, Module *builtin) {
   Class_Task = native_class(builtin, TASK_NAME, _task_init, _task_delete);
 
   native_function(builtin, intern("__collect_garbage"), _collect_garbage);
+  native_function(builtin, intern("heap_dump"), _heap_dump);
+  native_function(builtin, intern("string_stats"), _string_stats);
+  native_function(builtin, intern("lock_stats"), _lock_stats);
+  native_function(builtin, intern("background_stats"), _background_stats);
   native_function(builtin, intern("Int"), _Int);
   native_function(builtin, intern("Float"), _Float);
   native_function(builtin, intern("Bool"), __Bool);
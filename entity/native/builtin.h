@@ -8,7 +8,12 @@
 
 #include "entity/object.h"
 #include "vm/module_manager.h"
+#include "vm/process/processes.h"
 
 void builtin_add_native(ModuleManager *mm, Module *builtin);
 
+// Collects garbage on [process]'s heap, keeping everything reachable from its
+// tasks. Returns the number of objects deleted.
+uint32_t collect_garbage(Process *process);
+
 #endif /* ENTITY_NATIVE_BUILTIN_H_ */
\ No newline at end of file
@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 
+#include "alloc/alloc.h"
 #include "alloc/arena/intern.h"
 #include "debug/debug.h"
 #include "entity/class/classes.h"
@@ -21,6 +22,7 @@
 #include "vm/process/task.h"
 
 Class *Class_StackLine;
+Class *Class_Cancelled;
 
 typedef struct {
   Module *module;
@@ -127,9 +129,21 @@ Object *error_new(Task *task, Context *ctx, Object *error_msg) {
   return err;
 }
 
+Object *cancelled_error_new(Task *task, Context *ctx) {
+  const char msg[] = "Cancelled.";
+  Entity error_msg_e = entity_object(
+      string_new(task->parent_process->heap, msg, sizeof(msg) - 1));
+  Object *err = heap_new(task->parent_process->heap, Class_Cancelled);
+  _error_constructor(task, ctx, err, &error_msg_e);
+  return err;
+}
+
 void error_add_native(ModuleManager *mm, Module *error) {
   Class_Error = native_class(error, ERROR_NAME, _error_init, _error_delete);
   native_method(Class_Error, CONSTRUCTOR_KEY, _error_constructor);
+  Class_Cancelled =
+      native_class(error, intern("Cancelled"), _error_init, _error_delete);
+  Class_Cancelled->_super = Class_Error;
 
   Class_StackLine =
       native_class(error, STACKLINE_NAME, _stackline_init, _stackline_delete);
@@ -13,8 +13,11 @@
 #include "vm/process/processes.h"
 
 extern Class *Class_StackLine;
+// Raised in tasks whose Future was cancelled.
+extern Class *Class_Cancelled;
 
 Object *error_new(Task *task, Context *ctx, Object *error_msg);
+Object *cancelled_error_new(Task *task, Context *ctx);
 void error_add_native(ModuleManager *mm, Module *error);
 
 uint32_t stackline_linenum(Object *stackline);
@@ -5,9 +5,13 @@
 #include "entity/native/io.h"
 
 #include <errno.h>
+#include <stdatomic.h>
 #include <stdio.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -15,29 +19,73 @@
 #include "alloc/arena/intern.h"
 #include "debug/debug.h"
 #include "entity/class/classes.h"
+#include "entity/native/async.h"
 #include "entity/native/error.h"
 #include "entity/native/native.h"
 #include "entity/object.h"
 #include "entity/string/string.h"
 #include "entity/string/string_helper.h"
 #include "entity/tuple/tuple.h"
+#include "heap/heap.h"
 #include "struct/map.h"
 #include "struct/set.h"
 #include "util/file/file_util.h"
+#include "util/uring.h"
 #include "vm/intern.h"
+#include "vm/process/process.h"
+#include "vm/process/processes.h"
+#include "vm/process/task.h"
+#include "vm/virtual_machine.h"
+#include "vm/vm.h"
 
 #define MAX_EVENTS 1024
 #define FILE_NAME_LENGTH_ESTIMATE 16
 #define EVENT_SIZE (sizeof(struct inotify_event))
 #define EVENT_BUFFER_LENGTH \
   (MAX_EVENTS * (EVENT_SIZE + FILE_NAME_LENGTH_ESTIMATE))
+// Largest read or write handed to the ring at once.
+#define FILE_OP_MAX_TRANSFER (1U << 30)
+// Of the buffers of BufferedReader and BufferedWriter, unless given.
+#define BUFFERED_DEFAULT_SIZE (1U << 16)
 
 static Class *Class_WatchDir;
+static Class *Class_MappedFile;
+
+// Thread pool versions of getall() and puts(), used when the VM has no
+// io_uring or the file is not a regular file.
+static Function *_getall_in_background;
+static Function *_puts_in_background;
+// Background halves of BufferedReader.fill() and BufferedWriter.flush().
+static Function *_fill_in_background;
+static Function *_flush_in_background;
 
 typedef struct {
   FILE *fp;
 } _File;
 
+typedef enum {
+  FILE_OP_READ,
+  FILE_OP_WRITE,
+} _FileOpKind;
+
+// A read or write queued on the VM's io_uring. Its task never runs, it only
+// completes the Future returned to the caller.
+typedef struct {
+  _FileOpKind kind;
+  // A dup of the file's descriptor, so closing the File while the op is in
+  // flight cannot hand the kernel a reused descriptor.
+  int fd;
+  char *buf;
+  size_t len, done;
+  // Where the next transfer starts, or -1 for the current position.
+  int64_t offset;
+  // Of the last transfer, set on the ring's thread.
+  int32_t result;
+  Task *task;
+  // Pinned while the op is in flight.
+  Object *future;
+} _FileOp;
+
 typedef struct {
   bool is_closed;
   int fd, length;
@@ -49,6 +97,18 @@ typedef struct {
   char *dir;
 } _WatchDir;
 
+// A read-only view of [len] bytes of a file mapped into memory. Views made
+// by substr() and split() share the mapping and keep an edge to the
+// MappedFile that owns it, which unmaps it once it is collected.
+typedef struct {
+  const char *data;
+  size_t len;
+  // The MappedFile that owns the mapping, or NULL if this is it.
+  Object *owner;
+  void *mapping;
+  size_t mapping_len;
+} _MappedFile;
+
 char *_String_nullterm(String *str) {
   uint32_t str_len = String_size(str);
   char *out = ALLOC_ARRAY2(char, str_len + 1);
@@ -138,6 +198,39 @@ Entity _file_close(Task *task, Context *ctx, Object *obj, Entity *args) {
   return NONE_ENTITY;
 }
 
+Entity _file_fileno(Task *task, Context *ctx, Object *obj, Entity *args) {
+  _File *f = (_File *)obj->_internal_obj;
+  if (NULL == f->fp) {
+    return raise_error(task, ctx, "File is closed.");
+  }
+  return entity_int(fileno(f->fp));
+}
+
+// Drops what stdio has read ahead and moves the descriptor to where reads
+// through the File have got to, so it can be read directly from there. Pipes
+// and terminals cannot move back, so they are left as they are.
+Entity _file_sync(Task *task, Context *ctx, Object *obj, Entity *args) {
+  _File *f = (_File *)obj->_internal_obj;
+  if (NULL == f->fp) {
+    return raise_error(task, ctx, "File is closed.");
+  }
+  off_t pos = ftello(f->fp);
+  if (pos >= 0) {
+    fflush(f->fp);
+    lseek(fileno(f->fp), pos, SEEK_SET);
+  }
+  return NONE_ENTITY;
+}
+
+Entity _file_size(Task *task, Context *ctx, Object *obj, Entity *args) {
+  _File *f = (_File *)obj->_internal_obj;
+  struct stat st;
+  if (NULL == f->fp || 0 != fstat(fileno(f->fp), &st)) {
+    return raise_error(task, ctx, "Could not get the size of the file.");
+  }
+  return entity_int(st.st_size);
+}
+
 Entity _file_gets(Task *task, Context *ctx, Object *obj, Entity *args) {
   _File *f = (_File *)obj->_internal_obj;
   ASSERT(NOT_NULL(f), NOT_NULL(f->fp));
@@ -146,7 +239,17 @@ Entity _file_gets(Task *task, Context *ctx, Object *obj, Entity *args) {
   }
   char *buf = ALLOC_ARRAY2(char, pint(&args->pri) + 1);
   Entity string;
-  if (fgets(buf, pint(&args->pri), f->fp)) {
+  char *line;
+  // A read interrupted by Future.cancel() fails with EINTR.
+  for (errno = 0; NULL == (line = fgets(buf, pint(&args->pri), f->fp)) &&
+                  EINTR == errno && !task_is_cancelled(task);
+       errno = 0) {
+    clearerr(f->fp);
+  }
+  if (task_is_cancelled(task)) {
+    clearerr(f->fp);
+    string = NONE_ENTITY;
+  } else if (NULL != line) {
     string = entity_object(
         string_new(task->parent_process->heap, buf, pint(&args->pri)));
   } else {
@@ -175,7 +278,8 @@ Entity _file_getline(Task *task, Context *ctx, Object *obj, Entity *args) {
 }
 
 // This is vulnerable to files with \0 inside them.
-Entity _file_getall(Task *task, Context *ctx, Object *obj, Entity *args) {
+Entity _file_getall_blocking(Task *task, Context *ctx, Object *obj,
+                             Entity *args) {
   _File *f = (_File *)obj->_internal_obj;
   // Get length of file to realloc size and avoid buffer reallocs.
   fseek(f->fp, 0, SEEK_END);
@@ -193,7 +297,8 @@ Entity _file_getall(Task *task, Context *ctx, Object *obj, Entity *args) {
   return entity_object(str);
 }
 
-Entity _file_puts(Task *task, Context *ctx, Object *obj, Entity *args) {
+Entity _file_puts_blocking(Task *task, Context *ctx, Object *obj,
+                          Entity *args) {
   _File *f = (_File *)obj->_internal_obj;
   ASSERT(NOT_NULL(f));
   if (NULL == args || NONE == args->type || OBJECT != args->type ||
@@ -205,6 +310,826 @@ Entity _file_puts(Task *task, Context *ctx, Object *obj, Entity *args) {
   return NONE_ENTITY;
 }
 
+void _file_op_drained(Task *op_task);
+
+_FileOp *_file_op_create(_FileOpKind kind, int fd, char *buf, size_t len,
+                         int64_t offset) {
+  _FileOp *op = ALLOC2(_FileOp);
+  op->kind = kind;
+  op->fd = fd;
+  op->buf = buf;
+  op->len = len;
+  op->done = 0;
+  op->offset = offset;
+  op->result = 0;
+  op->task = NULL;
+  op->future = NULL;
+  return op;
+}
+
+void _file_op_delete(_FileOp *op) {
+  if (NULL != op->task) {
+    Process *process = op->task->parent_process;
+    heap_dec_edge(process->heap, process->_reflection, op->future);
+  }
+  close(op->fd);
+  DEALLOC(op->buf);
+  DEALLOC(op);
+}
+
+// Called on the ring's thread.
+void _file_op_done(void *arg, int32_t result) {
+  _FileOp *op = (_FileOp *)arg;
+  op->result = result;
+  process_post_completion(op->task->parent_process, op->task);
+}
+
+// Queues what is left of [op]. Returns false if the ring is full.
+bool _file_op_submit(Uring *uring, _FileOp *op) {
+  size_t len = op->len - op->done;
+  if (len > FILE_OP_MAX_TRANSFER) {
+    len = FILE_OP_MAX_TRANSFER;
+  }
+  int64_t offset = op->offset < 0 ? -1 : op->offset + (int64_t)op->done;
+  char *buf = op->buf + op->done;
+  Process *process = op->task->parent_process;
+  process_expect_completion(process);
+  if (FILE_OP_READ == op->kind
+          ? uring_read(uring, op->fd, buf, len, offset, _file_op_done, op)
+          : uring_write(uring, op->fd, buf, len, offset, _file_op_done, op)) {
+    return true;
+  }
+  process_drop_completion(process);
+  return false;
+}
+
+// Does what is left of [op] on this thread, for when the ring is full.
+// Returns false on failure.
+bool _file_op_finish_blocking(_FileOp *op) {
+  while (op->done < op->len) {
+    char *buf = op->buf + op->done;
+    size_t len = op->len - op->done;
+    off_t offset = op->offset + op->done;
+    ssize_t transferred;
+    if (FILE_OP_READ == op->kind) {
+      transferred = op->offset < 0 ? read(op->fd, buf, len)
+                                   : pread(op->fd, buf, len, offset);
+    } else {
+      transferred = op->offset < 0 ? write(op->fd, buf, len)
+                                   : pwrite(op->fd, buf, len, offset);
+    }
+    if (transferred < 0) {
+      if (EINTR == errno) {
+        continue;
+      }
+      return false;
+    }
+    if (0 == transferred) {
+      break;
+    }
+    op->done += transferred;
+  }
+  return true;
+}
+
+// Completes the op's task with what was read, or with an error.
+void _file_op_complete(_FileOp *op, bool is_ok) {
+  Task *op_task = op->task;
+  Process *process = op_task->parent_process;
+  Entity result;
+  if (!is_ok) {
+    const char *error = FILE_OP_READ == op->kind ? "Could not read file."
+                                                 : "Could not write file.";
+    result = entity_object(error_new(
+        op_task, NULL, string_new(process->heap, error, strlen(error))));
+    future_set_error(op->future);
+  } else if (FILE_OP_READ == op->kind) {
+    result = entity_object(string_new(process->heap, op->buf, op->done));
+  } else {
+    result = NONE_ENTITY;
+  }
+  *task_mutable_resval(op_task) = result;
+  op_task->state = is_ok ? TASK_COMPLETE : TASK_ERROR;
+  process_complete_task(process, op_task, !is_ok);
+  _file_op_delete(op);
+}
+
+// Returns a Future completed once [op] is done. It is handed to the kernel
+// with everything else queued in this scheduling quantum.
+Entity _file_op_start(Task *task, _FileOp *op) {
+  Process *process = task->parent_process;
+  op->task = process_create_unqueued_task(process);
+  op->task->on_completion_drained = _file_op_drained;
+  op->task->dependency_arg = op;
+  op->future = future_create(op->task);
+  heap_inc_edge(process->heap, process->_reflection, op->future);
+  Object *future = op->future;
+  if (!_file_op_submit(process->vm->uring, op)) {
+    _file_op_complete(op, _file_op_finish_blocking(op));
+  }
+  return entity_object(future);
+}
+
+// Called on the heap owner once the ring has posted the op's task.
+void _file_op_drained(Task *op_task) {
+  _FileOp *op = (_FileOp *)op_task->dependency_arg;
+  Process *process = op_task->parent_process;
+  // Whoever waited on it has already been told it was cancelled.
+  if (NULL != op_task->cancel_error) {
+    _file_op_delete(op);
+    return;
+  }
+  bool is_retry = -EINTR == op->result || -EAGAIN == op->result;
+  if (op->result < 0 && !is_retry) {
+    _file_op_complete(op, false);
+    return;
+  }
+  if (op->result > 0) {
+    op->done += op->result;
+  }
+  // A read of 0 bytes means the file ended early.
+  if ((is_retry || op->result > 0) && op->done < op->len) {
+    if (_file_op_submit(process->vm->uring, op)) {
+      return;
+    }
+    _file_op_complete(op, _file_op_finish_blocking(op));
+    return;
+  }
+  _file_op_complete(op, true);
+}
+
+// Returns a descriptor for [f] that can be used on the ring, or -1 if the
+// thread pool has to be used instead. Only regular files are sent to the
+// ring, since anything else may block it or share a stdio buffer.
+int _file_uring_fd(Task *task, _File *f, struct stat *st) {
+  if (NULL == task->parent_process->vm->uring || NULL == f->fp ||
+      stdin == f->fp || stdout == f->fp || stderr == f->fp) {
+    return -1;
+  }
+  int fd = fileno(f->fp);
+  if (fd < 0 || 0 != fstat(fd, st) || !S_ISREG(st->st_mode)) {
+    return -1;
+  }
+  return dup(fd);
+}
+
+Entity _file_getall(Task *task, Context *ctx, Object *obj, Entity *args) {
+  _File *f = (_File *)obj->_internal_obj;
+  struct stat st;
+  int fd = _file_uring_fd(task, f, &st);
+  // Files like those in /proc claim to be empty, so only stdio can tell.
+  if (fd >= 0 && 0 == st.st_size) {
+    close(fd);
+    fd = -1;
+  }
+  if (fd < 0) {
+    return entity_object(
+        vm_call_in_background(task, ctx, _getall_in_background, obj, args));
+  }
+  // Leave the file where reading all of it through stdio would have.
+  fseek(f->fp, 0, SEEK_END);
+  return _file_op_start(
+      task, _file_op_create(FILE_OP_READ, fd, ALLOC_ARRAY(char, st.st_size),
+                            st.st_size, 0));
+}
+
+Entity _file_puts(Task *task, Context *ctx, Object *obj, Entity *args) {
+  _File *f = (_File *)obj->_internal_obj;
+  ASSERT(NOT_NULL(f));
+  if (!IS_CLASS(args, Class_String)) {
+    return NONE_ENTITY;
+  }
+  String *string = (String *)args->obj->_internal_obj;
+  struct stat st;
+  int fd = _file_uring_fd(task, f, &st);
+  if (fd < 0) {
+    return entity_object(
+        vm_call_in_background(task, ctx, _puts_in_background, obj, args));
+  }
+  size_t len = String_size(string);
+  if (0 == len) {
+    close(fd);
+    return NONE_ENTITY;
+  }
+  // Whatever stdio still buffers has to reach the file first.
+  fflush(f->fp);
+  // Copied, since the String may change before the write is done.
+  char *buf = ALLOC_ARRAY(char, len);
+  memcpy(buf, string->table, len);
+  return _file_op_start(task,
+                        _file_op_create(FILE_OP_WRITE, fd, buf, len, -1));
+}
+
+// Reads a file descriptor in large chunks on a background thread and hands
+// out the lines in them without leaving the VM's thread.
+typedef struct {
+  // A dup, so it outlives the File it came from.
+  int fd;
+  char *buf;
+  // Unread bytes are [start, start + len) of buf.
+  size_t start, len, capacity;
+  // How much each fill() asks for.
+  size_t chunk_size;
+  // Unread bytes already known not to hold a '\n'.
+  size_t searched;
+  bool is_eof;
+  // Set while fill() runs on a background thread and cleared there, so it is
+  // read by the VM's thread without a lock.
+  atomic_bool is_filling;
+} _BufferedReader;
+
+// Collects writes and hands them to the file in batches.
+typedef struct {
+  int fd;
+  // Whether flushes go through the VM's io_uring.
+  bool use_uring;
+  char *buf;
+  size_t len, capacity;
+  // Being written by $flush on a background thread.
+  char *flushing;
+  size_t flushing_len;
+} _BufferedWriter;
+
+// Parses the (fd, size) arguments of the buffered constructors.
+bool _buffered_args(Entity *args, int *fd, size_t *size) {
+  const Entity *e_fd = args, *e_size = NULL;
+  if (IS_TUPLE(args)) {
+    Tuple *tuple = (Tuple *)args->obj->_internal_obj;
+    e_fd = tuple_get(tuple, 0);
+    e_size = tuple_size(tuple) > 1 ? tuple_get(tuple, 1) : NULL;
+  }
+  if (!IS_INT(e_fd) || pint(&e_fd->pri) < 0) {
+    return false;
+  }
+  *fd = pint(&e_fd->pri);
+  if (!IS_NONE(e_size)) {
+    if (!IS_INT(e_size) || pint(&e_size->pri) <= 0) {
+      return false;
+    }
+    *size = pint(&e_size->pri);
+  }
+  return true;
+}
+
+void _buffered_reader_init(Object *obj) {
+  _BufferedReader *r = ALLOC2(_BufferedReader);
+  r->fd = -1;
+  r->buf = NULL;
+  r->start = r->len = r->capacity = r->searched = 0;
+  r->chunk_size = BUFFERED_DEFAULT_SIZE;
+  r->is_eof = false;
+  atomic_init(&r->is_filling, false);
+  obj->_internal_obj = r;
+}
+
+void _buffered_reader_delete(Object *obj) {
+  _BufferedReader *r = (_BufferedReader *)obj->_internal_obj;
+  if (r->fd >= 0) {
+    close(r->fd);
+  }
+  if (NULL != r->buf) {
+    DEALLOC(r->buf);
+  }
+  DEALLOC(r);
+}
+
+Entity _buffered_reader_constructor(Task *task, Context *ctx, Object *obj,
+                                    Entity *args) {
+  _BufferedReader *r = (_BufferedReader *)obj->_internal_obj;
+  int fd;
+  if (!_buffered_args(args, &fd, &r->chunk_size)) {
+    return raise_error(task, ctx,
+                       "BufferedReader takes a file descriptor and a size.");
+  }
+  r->fd = dup(fd);
+  if (r->fd < 0) {
+    return raise_error(task, ctx, "Invalid file descriptor.");
+  }
+  r->capacity = r->chunk_size;
+  r->buf = ALLOC_ARRAY(char, r->capacity);
+  return entity_object(obj);
+}
+
+Entity _buffered_reader_fill(Task *task, Context *ctx, Object *obj,
+                             Entity *args) {
+  _BufferedReader *r = (_BufferedReader *)obj->_internal_obj;
+  if (r->fd < 0) {
+    return raise_error(task, ctx, "BufferedReader is closed.");
+  }
+  if (atomic_load(&r->is_filling)) {
+    return raise_error(task, ctx, "BufferedReader is already being filled.");
+  }
+  if (r->is_eof) {
+    return entity_int(0);
+  }
+  atomic_store(&r->is_filling, true);
+  return entity_object(
+      vm_call_in_background(task, ctx, _fill_in_background, obj, args));
+}
+
+// Reads the next chunk on a background thread. Returns how many bytes were
+// read, 0 at the end of the file.
+Entity _buffered_reader_fill_blocking(Task *task, Context *ctx, Object *obj,
+                                      Entity *args) {
+  _BufferedReader *r = (_BufferedReader *)obj->_internal_obj;
+  // Unread bytes move to the front rather than the buffer growing past what
+  // a line needs.
+  if (r->capacity - r->start - r->len < r->chunk_size && r->start > 0) {
+    memmove(r->buf, r->buf + r->start, r->len);
+    r->start = 0;
+  }
+  if (r->capacity - r->len < r->chunk_size) {
+    size_t capacity = r->capacity * 2;
+    if (capacity < r->len + r->chunk_size) {
+      capacity = r->len + r->chunk_size;
+    }
+    r->buf = REALLOC(r->buf, char, capacity);
+    r->capacity = capacity;
+  }
+  char *end = r->buf + r->start + r->len;
+  ssize_t nread;
+  // A read interrupted by Future.cancel() fails with EINTR.
+  while ((nread = read(r->fd, end, r->capacity - r->start - r->len)) < 0 &&
+         EINTR == errno && !task_is_cancelled(task)) {
+  }
+  if (nread < 0) {
+    atomic_store(&r->is_filling, false);
+    return task_is_cancelled(task)
+               ? NONE_ENTITY
+               : raise_error(task, ctx, "Could not read file.");
+  }
+  if (0 == nread) {
+    r->is_eof = true;
+  }
+  r->len += nread;
+  // Last, since the reader may be filled again as soon as this is cleared.
+  atomic_store(&r->is_filling, false);
+  return entity_int(nread);
+}
+
+// Returns the next line, with its '\n', or NULL if more has to be read.
+// After the end of the file the last line may have no '\n'.
+Object *_buffered_reader_next(Heap *heap, _BufferedReader *r) {
+  char *start = r->buf + r->start;
+  char *newline = memchr(start + r->searched, '\n', r->len - r->searched);
+  size_t line_len;
+  if (NULL != newline) {
+    line_len = newline - start + 1;
+  } else if (r->is_eof && r->len > 0) {
+    line_len = r->len;
+  } else {
+    r->searched = r->len;
+    return NULL;
+  }
+  Object *line = string_new(heap, start, line_len);
+  r->start += line_len;
+  r->len -= line_len;
+  r->searched = 0;
+  if (0 == r->len) {
+    r->start = 0;
+  }
+  return line;
+}
+
+// Returns the next line, or None if fill() has to be called first or the
+// file has ended.
+Entity _buffered_reader_line(Task *task, Context *ctx, Object *obj,
+                             Entity *args) {
+  _BufferedReader *r = (_BufferedReader *)obj->_internal_obj;
+  if (atomic_load(&r->is_filling)) {
+    return raise_error(task, ctx, "BufferedReader is being filled.");
+  }
+  if (NULL == r->buf) {
+    return NONE_ENTITY;
+  }
+  Object *line = _buffered_reader_next(task->parent_process->heap, r);
+  return NULL == line ? NONE_ENTITY : entity_object(line);
+}
+
+// Appends every line read so far to the given Array.
+Entity _buffered_reader_lines(Task *task, Context *ctx, Object *obj,
+                              Entity *args) {
+  _BufferedReader *r = (_BufferedReader *)obj->_internal_obj;
+  if (atomic_load(&r->is_filling)) {
+    return raise_error(task, ctx, "BufferedReader is being filled.");
+  }
+  if (!IS_CLASS(args, Class_Array)) {
+    return raise_error(task, ctx, "Lines can only be added to an Array.");
+  }
+  Heap *heap = task->parent_process->heap;
+  Object *lines = args->obj;
+  Object *line;
+  while (NULL != r->buf && NULL != (line = _buffered_reader_next(heap, r))) {
+    Entity e_line = entity_object(line);
+    array_add(heap, lines, &e_line);
+  }
+  return entity_object(lines);
+}
+
+// Returns True once the file has ended and every line has been taken.
+Entity _buffered_reader_is_done(Task *task, Context *ctx, Object *obj,
+                                Entity *args) {
+  _BufferedReader *r = (_BufferedReader *)obj->_internal_obj;
+  return (r->fd < 0 || r->is_eof) && 0 == r->len ? entity_int(1)
+                                                 : NONE_ENTITY;
+}
+
+Entity _buffered_reader_is_eof(Task *task, Context *ctx, Object *obj,
+                               Entity *args) {
+  _BufferedReader *r = (_BufferedReader *)obj->_internal_obj;
+  return r->fd < 0 || r->is_eof ? entity_int(1) : NONE_ENTITY;
+}
+
+Entity _buffered_reader_close(Task *task, Context *ctx, Object *obj,
+                              Entity *args) {
+  _BufferedReader *r = (_BufferedReader *)obj->_internal_obj;
+  if (atomic_load(&r->is_filling)) {
+    return raise_error(task, ctx, "BufferedReader is being filled.");
+  }
+  if (r->fd >= 0) {
+    close(r->fd);
+    r->fd = -1;
+  }
+  r->start = r->len = r->searched = 0;
+  return NONE_ENTITY;
+}
+
+// Writes all [len] bytes of [buf]. Returns false on failure.
+bool _write_fully(int fd, const char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t written = write(fd, buf, len);
+    if (written < 0) {
+      if (EINTR == errno) {
+        continue;
+      }
+      return false;
+    }
+    buf += written;
+    len -= written;
+  }
+  return true;
+}
+
+void _buffered_writer_init(Object *obj) {
+  _BufferedWriter *w = ALLOC2(_BufferedWriter);
+  w->fd = -1;
+  w->use_uring = false;
+  w->buf = NULL;
+  w->len = w->capacity = 0;
+  w->flushing = NULL;
+  w->flushing_len = 0;
+  obj->_internal_obj = w;
+}
+
+void _buffered_writer_delete(Object *obj) {
+  _BufferedWriter *w = (_BufferedWriter *)obj->_internal_obj;
+  // Whatever was never flushed is dropped. Writing it here would block the
+  // collector and could land ahead of a flush still in flight on io_uring.
+  if (w->fd >= 0) {
+    close(w->fd);
+  }
+  if (NULL != w->buf) {
+    DEALLOC(w->buf);
+  }
+  DEALLOC(w);
+}
+
+Entity _buffered_writer_constructor(Task *task, Context *ctx, Object *obj,
+                                    Entity *args) {
+  _BufferedWriter *w = (_BufferedWriter *)obj->_internal_obj;
+  int fd;
+  w->capacity = BUFFERED_DEFAULT_SIZE;
+  if (!_buffered_args(args, &fd, &w->capacity)) {
+    return raise_error(task, ctx,
+                       "BufferedWriter takes a file descriptor and a size.");
+  }
+  w->fd = dup(fd);
+  if (w->fd < 0) {
+    return raise_error(task, ctx, "Invalid file descriptor.");
+  }
+  struct stat st;
+  // Same as _file_uring_fd(), only regular files go to the ring.
+  w->use_uring = NULL != task->parent_process->vm->uring &&
+                 0 == fstat(w->fd, &st) && S_ISREG(st.st_mode);
+  w->buf = ALLOC_ARRAY(char, w->capacity);
+  return entity_object(obj);
+}
+
+// Buffers a String. Returns True once the buffer is full and should be
+// flushed.
+Entity _buffered_writer_append(Task *task, Context *ctx, Object *obj,
+                               Entity *args) {
+  _BufferedWriter *w = (_BufferedWriter *)obj->_internal_obj;
+  if (w->fd < 0) {
+    return raise_error(task, ctx, "BufferedWriter is closed.");
+  }
+  if (!IS_CLASS(args, Class_String)) {
+    return raise_error(task, ctx, "BufferedWriter can only write Strings.");
+  }
+  String *string = (String *)args->obj->_internal_obj;
+  size_t len = String_size(string);
+  if (w->len + len > w->capacity) {
+    size_t capacity = w->capacity * 2;
+    if (capacity < w->len + len) {
+      capacity = w->len + len;
+    }
+    w->buf = REALLOC(w->buf, char, capacity);
+    w->capacity = capacity;
+  }
+  memcpy(w->buf + w->len, string->table, len);
+  w->len += len;
+  return w->len >= w->capacity ? entity_int(1) : NONE_ENTITY;
+}
+
+// Hands everything buffered to the file. The buffer is swapped out, so more
+// can be appended while the write is in flight.
+Entity _buffered_writer_flush(Task *task, Context *ctx, Object *obj,
+                              Entity *args) {
+  _BufferedWriter *w = (_BufferedWriter *)obj->_internal_obj;
+  if (w->fd < 0) {
+    return raise_error(task, ctx, "BufferedWriter is closed.");
+  }
+  if (0 == w->len) {
+    return NONE_ENTITY;
+  }
+  if (w->use_uring) {
+    _FileOp *op =
+        _file_op_create(FILE_OP_WRITE, dup(w->fd), w->buf, w->len, -1);
+    w->buf = ALLOC_ARRAY(char, w->capacity);
+    w->len = 0;
+    return _file_op_start(task, op);
+  }
+  if (NULL != w->flushing) {
+    return raise_error(task, ctx, "BufferedWriter is already flushing.");
+  }
+  w->flushing = w->buf;
+  w->flushing_len = w->len;
+  w->buf = ALLOC_ARRAY(char, w->capacity);
+  w->len = 0;
+  return entity_object(
+      vm_call_in_background(task, ctx, _flush_in_background, obj, args));
+}
+
+Entity _buffered_writer_flush_blocking(Task *task, Context *ctx, Object *obj,
+                                       Entity *args) {
+  _BufferedWriter *w = (_BufferedWriter *)obj->_internal_obj;
+  bool is_ok = _write_fully(w->fd, w->flushing, w->flushing_len);
+  DEALLOC(w->flushing);
+  w->flushing = NULL;
+  w->flushing_len = 0;
+  return is_ok ? NONE_ENTITY : raise_error(task, ctx, "Could not write file.");
+}
+
+Entity _buffered_writer_close(Task *task, Context *ctx, Object *obj,
+                              Entity *args) {
+  _BufferedWriter *w = (_BufferedWriter *)obj->_internal_obj;
+  if (NULL != w->flushing) {
+    return raise_error(task, ctx, "BufferedWriter is flushing.");
+  }
+  if (w->fd >= 0) {
+    close(w->fd);
+    w->fd = -1;
+  }
+  w->len = 0;
+  return NONE_ENTITY;
+}
+
+void _mapped_file_init(Object *obj) {
+  _MappedFile *m = ALLOC2(_MappedFile);
+  m->data = NULL;
+  m->len = 0;
+  m->owner = NULL;
+  m->mapping = NULL;
+  m->mapping_len = 0;
+  obj->_internal_obj = m;
+}
+
+void _mapped_file_delete(Object *obj) {
+  _MappedFile *m = (_MappedFile *)obj->_internal_obj;
+  // Views never unmap, the owner they point at outlives them.
+  if (NULL != m->mapping) {
+    munmap(m->mapping, m->mapping_len);
+  }
+  DEALLOC(m);
+}
+
+// Returns a view of [len] bytes at [data] of the mapping behind [obj].
+Object *_mapped_file_view(Heap *heap, Object *obj, const char *data,
+                          size_t len) {
+  _MappedFile *m = (_MappedFile *)obj->_internal_obj;
+  Object *owner = NULL == m->owner ? obj : m->owner;
+  Object *view_obj = heap_new(heap, Class_MappedFile);
+  _MappedFile *view = (_MappedFile *)view_obj->_internal_obj;
+  view->data = data;
+  view->len = len;
+  view->owner = owner;
+  heap_inc_edge(heap, view_obj, owner);
+  return view_obj;
+}
+
+// Returns the first [needle_len] bytes equal to [needle] in [len] bytes from
+// [data], or NULL.
+const char *_find_bytes(const char *data, size_t len, const char *needle,
+                        size_t needle_len) {
+  if (0 == needle_len) {
+    return data;
+  }
+  const char *end = data + len;
+  const char *pos = data;
+  while ((size_t)(end - pos) >= needle_len &&
+         NULL != (pos = memchr(pos, needle[0], end - pos - needle_len + 1))) {
+    if (0 == memcmp(pos, needle, needle_len)) {
+      return pos;
+    }
+    ++pos;
+  }
+  return NULL;
+}
+
+// Gets the bytes of a String or MappedFile argument. Returns false if it is
+// neither.
+bool _bytes_of(const Entity *e, const char **data, size_t *len) {
+  if (IS_CLASS(e, Class_String)) {
+    String *str = (String *)e->obj->_internal_obj;
+    *data = str->table;
+    *len = String_size(str);
+    return true;
+  }
+  if (IS_CLASS(e, Class_MappedFile)) {
+    _MappedFile *m = (_MappedFile *)e->obj->_internal_obj;
+    *data = m->data;
+    *len = m->len;
+    return true;
+  }
+  return false;
+}
+
+// Maps the file at the given path read-only. The mapping is not charged to
+// the heap, since the page cache backs it.
+Entity _map_file(Task *task, Context *ctx, Object *obj, Entity *args) {
+  if (!IS_CLASS(args, Class_String)) {
+    return raise_error(task, ctx, "map_file() takes a path.");
+  }
+  char *fn = _String_nullterm((String *)args->obj->_internal_obj);
+  int fd = open(fn, O_RDONLY);
+  DEALLOC(fn);
+  struct stat st;
+  if (fd < 0 || 0 != fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+    if (fd >= 0) {
+      close(fd);
+    }
+    return raise_error(task, ctx, "File could not be mapped.");
+  }
+  void *mapping = NULL;
+  // An empty file cannot be mapped, so it gets an empty view.
+  if (st.st_size > 0) {
+    mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  // The mapping keeps the file open.
+  close(fd);
+  if (MAP_FAILED == mapping) {
+    return raise_error(task, ctx, "File could not be mapped.");
+  }
+  Object *mapped_obj = heap_new(task->parent_process->heap, Class_MappedFile);
+  _MappedFile *m = (_MappedFile *)mapped_obj->_internal_obj;
+  m->data = (const char *)mapping;
+  m->len = st.st_size;
+  m->mapping = mapping;
+  m->mapping_len = st.st_size;
+  return entity_object(mapped_obj);
+}
+
+Entity _mapped_file_len(Task *task, Context *ctx, Object *obj, Entity *args) {
+  _MappedFile *m = (_MappedFile *)obj->_internal_obj;
+  if (m->len > INT32_MAX) {
+    return raise_error(task, ctx,
+                       "MappedFile is too long for an Int, split() it first.");
+  }
+  return entity_int(m->len);
+}
+
+Entity _mapped_file_index(Task *task, Context *ctx, Object *obj,
+                          Entity *args) {
+  _MappedFile *m = (_MappedFile *)obj->_internal_obj;
+  if (!IS_INT(args)) {
+    return raise_error(task, ctx, "Bad MappedFile index input");
+  }
+  int32_t index = pint(&args->pri);
+  if (index < 0 || (size_t)index >= m->len) {
+    return raise_error(task, ctx, "Index out of bounds.");
+  }
+  return entity_char(m->data[index]);
+}
+
+// Returns a view of num_chars bytes from start, or of the rest if num_chars
+// is not given. Nothing is copied.
+Entity _mapped_file_substr(Task *task, Context *ctx, Object *obj,
+                           Entity *args) {
+  _MappedFile *m = (_MappedFile *)obj->_internal_obj;
+  const Entity *e_start = args, *e_num_chars = NULL;
+  if (IS_TUPLE(args)) {
+    Tuple *tuple = (Tuple *)args->obj->_internal_obj;
+    e_start = tuple_get(tuple, 0);
+    e_num_chars = tuple_size(tuple) > 1 ? tuple_get(tuple, 1) : NULL;
+  }
+  if (!IS_INT(e_start) || pint(&e_start->pri) < 0 ||
+      (size_t)pint(&e_start->pri) > m->len) {
+    return raise_error(task, ctx, "Index out of bounds.");
+  }
+  size_t start = pint(&e_start->pri);
+  size_t num_chars = m->len - start;
+  if (!IS_NONE(e_num_chars)) {
+    if (!IS_INT(e_num_chars) || pint(&e_num_chars->pri) < 0 ||
+        (size_t)pint(&e_num_chars->pri) > num_chars) {
+      return raise_error(task, ctx, "Index out of bounds.");
+    }
+    num_chars = pint(&e_num_chars->pri);
+  }
+  return entity_object(_mapped_file_view(task->parent_process->heap, obj,
+                                         m->data + start, num_chars));
+}
+
+// Returns the index of the first match of a String at or after index, or
+// None.
+Entity _mapped_file_find(Task *task, Context *ctx, Object *obj, Entity *args) {
+  _MappedFile *m = (_MappedFile *)obj->_internal_obj;
+  const Entity *e_sub = args, *e_index = NULL;
+  if (IS_TUPLE(args)) {
+    Tuple *tuple = (Tuple *)args->obj->_internal_obj;
+    e_sub = tuple_get(tuple, 0);
+    e_index = tuple_size(tuple) > 1 ? tuple_get(tuple, 1) : NULL;
+  }
+  const char *sub;
+  size_t sub_len;
+  if (!_bytes_of(e_sub, &sub, &sub_len)) {
+    return raise_error(task, ctx, "Only a String can be in a MappedFile.");
+  }
+  size_t index = 0;
+  if (!IS_NONE(e_index)) {
+    if (!IS_INT(e_index) || pint(&e_index->pri) < 0) {
+      return raise_error(task, ctx, "Expected a starting index.");
+    }
+    index = pint(&e_index->pri);
+  }
+  if (index > m->len) {
+    return NONE_ENTITY;
+  }
+  const char *found =
+      _find_bytes(m->data + index, m->len - index, sub, sub_len);
+  if (NULL == found || (size_t)(found - m->data) > INT32_MAX) {
+    return NONE_ENTITY;
+  }
+  return entity_int(found - m->data);
+}
+
+// Returns an Array of views of the parts between each delimiter. A trailing
+// delimiter does not add an empty part, so splitting on '\n' gives the lines.
+Entity _mapped_file_split(Task *task, Context *ctx, Object *obj,
+                          Entity *args) {
+  _MappedFile *m = (_MappedFile *)obj->_internal_obj;
+  const char *delim;
+  size_t delim_len;
+  if (!_bytes_of(args, &delim, &delim_len) || 0 == delim_len) {
+    return raise_error(task, ctx,
+                       "MappedFile.split() takes a non-empty String.");
+  }
+  Heap *heap = task->parent_process->heap;
+  Object *parts = heap_new(heap, Class_Array);
+  const char *pos = m->data, *end = m->data + m->len, *found;
+  while (pos < end &&
+         NULL != (found = _find_bytes(pos, end - pos, delim, delim_len))) {
+    Entity part = entity_object(_mapped_file_view(heap, obj, pos, found - pos));
+    array_add(heap, parts, &part);
+    pos = found + delim_len;
+  }
+  if (pos < end) {
+    Entity part = entity_object(_mapped_file_view(heap, obj, pos, end - pos));
+    array_add(heap, parts, &part);
+  }
+  return entity_object(parts);
+}
+
+Entity _mapped_file_starts_with(Task *task, Context *ctx, Object *obj,
+                                Entity *args) {
+  _MappedFile *m = (_MappedFile *)obj->_internal_obj;
+  const char *prefix;
+  size_t prefix_len;
+  if (!_bytes_of(args, &prefix, &prefix_len) || prefix_len > m->len) {
+    return NONE_ENTITY;
+  }
+  return 0 == memcmp(m->data, prefix, prefix_len) ? entity_int(1)
+                                                  : NONE_ENTITY;
+}
+
+// Copies the view into a String.
+Entity _mapped_file_to_s(Task *task, Context *ctx, Object *obj, Entity *args) {
+  _MappedFile *m = (_MappedFile *)obj->_internal_obj;
+  if (m->len >= UINT32_MAX) {
+    return raise_error(task, ctx, "MappedFile is too long for a String.");
+  }
+  return entity_object(string_new(task->parent_process->heap, m->data, m->len));
+}
+
 void _watch_dir_init(Object *obj) {
   _WatchDir *wd = ALLOC2(_WatchDir);
   obj->_internal_obj = wd;
@@ -338,11 +1263,52 @@ Entity _file_watcher_close(Task *task, Context *ctx, Object *obj,
 void io_add_native(ModuleManager *mm, Module *io) {
   Class *file = native_class(io, intern("__File"), __file_init, __file_delete);
   native_method(file, CONSTRUCTOR_KEY, _file_constructor);
-  native_background_method(file, intern("__close"), _file_close);
-  native_background_method(file, intern("__gets"), _file_gets);
-  native_background_method(file, intern("__getline"), _file_getline);
-  native_background_method(file, intern("__getall"), _file_getall);
-  native_background_method(file, intern("__puts"), _file_puts);
+  native_background_method(file, intern("__close"), _file_close, BACKGROUND_IO);
+  native_method(file, intern("__fileno"), _file_fileno);
+  native_method(file, intern("__sync"), _file_sync);
+  native_method(file, intern("__size"), _file_size);
+  native_background_method(file, intern("__gets"), _file_gets, BACKGROUND_IO);
+  native_background_method(file, intern("__getline"), _file_getline,
+                           BACKGROUND_IO);
+  native_method(file, intern("__getall"), _file_getall);
+  native_method(file, intern("__puts"), _file_puts);
+  _getall_in_background = native_background_method(
+      file, intern("$getall"), _file_getall_blocking, BACKGROUND_IO);
+  _puts_in_background = native_background_method(
+      file, intern("$puts"), _file_puts_blocking, BACKGROUND_IO);
+
+  Class *reader = native_class(io, intern("__BufferedReader"),
+                               _buffered_reader_init, _buffered_reader_delete);
+  native_method(reader, CONSTRUCTOR_KEY, _buffered_reader_constructor);
+  native_method(reader, intern("__fill"), _buffered_reader_fill);
+  native_method(reader, intern("__line"), _buffered_reader_line);
+  native_method(reader, intern("__lines"), _buffered_reader_lines);
+  native_method(reader, intern("__is_done"), _buffered_reader_is_done);
+  native_method(reader, intern("__is_eof"), _buffered_reader_is_eof);
+  native_method(reader, intern("__close"), _buffered_reader_close);
+  _fill_in_background = native_background_method(
+      reader, intern("$fill"), _buffered_reader_fill_blocking, BACKGROUND_IO);
+
+  Class *writer = native_class(io, intern("__BufferedWriter"),
+                               _buffered_writer_init, _buffered_writer_delete);
+  native_method(writer, CONSTRUCTOR_KEY, _buffered_writer_constructor);
+  native_method(writer, intern("__append"), _buffered_writer_append);
+  native_method(writer, intern("__flush"), _buffered_writer_flush);
+  native_method(writer, intern("__close"), _buffered_writer_close);
+  _flush_in_background = native_background_method(
+      writer, intern("$flush"), _buffered_writer_flush_blocking, BACKGROUND_IO);
+
+  native_function(io, intern("map_file"), _map_file);
+  Class_MappedFile = native_class(io, intern("MappedFile"), _mapped_file_init,
+                                  _mapped_file_delete);
+  native_method(Class_MappedFile, intern("len"), _mapped_file_len);
+  native_method(Class_MappedFile, ARRAYLIKE_INDEX_KEY, _mapped_file_index);
+  native_method(Class_MappedFile, intern("substr"), _mapped_file_substr);
+  native_method(Class_MappedFile, intern("find"), _mapped_file_find);
+  native_method(Class_MappedFile, intern("split"), _mapped_file_split);
+  native_method(Class_MappedFile, intern("starts_with"),
+                _mapped_file_starts_with);
+  native_method(Class_MappedFile, intern("to_s"), _mapped_file_to_s);
 
   Class_WatchDir = native_class(io, intern("__WatchDir"), _watch_dir_init,
                                 _watch_dir_delete);
@@ -351,7 +1317,8 @@ void io_add_native(ModuleManager *mm, Module *io) {
   native_method(file_watcher, intern("__is_valid"), _file_watcher_is_valid);
   native_method(file_watcher, intern("__watch"), _file_watcher_watch);
   native_method(file_watcher, intern("__unwatch"), _file_watcher_unwatch);
-  native_background_method(file_watcher, intern("__read"), _file_watcher_read);
+  native_background_method(file_watcher, intern("__read"), _file_watcher_read,
+                           BACKGROUND_IO);
   native_method(file_watcher, intern("__get_read"), _file_watcher_get_read);
   native_method(file_watcher, intern("__close"), _file_watcher_close);
 }
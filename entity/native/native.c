@@ -17,9 +17,10 @@ Function *native_method(Class *class, const char name[], NativeFn native_fn) {
 }
 
 Function *native_background_method(Class *class, const char *name,
-                                   NativeFn native_fn) {
+                                   NativeFn native_fn, BackgroundPool pool) {
   Function *fn = native_method(class, name, native_fn);
   fn->_is_background = true;
+  fn->_background_pool = pool;
   fn->_is_async = true;
   return fn;
 }
@@ -33,9 +34,10 @@ Function *native_function(Module *module, const char name[],
 }
 
 Function *native_background_function(Module *module, const char name[],
-                                     NativeFn native_fn) {
+                                     NativeFn native_fn, BackgroundPool pool) {
   Function *fn = native_function(module, name, native_fn);
   fn->_is_background = true;
+  fn->_background_pool = pool;
   fn->_is_async = true;
   return fn;
 }
@@ -27,11 +27,12 @@
 typedef Entity (*NativeFn)(Task *, Context *, Object *obj, Entity *args);
 
 Function *native_method(Class *class, const char *name, NativeFn native_fn);
+// Background natives run on the VM's [pool] and return a Future.
 Function *native_background_method(Class *class, const char *name,
-                                   NativeFn native_fn);
+                                   NativeFn native_fn, BackgroundPool pool);
 Function *native_function(Module *module, const char *name, NativeFn native_fn);
 Function *native_background_function(Module *module, const char name[],
-                                     NativeFn native_fn);
+                                     NativeFn native_fn, BackgroundPool pool);
 Class *native_class(Module *module, const char name[], ObjInitFn init_fn,
                     ObjDelFn del_fn);
 
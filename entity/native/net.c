@@ -0,0 +1,164 @@
+// net.c
+//
+// Created on: Oct 18, 2026
+//     Author: Jeff Manzione
+
+#include "entity/native/net.h"
+
+#include <string.h>
+
+#include "alloc/alloc.h"
+#include "alloc/arena/intern.h"
+#include "entity/class/classes.h"
+#include "entity/entity.h"
+#include "entity/native/error.h"
+#include "entity/native/native.h"
+#include "entity/string/string.h"
+#include "entity/string/string_helper.h"
+#include "entity/tuple/tuple.h"
+
+static Class *Class_HttpRequest = NULL;
+
+// A request received by SocketHandle.receive_request(). Its parts are only
+// turned into Strings when asked for.
+typedef struct {
+  // The head followed by the body.
+  char *data;
+  size_t len;
+  HttpRequestHead head;
+} _HttpRequest;
+
+void _http_request_init(Object *obj) {
+  _HttpRequest *req = ALLOC2(_HttpRequest);
+  req->data = NULL;
+  req->len = 0;
+  obj->_internal_obj = req;
+}
+
+void _http_request_delete(Object *obj) {
+  _HttpRequest *req = (_HttpRequest *)obj->_internal_obj;
+  if (NULL == req) {
+    return;
+  }
+  if (NULL != req->data) {
+    DEALLOC(req->data);
+  }
+  DEALLOC(req);
+}
+
+Object *http_request_new(Heap *heap, const char *data, size_t len,
+                         const HttpRequestHead *head) {
+  if (NULL == Class_HttpRequest) {
+    return NULL;
+  }
+  Object *obj = heap_new(heap, Class_HttpRequest);
+  _HttpRequest *req = (_HttpRequest *)obj->_internal_obj;
+  req->data = ALLOC_ARRAY(char, len + 1);
+  memcpy(req->data, data, len);
+  req->len = len;
+  req->head = *head;
+  heap_charge(heap, obj, len);
+  return obj;
+}
+
+static inline Entity _span_string(Heap *heap, const _HttpRequest *req,
+                                  HttpSpan span) {
+  return entity_object(string_new(heap, req->data + span.start, span.len));
+}
+
+Entity _http_request_method(Task *task, Context *ctx, Object *obj,
+                            Entity *args) {
+  _HttpRequest *req = (_HttpRequest *)obj->_internal_obj;
+  return _span_string(task->parent_process->heap, req, req->head.method);
+}
+
+Entity _http_request_target(Task *task, Context *ctx, Object *obj,
+                            Entity *args) {
+  _HttpRequest *req = (_HttpRequest *)obj->_internal_obj;
+  return _span_string(task->parent_process->heap, req, req->head.target);
+}
+
+Entity _http_request_path(Task *task, Context *ctx, Object *obj,
+                          Entity *args) {
+  _HttpRequest *req = (_HttpRequest *)obj->_internal_obj;
+  return _span_string(task->parent_process->heap, req, req->head.path);
+}
+
+Entity _http_request_query(Task *task, Context *ctx, Object *obj,
+                           Entity *args) {
+  _HttpRequest *req = (_HttpRequest *)obj->_internal_obj;
+  return _span_string(task->parent_process->heap, req, req->head.query);
+}
+
+Entity _http_request_version(Task *task, Context *ctx, Object *obj,
+                             Entity *args) {
+  _HttpRequest *req = (_HttpRequest *)obj->_internal_obj;
+  return _span_string(task->parent_process->heap, req, req->head.version);
+}
+
+// Returns the value of the header named by the String [args], ignoring case,
+// or None.
+Entity _http_request_header(Task *task, Context *ctx, Object *obj,
+                            Entity *args) {
+  if (!IS_CLASS(args, Class_String)) {
+    return raise_error(task, ctx, "Expected a header name.");
+  }
+  _HttpRequest *req = (_HttpRequest *)obj->_internal_obj;
+  String *name = (String *)args->obj->_internal_obj;
+  int i = http_request_find_header(&req->head, req->data, name->table,
+                                   String_size(name));
+  if (i < 0) {
+    return NONE_ENTITY;
+  }
+  return _span_string(task->parent_process->heap, req,
+                      req->head.header_values[i]);
+}
+
+// Returns every header as an Array of (name, value) Tuples, in order.
+Entity _http_request_headers(Task *task, Context *ctx, Object *obj,
+                             Entity *args) {
+  _HttpRequest *req = (_HttpRequest *)obj->_internal_obj;
+  Heap *heap = task->parent_process->heap;
+  Object *arr_obj = heap_new(heap, Class_Array);
+  uint32_t i;
+  for (i = 0; i < req->head.num_headers; ++i) {
+    Entity name = _span_string(heap, req, req->head.header_names[i]);
+    Entity value = _span_string(heap, req, req->head.header_values[i]);
+    Object *tuple_obj = heap_new(heap, Class_Tuple);
+    tuple_obj->_internal_obj = tuple_create(2);
+    Entity tuple_e = entity_object(tuple_obj);
+    tuple_set(heap, tuple_obj, 0, &name);
+    tuple_set(heap, tuple_obj, 1, &value);
+    array_add(heap, arr_obj, &tuple_e);
+  }
+  return entity_object(arr_obj);
+}
+
+Entity _http_request_body(Task *task, Context *ctx, Object *obj,
+                          Entity *args) {
+  _HttpRequest *req = (_HttpRequest *)obj->_internal_obj;
+  return entity_object(string_new(task->parent_process->heap,
+                                  req->data + req->head.head_len,
+                                  req->len - req->head.head_len));
+}
+
+Entity _http_request_keep_alive(Task *task, Context *ctx, Object *obj,
+                                Entity *args) {
+  _HttpRequest *req = (_HttpRequest *)obj->_internal_obj;
+  return req->head.keep_alive ? entity_int(1) : NONE_ENTITY;
+}
+
+void net_add_native(ModuleManager *mm, Module *net) {
+  Class_HttpRequest = native_class(net, intern("__HttpRequest"),
+                                   _http_request_init, _http_request_delete);
+  native_method(Class_HttpRequest, intern("method"), _http_request_method);
+  native_method(Class_HttpRequest, intern("target"), _http_request_target);
+  native_method(Class_HttpRequest, intern("path"), _http_request_path);
+  native_method(Class_HttpRequest, intern("query"), _http_request_query);
+  native_method(Class_HttpRequest, intern("version"), _http_request_version);
+  native_method(Class_HttpRequest, intern("header"), _http_request_header);
+  native_method(Class_HttpRequest, intern("headers"), _http_request_headers);
+  native_method(Class_HttpRequest, intern("body"), _http_request_body);
+  native_method(Class_HttpRequest, intern("keep_alive"),
+                _http_request_keep_alive);
+}
@@ -0,0 +1,24 @@
+// net.h
+//
+// Created on: Oct 18, 2026
+//     Author: Jeff Manzione
+
+#ifndef ENTITY_NATIVE_NET_H_
+#define ENTITY_NATIVE_NET_H_
+
+#include <stddef.h>
+
+#include "entity/object.h"
+#include "heap/heap.h"
+#include "util/http_parser.h"
+#include "vm/module_manager.h"
+
+void net_add_native(ModuleManager *mm, Module *net);
+
+// Returns a net.__HttpRequest holding a copy of the [len] bytes of a request
+// at [data], whose head was parsed into [head]. Returns NULL if the net
+// module has not been loaded.
+Object *http_request_new(Heap *heap, const char *data, size_t len,
+                         const HttpRequestHead *head);
+
+#endif /* ENTITY_NATIVE_NET_H_ */
@@ -5,19 +5,17 @@
 
 #include "entity/native/process.h"
 
-#if defined(OS_WINDOWS)
-#include <synchapi.h>
-#else
-#include <unistd.h>
-#endif
-
+#include "alloc/alloc.h"
 #include "alloc/arena/intern.h"
 #include "entity/class/class.h"
 #include "entity/class/classes.h"
+#include "entity/native/async.h"
 #include "entity/native/error.h"
 #include "entity/native/native.h"
 #include "entity/object.h"
 #include "entity/tuple/tuple.h"
+#include "heap/heap.h"
+#include "struct/q.h"
 #include "struct/struct_defaults.h"
 #include "util/sync/thread.h"
 #include "vm/intern.h"
@@ -25,11 +23,9 @@
 #include "vm/process/process.h"
 #include "vm/process/processes.h"
 #include "vm/process/task.h"
+#include "vm/virtual_machine.h"
 #include "vm/vm.h"
 
-// From vm/virtual_machine.h
-ThreadHandle process_run_in_new_thread(Process *process);
-
 // void _remote_init(Object *obj) {}
 // void _remote_delete(Object *obj) {}
 
@@ -41,18 +37,37 @@ Entity _create_process(Task *task, Context *ctx, Object *obj, Entity *args) {
         "ANY).");
   }
   Tuple *tuple = (Tuple *)args->obj->_internal_obj;
-  if (2 != tuple_size(tuple)) {
-    return raise_error(task, ctx, "create_process expects 2 args.");
+  if (2 != tuple_size(tuple) && 4 != tuple_size(tuple)) {
+    return raise_error(task, ctx, "create_process expects 2 or 4 args.");
   }
   const Entity *fn = tuple_get(tuple, 0);
   const Entity *fn_args = tuple_get(tuple, 1);
   if (!IS_OBJECT(fn) || !inherits_from(fn->obj->_class, Class_Function)) {
     return raise_error(task, ctx, "create_processes expects (Function, ANY).");
   }
+  HeapLimits limits = task->parent_process->vm->heap_limits;
+  if (4 == tuple_size(tuple)) {
+    const Entity *max_objects = tuple_get(tuple, 2);
+    const Entity *max_bytes = tuple_get(tuple, 3);
+    if (!IS_INT(max_objects) || !IS_INT(max_bytes) ||
+        pint(&max_objects->pri) < 0 || pint(&max_bytes->pri) < 0) {
+      return raise_error(task, ctx,
+                         "create_process heap limits must be non-negative "
+                         "ints.");
+    }
+    // 0 keeps the VM default.
+    if (0 != pint(&max_objects->pri)) {
+      limits.max_objects = pint(&max_objects->pri);
+    }
+    if (0 != pint(&max_bytes->pri)) {
+      limits.max_bytes = pint(&max_bytes->pri);
+    }
+  }
 
   Function *f = fn->obj->_function_obj;
 
   Process *p = vm_create_process(task->parent_process->vm);
+  heap_set_limits(p->heap, &limits);
   Task *t = process_create_task(p);
 
   t->parent_task = task;
@@ -65,31 +80,307 @@ Entity _create_process(Task *task, Context *ctx, Object *obj, Entity *args) {
   map_finalize(&cps);
   context_set_function(new_ctx, f);
 
-  process_run_in_new_thread(p);
+  process_start(p);
   return entity_object(p->_reflection);
 }
 
+// Copies the argument once into an immutable region that is passed to other
+// processes by reference instead of being copied again.
+Entity _freeze(Task *task, Context *ctx, Object *obj, Entity *args) {
+  if (NULL == args) {
+    return NONE_ENTITY;
+  }
+  return heap_freeze(task->parent_process->heap, args);
+}
+
+// Returns a Future completed by the VM's timer wheel, so a sleeping task holds
+// no thread while it waits.
 Entity _sleep(Task *task, Context *ctx, Object *obj, Entity *args) {
-  double sleep_duration_sec = 0;
-  if (IS_INT(args)) {
-    sleep_duration_sec = pint(&args->pri);
-  } else if (IS_FLOAT(args)) {
-    sleep_duration_sec = pfloat(&args->pri);
-  } else {
+  uint64_t duration_ms;
+  if (!async_duration_ms(args, &duration_ms)) {
     return raise_error(task, ctx, "sleep() expected to be called with number.");
   }
-#if defined(OS_WINDOWS)
-  // Accepts millis as an unsigned long instead of double seconds.
-  Sleep((uint64_t)(sleep_duration_sec * 1000));
-#else
-  sleep(sleep_duration_sec);
-#endif
-  return NONE_ENTITY;
+  TimerId timer_id;
+  Task *timer =
+      async_timer_create(task->parent_process, duration_ms, &timer_id);
+  return entity_object(future_create(timer));
+}
+
+static Class *Class_Pool;
+
+typedef struct __PoolJob _PoolJob;
+
+// A warm Process that runs one job of a Pool after another.
+typedef struct {
+  Process *process;
+  // NULL while idle.
+  _PoolJob *job;
+} _PoolWorker;
+
+// Only touched by the heap owner of [owner], which submits the jobs and
+// collects their results, so nothing here needs a lock.
+typedef struct {
+  Process *owner;
+  _PoolWorker *workers;
+  uint32_t num_workers;
+  // Jobs waiting for an idle worker.
+  Q pending;
+  // Held by the Pool object and by each unfinished job.
+  uint32_t refs;
+} _Pool;
+
+struct __PoolJob {
+  _Pool *pool;
+  _PoolWorker *worker;
+  const Function *fn;
+  // On the owner's heap, pinned until the job is handed to a worker.
+  Entity args;
+  TaskPriority priority;
+  // Never runs. Completed with the job's result by the owner.
+  Task *future_task;
+  Object *future;
+  // On the worker: the task running fn and the one told when it finishes.
+  Task *task;
+  Task *done;
+};
+
+void _pool_init(Object *obj) { obj->_internal_obj = NULL; }
+
+void _pool_release(_Pool *pool) {
+  if (0 != --pool->refs) {
+    return;
+  }
+  // Only released once every job has finished, so the workers are idle.
+  uint32_t i;
+  for (i = 0; i < pool->num_workers; ++i) {
+    process_retire(pool->workers[i].process);
+  }
+  Q_finalize(&pool->pending);
+  DEALLOC(pool->workers);
+  DEALLOC(pool);
+}
+
+// Jobs still queued or running keep the Pool alive until they finish.
+void _pool_delete(Object *obj) {
+  if (NULL != obj->_internal_obj) {
+    _pool_release((_Pool *)obj->_internal_obj);
+  }
+}
+
+Process *_pool_create_worker(VM *vm) {
+  Process *worker = vm_create_process(vm);
+  process_start(worker);
+  return worker;
+}
+
+void _pool_pin(Process *process, const Entity *e) {
+  if (OBJECT == e->type) {
+    heap_inc_edge(process->heap, process->_reflection, e->obj);
+  }
+}
+
+void _pool_unpin(Process *process, const Entity *e) {
+  if (OBJECT == e->type) {
+    heap_dec_edge(process->heap, process->_reflection, e->obj);
+  }
+}
+
+// Called on the worker when the job's task completes or fails.
+void _pool_job_done(Task *done, Task *job_task) {
+  _PoolJob *job = (_PoolJob *)done->dependency_arg;
+  process_post_completion(job->pool->owner, job->future_task);
+}
+
+// Must hold the heap_owner_lock of the worker.
+void _pool_start_job(Process *worker, _PoolJob *job) {
+  job->done = process_create_unqueued_task(worker);
+  job->done->on_dependency_complete = _pool_job_done;
+  job->done->dependency_arg = job;
+
+  Task *t = job->task = process_create_unqueued_task(worker);
+  t->parent_task = job->done;
+  t->priority = job->priority;
+  set_insert(&t->dependent_tasks, job->done);
+  const Function *f = job->fn;
+  Context *ctx = task_create_context(t, f->_module->_reflection,
+                                     (Module *)f->_module, f->_ins_pos);
+  Map cps;
+  map_init_default(&cps);
+  *task_mutable_resval(t) = entity_copy(worker->heap, &cps, &job->args);
+  map_finalize(&cps);
+  context_set_function(ctx, f);
+  process_enqueue_task(worker, t);
+}
+
+void _pool_dispatch(_Pool *pool, _PoolWorker *worker, _PoolJob *job) {
+  worker->job = job;
+  job->worker = worker;
+  Process *process = worker->process;
+  SYNCHRONIZED(process->heap_owner_lock, { _pool_start_job(process, job); });
+  _pool_unpin(pool->owner, &job->args);
+}
+
+// Takes the next pending job, dropping the ones cancelled while queued.
+_PoolJob *_pool_next_job(_Pool *pool) {
+  while (!Q_is_empty(&pool->pending)) {
+    _PoolJob *job = (_PoolJob *)Q_pop(&pool->pending);
+    if (NULL == job->future_task->cancel_error) {
+      return job;
+    }
+    _pool_unpin(pool->owner, &job->args);
+    heap_dec_edge(pool->owner->heap, pool->owner->_reflection, job->future);
+    DEALLOC(job);
+    _pool_release(pool);
+  }
+  return NULL;
+}
+
+// Copies the job's result to the owner and readies the worker for the next
+// job. Must hold the heap_owner_lock of the worker.
+Entity _pool_finish_job(_PoolJob *job, bool *is_error) {
+  Process *owner = job->pool->owner;
+  Process *worker = job->worker->process;
+  *is_error = TASK_ERROR == job->task->state;
+  Map cps;
+  map_init_default(&cps);
+  Entity result = entity_copy(owner->heap, &cps, task_get_resval(job->task));
+  map_finalize(&cps);
+  task_finalize(job->done);
+  if (process_is_finished(worker)) {
+    process_reset(worker, &owner->vm->heap_limits);
+  } else {
+    // The job left work behind, like async calls or sleeps it never waited
+    // on. Let it finish on its own and use a fresh Process instead. The old
+    // one is retired by the caller once its lock is released, and only freed
+    // once nothing can post to it.
+    job->worker->process = _pool_create_worker(owner->vm);
+  }
+  return result;
+}
+
+// Called on the owner when it drains a job posted by _pool_job_done().
+void _pool_job_drained(Task *future_task) {
+  _PoolJob *job = (_PoolJob *)future_task->dependency_arg;
+  _Pool *pool = job->pool;
+  _PoolWorker *worker = job->worker;
+  Process *process = worker->process;
+  Entity result;
+  bool is_error;
+  SYNCHRONIZED(process->heap_owner_lock,
+               { result = _pool_finish_job(job, &is_error); });
+  if (worker->process != process) {
+    process_retire(process);
+  }
+  // Whoever waited on it has already been told it was cancelled.
+  if (NULL == future_task->cancel_error) {
+    *task_mutable_resval(future_task) = result;
+    future_task->state = is_error ? TASK_ERROR : TASK_COMPLETE;
+    if (is_error) {
+      future_set_error(job->future);
+    }
+    process_complete_task(pool->owner, future_task, is_error);
+  }
+  heap_dec_edge(pool->owner->heap, pool->owner->_reflection, job->future);
+  worker->job = NULL;
+  _PoolJob *next = _pool_next_job(pool);
+  if (NULL != next) {
+    _pool_dispatch(pool, worker, next);
+  }
+  DEALLOC(job);
+  _pool_release(pool);
+}
+
+Entity _pool_constructor(Task *task, Context *ctx, Object *obj,
+                         Entity *args) {
+  int32_t num_workers = thread_num_processors();
+  if (NULL != args && NONE != args->type) {
+    if (!IS_INT(args) || pint(&args->pri) <= 0) {
+      return raise_error(task, ctx, "Pool expects a positive Int or None.");
+    }
+    num_workers = pint(&args->pri);
+  }
+  Process *process = task->parent_process;
+  _Pool *pool = ALLOC2(_Pool);
+  pool->owner = process;
+  pool->num_workers = num_workers;
+  pool->workers = ALLOC_ARRAY(_PoolWorker, num_workers);
+  Q_init(&pool->pending);
+  pool->refs = 1;
+  uint32_t i;
+  for (i = 0; i < pool->num_workers; ++i) {
+    pool->workers[i].process = _pool_create_worker(process->vm);
+    pool->workers[i].job = NULL;
+  }
+  obj->_internal_obj = pool;
+  return entity_object(obj);
+}
+
+// Takes a Function or (Function, args) and returns a Future to its result.
+Entity _pool_submit(Task *task, Context *ctx, Object *obj, Entity *args) {
+  _Pool *pool = (_Pool *)obj->_internal_obj;
+  if (NULL == pool || task->parent_process != pool->owner) {
+    return raise_error(task, ctx,
+                       "Pool can only be used by the process creating it.");
+  }
+  const Entity *fn = args;
+  Entity fn_args = NONE_ENTITY;
+  if (IS_TUPLE(args) && 2 == tuple_size((Tuple *)args->obj->_internal_obj)) {
+    Tuple *tuple = (Tuple *)args->obj->_internal_obj;
+    fn = tuple_get(tuple, 0);
+    fn_args = *tuple_get(tuple, 1);
+  }
+  if (NULL == fn || !IS_OBJECT(fn) ||
+      !inherits_from(fn->obj->_class, Class_Function)) {
+    return raise_error(task, ctx, "submit() expects (Function, ANY).");
+  }
+  Process *process = task->parent_process;
+  _PoolJob *job = ALLOC2(_PoolJob);
+  job->pool = pool;
+  job->worker = NULL;
+  job->fn = fn->obj->_function_obj;
+  job->args = fn_args;
+  job->priority = task->priority;
+  job->task = NULL;
+  job->done = NULL;
+  job->future_task = process_create_unqueued_task(process);
+  job->future_task->on_completion_drained = _pool_job_drained;
+  job->future_task->dependency_arg = job;
+  job->future = future_create(job->future_task);
+  process_expect_completion(process);
+  _pool_pin(process, &job->args);
+  heap_inc_edge(process->heap, process->_reflection, job->future);
+  pool->refs++;
+
+  uint32_t i;
+  for (i = 0; i < pool->num_workers; ++i) {
+    if (NULL == pool->workers[i].job) {
+      _pool_dispatch(pool, &pool->workers[i], job);
+      return entity_object(job->future);
+    }
+  }
+  *Q_add_last(&pool->pending) = job;
+  return entity_object(job->future);
+}
+
+Entity _pool_size(Task *task, Context *ctx, Object *obj, Entity *args) {
+  _Pool *pool = (_Pool *)obj->_internal_obj;
+  return entity_int(NULL == pool ? 0 : pool->num_workers);
+}
+
+Entity _num_processors(Task *task, Context *ctx, Object *obj, Entity *args) {
+  return entity_int(thread_num_processors());
 }
 
 void process_add_native(ModuleManager *mm, Module *process) {
   // Class_Remote =
   //     native_class(process, REMOTE_CLASS_NAME, _remote_init, _remote_delete);
   native_function(process, intern("__create_process"), _create_process);
-  native_background_function(process, intern("__sleep"), _sleep);
+  native_function(process, intern("freeze"), _freeze);
+  native_function(process, intern("__sleep"), _sleep);
+  native_function(process, intern("num_processors"), _num_processors);
+
+  Class_Pool = native_class(process, intern("Pool"), _pool_init, _pool_delete);
+  native_method(Class_Pool, CONSTRUCTOR_KEY, _pool_constructor);
+  native_method(Class_Pool, intern("submit"), _pool_submit);
+  native_method(Class_Pool, intern("size"), _pool_size);
 }
@@ -5,25 +5,135 @@
 
 #include "util/socket.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc/alloc.h"
 #include "alloc/arena/intern.h"
 #include "entity/array/array.h"
 #include "entity/class/classes.h"
 #include "entity/entity.h"
+#include "entity/native/async.h"
 #include "entity/native/error.h"
 #include "entity/native/native.h"
+#include "entity/native/net.h"
 #include "entity/object.h"
 #include "entity/string/string.h"
 #include "entity/string/string_helper.h"
 #include "entity/tuple/tuple.h"
+#include "heap/heap.h"
+#include "util/http_parser.h"
+#include "util/reactor.h"
 #include "util/socket.h"
+#include "vm/process/process.h"
 #include "vm/process/processes.h"
+#include "vm/process/task.h"
+#include "vm/virtual_machine.h"
+#include "vm/vm.h"
 
-#define BUFFER_SIZE 4096
 #define SOCKET_ERROR (-1)
+// Pending connections a listening socket holds when listen() is not told.
+#define DEFAULT_NUM_CONNECTIONS 128
 
 static Class *Class_SocketHandle;
 static Class *Class_Socket;
 
+// Blocking versions of accept(), send(), the receives and send_file(), used
+// on sockets that are not in non-blocking mode.
+static Function *_accept_in_background;
+static Function *_send_in_background;
+static Function *_receive_in_background;
+static Function *_receive_exact_in_background;
+static Function *_receive_until_in_background;
+static Function *_receive_into_in_background;
+static Function *_receive_request_in_background;
+static Function *_send_file_in_background;
+static Function *_send_handle_in_background;
+static Function *_receive_handle_in_background;
+
+typedef enum {
+  // Whatever has arrived, as for receive().
+  FRAME_ANY,
+  // Whatever has arrived, appended to a String.
+  FRAME_INTO,
+  FRAME_EXACT,
+  FRAME_UNTIL,
+  // An HTTP request, head and body.
+  FRAME_HTTP,
+} _FrameKind;
+
+// What a receive waits for. Bytes past the end of the frame stay read ahead
+// in the SocketHandle for the next receive.
+typedef struct {
+  _FrameKind kind;
+  // Bytes wanted by receive_exact().
+  size_t len;
+  // The delimiter for receive_until().
+  const char *delim;
+  size_t delim_len;
+  // Most bytes receive_until() reads looking for the delimiter, or that the
+  // head of an HTTP request may take. 0 for no limit.
+  size_t max;
+  // Largest body an HTTP request may have, 0 for no limit.
+  size_t max_body;
+  // How many bytes read ahead are known not to start the delimiter.
+  size_t searched;
+  // For receive_request(). The head is parsed as its bytes arrive, and only
+  // once.
+  HttpParser parser;
+  HttpRequestHead head;
+  bool is_head_parsed;
+} _Frame;
+
+typedef enum {
+  FRAME_READY,
+  FRAME_WAIT,
+  FRAME_INTERRUPTED,
+  FRAME_CLOSED,
+  FRAME_TOO_LONG,
+  FRAME_MALFORMED,
+  FRAME_FAILED,
+} _FrameStatus;
+
+typedef enum {
+  SOCKET_OP_ACCEPT,
+  SOCKET_OP_RECEIVE,
+  SOCKET_OP_SEND,
+  SOCKET_OP_SEND_FILE,
+  SOCKET_OP_SEND_HANDLE,
+  SOCKET_OP_RECEIVE_HANDLE,
+} _SocketOpKind;
+
+// A call on a non-blocking socket that waits on the VM's reactor. Its task
+// never runs, it only completes the Future returned to the caller.
+typedef struct {
+  _SocketOpKind kind;
+  // The Socket or SocketHandle. Pinned, along with the Future, while the op
+  // waits.
+  Object *obj;
+  SOCKET fd;
+  // What is left to send.
+  char *buf;
+  size_t len, sent;
+  // For send_file(), the file being sent and where it starts. For
+  // send_handle(), the descriptor being passed.
+  int file_fd;
+  int64_t file_offset;
+  // For receives. A delimiter is copied into buf.
+  _Frame frame;
+  // The String receive_into() appends to. Pinned while the op waits.
+  Object *target;
+  Task *task;
+  Object *future;
+  // Set when the socket is closed before it is ready.
+  bool is_dropped;
+} _SocketOp;
+
 Entity _SocketHandle_constructor(Task *task, Context *ctx, Object *obj,
                                  Entity *args);
 
@@ -36,6 +146,46 @@ void _SocketHandle_delete(Object *obj) {
   sockethandle_delete((SocketHandle *)obj->_internal_obj);
 }
 
+// Binds [socket] and listens on it. Returns false and sets [error] on
+// failure.
+bool _socket_listen(Task *task, Context *ctx, Socket *socket,
+                    int num_connections, Entity *error) {
+  if (!socket_is_valid(socket)) {
+    *error = raise_error(task, ctx, "Invalid socket.");
+    return false;
+  }
+  if (SOCKET_ERROR == socket_bind(socket)) {
+    *error = raise_error(task, ctx, "Could not bind to socket.");
+    return false;
+  }
+  // Datagram sockets only bind.
+  if (!socket_is_datagram(socket) &&
+      SOCKET_ERROR == socket_listen(socket, num_connections)) {
+    *error = raise_error(task, ctx, "Could not listen to socket.");
+    return false;
+  }
+  // Listening sockets wait on the reactor where there is one.
+  if (NULL != task->parent_process->vm->reactor) {
+    socket_set_non_blocking(socket, true);
+  }
+  return true;
+}
+
+// For AF_UNIX the host is the path, and a leading '@' names the socket in
+// the abstract namespace instead.
+Socket *_unix_socket_create(int type, const String *path) {
+  size_t len = String_size(path);
+  if (len == 0 || '@' != path->table[0]) {
+    return socket_create_unix(type, path->table, len);
+  }
+  char *name = ALLOC_ARRAY(char, len);
+  memcpy(name, path->table, len);
+  name[0] = '\0';
+  Socket *socket = socket_create_unix(type, name, len);
+  DEALLOC(name);
+  return socket;
+}
+
 Entity _Socket_constructor(Task *task, Context *ctx, Object *obj,
                            Entity *args) {
   if (!IS_TUPLE(args)) {
@@ -49,48 +199,80 @@ Entity _Socket_constructor(Task *task, Context *ctx, Object *obj,
 
   String *host = (String *)tuple_get(tuple, 3)->obj->_internal_obj;
 
-  Socket *socket = socket_create(
-      pint(&tuple_get(tuple, 0)->pri), pint(&tuple_get(tuple, 1)->pri),
-      pint(&tuple_get(tuple, 2)->pri),
-      socket_inet_address(host->table, String_size(host)),
-      pint(&tuple_get(tuple, 4)->pri));
+  int domain = pint(&tuple_get(tuple, 0)->pri);
+  Socket *socket =
+      SOCKET_DOMAIN_UNIX == domain
+          ? _unix_socket_create(pint(&tuple_get(tuple, 1)->pri), host)
+          : socket_create(domain, pint(&tuple_get(tuple, 1)->pri),
+                          pint(&tuple_get(tuple, 2)->pri),
+                          socket_inet_address(host->table, String_size(host)),
+                          pint(&tuple_get(tuple, 4)->pri));
 
   obj->_internal_obj = socket;
   // Auto bind/
-  if (NONE != tuple_get(tuple, 6)->type) {
-    if (!socket_is_valid(socket)) {
-      return raise_error(task, ctx, "Invalid socket.");
-    }
-    if (SOCKET_ERROR == socket_bind(socket)) {
-      return raise_error(task, ctx, "Could not bind to socket.");
-    }
-    if (SOCKET_ERROR ==
-        socket_listen(socket, pint(&tuple_get(tuple, 4)->pri))) {
-      return raise_error(task, ctx, "Could not listen to socket.");
-    }
+  Entity error;
+  if (NONE != tuple_get(tuple, 6)->type &&
+      !_socket_listen(task, ctx, socket, pint(&tuple_get(tuple, 5)->pri),
+                      &error)) {
+    return error;
   }
   return entity_object(obj);
 }
 
+// Socket.listen(num_connections=None) binds and listens on a Socket created
+// without auto-bind, e.g. after setting SO_REUSEPORT on it.
+Entity _Socket_listen(Task *task, Context *ctx, Object *obj, Entity *args) {
+  Socket *socket = (Socket *)obj->_internal_obj;
+  if (NULL == socket) {
+    return raise_error(task, ctx, "Weird Socket error.");
+  }
+  int num_connections = DEFAULT_NUM_CONNECTIONS;
+  if (!IS_NONE(args)) {
+    if (!IS_INT(args) || pint(&args->pri) <= 0) {
+      return raise_error(task, ctx, "Expected a positive Int or None.");
+    }
+    num_connections = pint(&args->pri);
+  }
+  Entity error;
+  if (!_socket_listen(task, ctx, socket, num_connections, &error)) {
+    return error;
+  }
+  return NONE_ENTITY;
+}
+
 Entity _Socket_close(Task *task, Context *ctx, Object *obj, Entity *args) {
   Socket *socket = (Socket *)obj->_internal_obj;
   if (NULL == socket) {
     return raise_error(task, ctx, "Weird Socket error.");
   }
+  Reactor *reactor = task->parent_process->vm->reactor;
+  if (NULL != reactor && socket_is_non_blocking(socket)) {
+    reactor_unwatch(reactor, socket_get_socket(socket));
+  }
   socket_close(socket);
   return NONE_ENTITY;
 }
 
 // To ease finding sockethandle class.
-Entity _Socket_accept(Task *task, Context *ctx, Object *obj, Entity *args) {
+Entity _Socket_accept_blocking(Task *task, Context *ctx, Object *obj,
+                               Entity *args) {
   Socket *socket = (Socket *)obj->_internal_obj;
   if (NULL == socket) {
     return raise_error(task, ctx, "Weird Socket error.");
   }
+  SocketHandle *sh;
+  // Interrupted by Future.cancel(), or spuriously.
+  while (!sockethandle_is_valid(sh = socket_accept(socket)) &&
+         socket_was_interrupted() && !task_is_cancelled(task)) {
+    sockethandle_delete(sh);
+  }
+  if (task_is_cancelled(task)) {
+    sockethandle_delete(sh);
+    return NONE_ENTITY;
+  }
   Object *socket_handle =
       heap_new(task->parent_process->heap, Class_SocketHandle);
-  Entity arg = entity_object(obj);
-  _SocketHandle_constructor(task, ctx, socket_handle, &arg);
+  socket_handle->_internal_obj = sh;
   return entity_object(socket_handle);
 }
 
@@ -101,6 +283,9 @@ Entity _SocketHandle_connect_constructor(Task *task, Context *ctx, Object *obj,
     return raise_error(task, ctx, "Weird Socket error.");
   }
   SocketHandle *sh = socket_connect(socket);
+  if (NULL != task->parent_process->vm->reactor) {
+    sockethandle_set_non_blocking(sh, true);
+  }
   obj->_internal_obj = sh;
   return entity_object(obj);
 }
@@ -128,50 +313,1199 @@ Entity _SocketHandle_constructor(Task *task, Context *ctx, Object *obj,
   return entity_object(obj);
 }
 
+Object *_handle_new(Heap *heap, SocketHandle *sh) {
+  Object *socket_handle = heap_new(heap, Class_SocketHandle);
+  socket_handle->_internal_obj = sh;
+  return socket_handle;
+}
+
+// Socket.receiver() returns a SocketHandle that receives what is sent to a
+// bound datagram Socket.
+Entity _Socket_receiver(Task *task, Context *ctx, Object *obj, Entity *args) {
+  Socket *socket = (Socket *)obj->_internal_obj;
+  if (NULL == socket) {
+    return raise_error(task, ctx, "Weird Socket error.");
+  }
+  SocketHandle *sh = socket_receiver(socket);
+  if (!sockethandle_is_valid(sh)) {
+    sockethandle_delete(sh);
+    return raise_error(task, ctx, "Could not create receiver.");
+  }
+  return entity_object(_handle_new(task->parent_process->heap, sh));
+}
+
+// socketpair(type=None) returns a Tuple of two connected SocketHandles,
+// SOCK_STREAM unless [type] says otherwise.
+Entity _socketpair(Task *task, Context *ctx, Object *obj, Entity *args) {
+  int type = SOCKET_TYPE_STREAM;
+  if (!IS_NONE(args)) {
+    if (!IS_INT(args)) {
+      return raise_error(task, ctx, "Expected a socket type.");
+    }
+    type = pint(&args->pri);
+  }
+  SocketHandle *first, *second;
+  if (!socket_pair(type, &first, &second)) {
+    return raise_error(task, ctx, "Could not create socket pair.");
+  }
+  if (NULL != task->parent_process->vm->reactor) {
+    sockethandle_set_non_blocking(first, true);
+    sockethandle_set_non_blocking(second, true);
+  }
+  Heap *heap = task->parent_process->heap;
+  Object *tuple_obj = heap_new(heap, Class_Tuple);
+  tuple_obj->_internal_obj = tuple_create(2);
+  Entity first_e = entity_object(_handle_new(heap, first));
+  Entity second_e = entity_object(_handle_new(heap, second));
+  tuple_set(heap, tuple_obj, 0, &first_e);
+  tuple_set(heap, tuple_obj, 1, &second_e);
+  return entity_object(tuple_obj);
+}
+
+// handle_from_fd(fd) takes ownership of the connected socket [fd], e.g. one
+// given up by SocketHandle.detach() in another Process.
+Entity _handle_from_fd(Task *task, Context *ctx, Object *obj, Entity *args) {
+  if (!IS_INT(args) || pint(&args->pri) < 0) {
+    return raise_error(task, ctx, "Expected a socket descriptor.");
+  }
+  SocketHandle *sh = sockethandle_create(pint(&args->pri));
+  if (NULL != task->parent_process->vm->reactor) {
+    sockethandle_set_non_blocking(sh, true);
+  }
+  return entity_object(_handle_new(task->parent_process->heap, sh));
+}
+
+// Returns the descriptor, which the handle no longer closes.
+Entity _SocketHandle_detach(Task *task, Context *ctx, Object *obj,
+                            Entity *args) {
+  SocketHandle *sh = (SocketHandle *)obj->_internal_obj;
+  if (NULL == sh || sockethandle_is_closed(sh)) {
+    return raise_error(task, ctx, "Cannot detach a closed socket.");
+  }
+  const char *data;
+  if (sockethandle_peek(sh, &data) > 0) {
+    return raise_error(task, ctx,
+                       "Cannot detach a socket with data read ahead.");
+  }
+  Reactor *reactor = task->parent_process->vm->reactor;
+  if (NULL != reactor && sockethandle_is_non_blocking(sh)) {
+    reactor_unwatch(reactor, sockethandle_get_socket(sh));
+  }
+  return entity_int(sockethandle_detach(sh));
+}
+
 Entity _SocketHandle_close(Task *task, Context *ctx, Object *obj,
                            Entity *args) {
   SocketHandle *sh = (SocketHandle *)obj->_internal_obj;
   if (NULL == sh) {
     return raise_error(task, ctx, "Weird Socket error.");
   }
+  Reactor *reactor = task->parent_process->vm->reactor;
+  if (NULL != reactor && sockethandle_is_non_blocking(sh) &&
+      !sockethandle_is_closed(sh)) {
+    reactor_unwatch(reactor, sockethandle_get_socket(sh));
+  }
   sockethandle_close(sh);
   return NONE_ENTITY;
 }
 
-Entity _SocketHandle_send(Task *task, Context *ctx, Object *obj, Entity *args) {
+// Returns the first occurrence of [needle] in [haystack], or NULL.
+const char *_find(const char *haystack, size_t len, const char *needle,
+                  size_t needle_len) {
+  const char *end = haystack + len;
+  const char *pos = haystack;
+  while (end - pos >= (ptrdiff_t)needle_len &&
+         NULL != (pos = memchr(pos, needle[0], end - pos))) {
+    if (end - pos < (ptrdiff_t)needle_len) {
+      return NULL;
+    }
+    if (0 == memcmp(pos, needle, needle_len)) {
+      return pos;
+    }
+    ++pos;
+  }
+  return NULL;
+}
+
+// Reads ahead on [sh] until [frame] has arrived. On FRAME_READY, [len] is
+// the number of bytes read ahead that make it up.
+_FrameStatus _frame_receive(SocketHandle *sh, _Frame *frame, size_t *len) {
+  for (;;) {
+    const char *data;
+    size_t buffered = sockethandle_peek(sh, &data);
+    size_t wanted = 0;
+    if (FRAME_ANY == frame->kind || FRAME_INTO == frame->kind) {
+      if (buffered > 0) {
+        *len = buffered;
+        return FRAME_READY;
+      }
+    } else if (FRAME_EXACT == frame->kind) {
+      if (buffered >= frame->len) {
+        *len = frame->len;
+        return FRAME_READY;
+      }
+      // Lets a large frame arrive in one read.
+      wanted = frame->len - buffered;
+    } else if (FRAME_HTTP == frame->kind) {
+      if (!frame->is_head_parsed && buffered > 0) {
+        HttpParseStatus parsed = http_parse_request(&frame->parser, data,
+                                                    buffered, &frame->head);
+        if (HTTP_PARSE_ERROR == parsed) {
+          return FRAME_MALFORMED;
+        }
+        frame->is_head_parsed = HTTP_PARSE_DONE == parsed;
+      }
+      if (frame->is_head_parsed) {
+        if ((frame->max > 0 && frame->head.head_len > frame->max) ||
+            (frame->max_body > 0 &&
+             frame->head.content_length > frame->max_body)) {
+          return FRAME_TOO_LONG;
+        }
+        size_t request_len = frame->head.head_len + frame->head.content_length;
+        if (buffered >= request_len) {
+          *len = request_len;
+          return FRAME_READY;
+        }
+        // Lets a large body arrive in one read.
+        wanted = request_len - buffered;
+      } else if (frame->max > 0 && buffered >= frame->max) {
+        return FRAME_TOO_LONG;
+      }
+    } else {
+      const char *found =
+          buffered <= frame->searched
+              ? NULL
+              : _find(data + frame->searched, buffered - frame->searched,
+                      frame->delim, frame->delim_len);
+      if (NULL != found) {
+        *len = found - data + frame->delim_len;
+        return frame->max > 0 && *len > frame->max ? FRAME_TOO_LONG
+                                                   : FRAME_READY;
+      }
+      // The delimiter may start in the bytes that arrived last.
+      if (buffered >= frame->delim_len) {
+        frame->searched = buffered - frame->delim_len + 1;
+      }
+      if (frame->max > 0 && buffered >= frame->max) {
+        return FRAME_TOO_LONG;
+      }
+    }
+    int32_t received = sockethandle_receive_ahead(sh, wanted);
+    if (received > 0) {
+      continue;
+    }
+    if (0 == received) {
+      return FRAME_CLOSED;
+    }
+    if (socket_was_interrupted()) {
+      return FRAME_INTERRUPTED;
+    }
+    return socket_would_block() ? FRAME_WAIT : FRAME_FAILED;
+  }
+}
+
+// Turns the outcome of _frame_receive() into what the receive returns, taking
+// the frame from what was read ahead. Returns false if it has to wait.
+// Otherwise sets [result], or [error] if it failed.
+bool _frame_finish(Heap *heap, SocketHandle *sh, const _Frame *frame,
+                   Object *target, _FrameStatus status, size_t len,
+                   Entity *result, const char **error) {
+  const char *data;
+  size_t buffered = sockethandle_peek(sh, &data);
+  switch (status) {
+  case FRAME_WAIT:
+    return false;
+  case FRAME_READY:
+    if (FRAME_HTTP == frame->kind) {
+      Object *request = http_request_new(heap, data, len, &frame->head);
+      if (NULL == request) {
+        *error = "Import net to receive HTTP requests.";
+        return true;
+      }
+      *result = entity_object(request);
+    } else if (NULL != target) {
+      String *str = (String *)target->_internal_obj;
+      size_t footprint = String_footprint(str);
+      String_append_chars(str, data, len);
+      string_recharge(heap, target, footprint);
+      *result = entity_int(len);
+    } else {
+      *result = entity_object(string_new(heap, data, len));
+    }
+    sockethandle_take(sh, len);
+    return true;
+  case FRAME_CLOSED:
+    if (FRAME_ANY == frame->kind) {
+      *result = entity_object(string_new(heap, NULL, 0));
+    } else if (FRAME_INTO == frame->kind) {
+      *result = entity_int(0);
+    } else if (0 == buffered) {
+      *result = NONE_ENTITY;
+    } else {
+      *error = "Socket closed in the middle of a frame.";
+    }
+    return true;
+  case FRAME_TOO_LONG:
+    *error = FRAME_HTTP == frame->kind
+                 ? "HTTP request too large."
+                 : "Delimiter not found within the maximum length.";
+    return true;
+  case FRAME_MALFORMED:
+    *error = "Malformed HTTP request.";
+    return true;
+  default:
+    *error = "Could not receive from socket.";
+    return true;
+  }
+}
+
+// Reads the arguments of receive_exact(), receive_until(), receive_into() or
+// receive_request() into [frame] and [target]. Returns an error message on
+// failure.
+const char *_frame_args(_FrameKind kind, Entity *args, _Frame *frame,
+                        Object **target) {
+  frame->kind = kind;
+  frame->delim = NULL;
+  frame->max = 0;
+  frame->max_body = 0;
+  frame->searched = 0;
+  frame->is_head_parsed = false;
+  *target = NULL;
+  switch (kind) {
+  case FRAME_EXACT:
+    if (!IS_INT(args) || pint(&args->pri) < 0) {
+      return "Expected a non-negative Int.";
+    }
+    frame->len = pint(&args->pri);
+    return NULL;
+  case FRAME_UNTIL: {
+    const Entity *delim = args, *max = NULL;
+    if (IS_TUPLE(args)) {
+      Tuple *tuple = (Tuple *)args->obj->_internal_obj;
+      delim = tuple_get(tuple, 0);
+      max = tuple_size(tuple) > 1 ? tuple_get(tuple, 1) : NULL;
+    }
+    if (!IS_CLASS(delim, Class_String) ||
+        0 == String_size((String *)delim->obj->_internal_obj)) {
+      return "Delimiter must be a non-empty String.";
+    }
+    if (!IS_NONE(max) && (!IS_INT(max) || pint(&max->pri) < 0)) {
+      return "Max must be a non-negative Int.";
+    }
+    String *str = (String *)delim->obj->_internal_obj;
+    frame->delim = str->table;
+    frame->delim_len = String_size(str);
+    frame->max = IS_NONE(max) ? 0 : pint(&max->pri);
+    return NULL;
+  }
+  case FRAME_INTO:
+    if (!IS_CLASS(args, Class_String)) {
+      return "Expected a String to receive into.";
+    }
+    if (object_is_frozen(args->obj)) {
+      return "Cannot receive into a frozen String.";
+    }
+    *target = args->obj;
+    return NULL;
+  case FRAME_HTTP: {
+    const Entity *max = args, *max_body = NULL;
+    if (IS_TUPLE(args)) {
+      Tuple *tuple = (Tuple *)args->obj->_internal_obj;
+      max = tuple_get(tuple, 0);
+      max_body = tuple_size(tuple) > 1 ? tuple_get(tuple, 1) : NULL;
+    }
+    if ((!IS_NONE(max) && (!IS_INT(max) || pint(&max->pri) < 0)) ||
+        (!IS_NONE(max_body) &&
+         (!IS_INT(max_body) || pint(&max_body->pri) < 0))) {
+      return "Maximum sizes must be non-negative Ints.";
+    }
+    frame->max = IS_NONE(max) ? 0 : pint(&max->pri);
+    frame->max_body = IS_NONE(max_body) ? 0 : pint(&max_body->pri);
+    http_parser_init(&frame->parser);
+    return NULL;
+  }
+  default:
+    return NULL;
+  }
+}
+
+// Points [bufs] at the contents of the String or Array of Strings given to
+// send(), skipping empty ones. Sets [len] to the total. Returns false if
+// something other than a String was given.
+bool _send_buffers_create(const Entity *args, SocketBuffer **bufs,
+                          int *num_bufs, size_t *len) {
+  *bufs = NULL;
+  *num_bufs = 0;
+  *len = 0;
+  if (IS_CLASS(args, Class_String)) {
+    String *msg = (String *)args->obj->_internal_obj;
+    *bufs = ALLOC2(SocketBuffer);
+    (*bufs)->data = msg->table;
+    (*bufs)->len = String_size(msg);
+    *num_bufs = 0 == (*bufs)->len ? 0 : 1;
+    *len = (*bufs)->len;
+    return true;
+  }
+  if (!IS_CLASS(args, Class_Array)) {
+    return false;
+  }
+  Array *arr = (Array *)args->obj->_internal_obj;
+  int i, arr_len = Array_size(arr);
+  *bufs = ALLOC_ARRAY(SocketBuffer, arr_len + 1);
+  for (i = 0; i < arr_len; ++i) {
+    const Entity *e = Array_get_ref(arr, i);
+    if (!IS_CLASS(e, Class_String)) {
+      DEALLOC(*bufs);
+      *bufs = NULL;
+      return false;
+    }
+    String *msg = (String *)e->obj->_internal_obj;
+    if (0 == String_size(msg)) {
+      continue;
+    }
+    (*bufs)[*num_bufs].data = msg->table;
+    (*bufs)[*num_bufs].len = String_size(msg);
+    *len += String_size(msg);
+    ++*num_bufs;
+  }
+  return true;
+}
+
+// Drops the first [sent] bytes from [bufs].
+void _send_buffers_consume(SocketBuffer **bufs, int *num_bufs, size_t sent) {
+  while (*num_bufs > 0 && sent >= (*bufs)->len) {
+    sent -= (*bufs)->len;
+    ++*bufs;
+    --*num_bufs;
+  }
+  if (*num_bufs > 0) {
+    (*bufs)->data += sent;
+    (*bufs)->len -= sent;
+  }
+}
+
+Entity _SocketHandle_send_blocking(Task *task, Context *ctx, Object *obj,
+                                   Entity *args) {
   SocketHandle *sh = (SocketHandle *)obj->_internal_obj;
   if (NULL == sh) {
     return raise_error(task, ctx, "Weird Socket error.");
   }
-  if (IS_CLASS(args, Class_String)) {
-    String *msg = args->obj->_internal_obj;
-    sockethandle_send(sh, msg->table, String_size(msg));
-    return NONE_ENTITY;
-  } else if (IS_CLASS(args, Class_Array)) {
-    Array *arr = args->obj->_internal_obj;
-    int i, arr_len = Array_size(arr);
-    for (i = 0; i < arr_len; ++i) {
-      String *msg = Array_get_ref(arr, i)->obj->_internal_obj;
-      sockethandle_send(sh, msg->table, String_size(msg));
+  SocketBuffer *bufs;
+  int num_bufs;
+  size_t len;
+  if (!_send_buffers_create(args, &bufs, &num_bufs, &len)) {
+    return raise_error(task, ctx, "Cannot send non-string.");
+  }
+  // Every fragment goes out in one writev, resumed after partial writes.
+  SocketBuffer *pending = bufs;
+  while (num_bufs > 0 && !task_is_cancelled(task)) {
+    int64_t sent = sockethandle_send_buffers(sh, pending, num_bufs);
+    if (sent < 0) {
+      if (socket_was_interrupted()) {
+        continue;
+      }
+      DEALLOC(bufs);
+      return raise_error(task, ctx, "Could not send to socket.");
     }
+    _send_buffers_consume(&pending, &num_bufs, sent);
+  }
+  DEALLOC(bufs);
+  return NONE_ENTITY;
+}
+
+// Called on the heap owner once receive_into() on a blocking handle has read
+// ahead, since only the heap owner may change the String received into. The
+// task is then handed back to be completed as usual. If it was cancelled in
+// the meantime, the bytes stay read ahead for the next receive.
+void _receive_into_drained(Task *task) {
+  Process *process = task->parent_process;
+  Object *target = (Object *)task->dependency_arg;
+  task->on_completion_drained = NULL;
+  task->dependency_arg = NULL;
+  if (NULL == task->cancel_error) {
+    Entity result;
+    const char *error = NULL;
+    _Frame frame = {.kind = FRAME_INTO};
+    _frame_finish(process->heap, task->_background_self->_internal_obj, &frame,
+                  target, FRAME_READY, pint(&task_get_resval(task)->pri),
+                  &result, &error);
+    *task_mutable_resval(task) = result;
+  }
+  process_expect_completion(process);
+  process_post_completion(process, task);
+}
+
+// Blocks until the frame of kind [kind] described by [args] has arrived.
+Entity _receive_frame_blocking(Task *task, Context *ctx, Object *obj,
+                               _FrameKind kind, Entity *args) {
+  SocketHandle *sh = (SocketHandle *)obj->_internal_obj;
+  if (NULL == sh) {
+    return raise_error(task, ctx, "Weird Socket error.");
+  }
+  _Frame frame;
+  Object *target;
+  const char *error = _frame_args(kind, args, &frame, &target);
+  if (NULL != error) {
+    return raise_error(task, ctx, error);
+  }
+  _FrameStatus status;
+  size_t len;
+  // Interrupted by Future.cancel(), or spuriously.
+  while (FRAME_INTERRUPTED == (status = _frame_receive(sh, &frame, &len)) &&
+         !task_is_cancelled(task)) {
+  }
+  if (task_is_cancelled(task)) {
     return NONE_ENTITY;
+  }
+  if (FRAME_READY == status && NULL != target) {
+    task->on_completion_drained = _receive_into_drained;
+    task->dependency_arg = target;
+    return entity_int(len);
+  }
+  Entity result;
+  // Blocking sockets never have to wait.
+  _frame_finish(task->parent_process->heap, sh, &frame, target, status, len,
+                &result, &error);
+  return NULL == error ? result : raise_error(task, ctx, error);
+}
+
+Entity _SocketHandle_receive_blocking(Task *task, Context *ctx, Object *obj,
+                                      Entity *args) {
+  return _receive_frame_blocking(task, ctx, obj, FRAME_ANY, NULL);
+}
+
+Entity _SocketHandle_receive_exact_blocking(Task *task, Context *ctx,
+                                            Object *obj, Entity *args) {
+  return _receive_frame_blocking(task, ctx, obj, FRAME_EXACT, args);
+}
+
+Entity _SocketHandle_receive_until_blocking(Task *task, Context *ctx,
+                                            Object *obj, Entity *args) {
+  return _receive_frame_blocking(task, ctx, obj, FRAME_UNTIL, args);
+}
+
+Entity _SocketHandle_receive_into_blocking(Task *task, Context *ctx,
+                                           Object *obj, Entity *args) {
+  return _receive_frame_blocking(task, ctx, obj, FRAME_INTO, args);
+}
+
+Entity _SocketHandle_receive_request_blocking(Task *task, Context *ctx,
+                                              Object *obj, Entity *args) {
+  return _receive_frame_blocking(task, ctx, obj, FRAME_HTTP, args);
+}
+
+// Turns what sockethandle_receive_fd() returned into what receive_handle()
+// returns: a SocketHandle in the same mode as [sh], or None once the peer has
+// closed. Sets [error] on failure.
+void _received_handle(Heap *heap, SocketHandle *sh, int32_t received, int fd,
+                      Entity *result, const char **error) {
+  if (0 == received) {
+    *result = NONE_ENTITY;
+  } else if (received < 0) {
+    *error = "Could not receive from socket.";
+  } else if (fd < 0) {
+    *error = "Received no handle.";
+  } else {
+    SocketHandle *received_sh = sockethandle_create(fd);
+    sockethandle_set_non_blocking(received_sh,
+                                  sockethandle_is_non_blocking(sh));
+    *result = entity_object(_handle_new(heap, received_sh));
+  }
+}
+
+// Reads the SocketHandle or descriptor given to send_handle() into [fd], a
+// duplicate owned by the caller. Returns an error message on failure.
+const char *_send_handle_args(const Entity *args, int *fd) {
+  if (IS_CLASS(args, Class_SocketHandle)) {
+    SocketHandle *sh = (SocketHandle *)args->obj->_internal_obj;
+    if (NULL == sh || sockethandle_is_closed(sh)) {
+      return "Cannot send a closed handle.";
+    }
+    *fd = dup(sockethandle_get_socket(sh));
+  } else if (IS_INT(args)) {
+    *fd = dup(pint(&args->pri));
+  } else {
+    return "Expected a SocketHandle or descriptor.";
+  }
+  return *fd < 0 ? "Could not duplicate handle." : NULL;
+}
+
+void _socket_op_drained(Task *op_task);
+void _socket_op_cancel(Task *op_task);
+void _socket_op_complete(_SocketOp *op, const Entity *result,
+                         const char *error);
+
+_SocketOp *_socket_op_create(_SocketOpKind kind, Object *obj, SOCKET fd) {
+  _SocketOp *op = ALLOC2(_SocketOp);
+  op->kind = kind;
+  op->obj = obj;
+  op->fd = fd;
+  op->buf = NULL;
+  op->len = 0;
+  op->sent = 0;
+  op->file_fd = -1;
+  op->file_offset = 0;
+  op->frame.kind = FRAME_ANY;
+  op->frame.delim = NULL;
+  op->frame.searched = 0;
+  op->target = NULL;
+  op->task = NULL;
+  op->future = NULL;
+  op->is_dropped = false;
+  return op;
+}
+
+void _socket_op_delete(_SocketOp *op) {
+  if (NULL != op->task) {
+    Process *process = op->task->parent_process;
+    heap_dec_edge(process->heap, process->_reflection, op->obj);
+    heap_dec_edge(process->heap, process->_reflection, op->future);
+    if (NULL != op->target) {
+      heap_dec_edge(process->heap, process->_reflection, op->target);
+    }
+  }
+  if (NULL != op->buf) {
+    DEALLOC(op->buf);
+  }
+  if (op->file_fd >= 0) {
+    close(op->file_fd);
+  }
+  DEALLOC(op);
+}
+
+// Tries [op] without blocking. Returns false if it has to wait. Otherwise
+// sets [result], or [error] if it failed.
+bool _socket_op_try(_SocketOp *op, Heap *heap, Entity *result,
+                    const char **error) {
+  switch (op->kind) {
+  case SOCKET_OP_ACCEPT: {
+    Socket *socket = (Socket *)op->obj->_internal_obj;
+    SocketHandle *sh;
+    while (!sockethandle_is_valid(sh = socket_accept(socket)) &&
+           socket_was_interrupted()) {
+      sockethandle_delete(sh);
+    }
+    if (!sockethandle_is_valid(sh)) {
+      bool would_block = socket_would_block();
+      sockethandle_delete(sh);
+      if (would_block) {
+        return false;
+      }
+      *error = "Could not accept connection.";
+      return true;
+    }
+    sockethandle_set_non_blocking(sh, true);
+    Object *socket_handle = heap_new(heap, Class_SocketHandle);
+    socket_handle->_internal_obj = sh;
+    *result = entity_object(socket_handle);
+    return true;
+  }
+  case SOCKET_OP_RECEIVE: {
+    SocketHandle *sh = (SocketHandle *)op->obj->_internal_obj;
+    _FrameStatus status;
+    size_t len;
+    while (FRAME_INTERRUPTED ==
+           (status = _frame_receive(sh, &op->frame, &len))) {
+    }
+    return _frame_finish(heap, sh, &op->frame, op->target, status, len, result,
+                         error);
+  }
+  case SOCKET_OP_SEND:
+    while (op->sent < op->len) {
+      int32_t chars_sent = sockethandle_send(
+          op->obj->_internal_obj, op->buf + op->sent, op->len - op->sent);
+      if (chars_sent < 0) {
+        if (socket_was_interrupted()) {
+          continue;
+        }
+        if (socket_would_block()) {
+          return false;
+        }
+        *error = "Could not send to socket.";
+        return true;
+      }
+      op->sent += chars_sent;
+    }
+    *result = NONE_ENTITY;
+    return true;
+  case SOCKET_OP_SEND_FILE:
+    while (op->sent < op->len) {
+      int64_t chars_sent = sockethandle_send_file(
+          op->obj->_internal_obj, op->file_fd, op->file_offset + op->sent,
+          op->len - op->sent);
+      if (chars_sent < 0) {
+        if (socket_was_interrupted()) {
+          continue;
+        }
+        if (socket_would_block()) {
+          return false;
+        }
+        *error = "Could not send file to socket.";
+        return true;
+      }
+      // The file ended early.
+      if (0 == chars_sent) {
+        break;
+      }
+      op->sent += chars_sent;
+    }
+    *result = entity_int(op->sent);
+    return true;
+  case SOCKET_OP_SEND_HANDLE: {
+    int32_t sent;
+    while ((sent = sockethandle_send_fd(op->obj->_internal_obj,
+                                        op->file_fd)) < 0 &&
+           socket_was_interrupted()) {
+    }
+    if (sent < 0) {
+      if (socket_would_block()) {
+        return false;
+      }
+      *error = "Could not send handle.";
+      return true;
+    }
+    *result = NONE_ENTITY;
+    return true;
+  }
+  case SOCKET_OP_RECEIVE_HANDLE: {
+    SocketHandle *sh = (SocketHandle *)op->obj->_internal_obj;
+    int fd;
+    int32_t received;
+    while ((received = sockethandle_receive_fd(sh, &fd)) < 0 &&
+           socket_was_interrupted()) {
+    }
+    if (received < 0 && socket_would_block()) {
+      return false;
+    }
+    _received_handle(heap, sh, received, fd, result, error);
+    return true;
+  }
+  default:
+    ERROR("Unknown socket op.");
+  }
+  return true;
+}
+
+// Called on the reactor's thread.
+void _socket_op_ready(void *arg, int event) {
+  _SocketOp *op = (_SocketOp *)arg;
+  op->is_dropped = 0 == event;
+  process_post_completion(op->task->parent_process, op->task);
+}
+
+ReactorEvent _socket_op_event(const _SocketOp *op) {
+  return SOCKET_OP_SEND == op->kind || SOCKET_OP_SEND_FILE == op->kind ||
+                 SOCKET_OP_SEND_HANDLE == op->kind
+             ? REACTOR_WRITE
+             : REACTOR_READ;
+}
+
+bool _socket_op_watch(Reactor *reactor, _SocketOp *op) {
+  if (!reactor_watch(reactor, op->fd, _socket_op_event(op), _socket_op_ready,
+                     op)) {
+    return false;
+  }
+  process_expect_completion(op->task->parent_process);
+  return true;
+}
+
+// Called on the heap owner when the op's Future is cancelled. Frees the
+// socket for the next call right away, so nothing is read into or sent from
+// the cancelled op. Dropping the watch posts the op's task, or it was posted
+// already, so _socket_op_drained() still frees the op.
+void _socket_op_cancel(Task *op_task) {
+  _SocketOp *op = (_SocketOp *)op_task->dependency_arg;
+  reactor_unwatch_event(op_task->parent_process->vm->reactor, op->fd,
+                        _socket_op_event(op));
+}
+
+// Runs [op] right away if it can, otherwise returns a Future completed once
+// the reactor says the socket is ready.
+Entity _socket_op_start(Task *task, Context *ctx, _SocketOp *op) {
+  Process *process = task->parent_process;
+  Entity result;
+  const char *error = NULL;
+  if (_socket_op_try(op, process->heap, &result, &error)) {
+    _socket_op_delete(op);
+    return NULL == error ? result : raise_error(task, ctx, error);
+  }
+  op->task = process_create_unqueued_task(process);
+  op->task->on_completion_drained = _socket_op_drained;
+  op->task->on_cancel = _socket_op_cancel;
+  op->task->dependency_arg = op;
+  op->future = future_create(op->task);
+  heap_inc_edge(process->heap, process->_reflection, op->obj);
+  heap_inc_edge(process->heap, process->_reflection, op->future);
+  if (NULL != op->target) {
+    heap_inc_edge(process->heap, process->_reflection, op->target);
+  }
+  Object *future = op->future;
+  if (!_socket_op_watch(process->vm->reactor, op)) {
+    // The task already backs the Future, so it fails rather than being left
+    // incomplete.
+    _socket_op_complete(op, NULL,
+                        "Socket already has a call waiting to do the same.");
+  }
+  return entity_object(future);
+}
+
+// Called on the heap owner once the reactor has posted the op's task.
+void _socket_op_drained(Task *op_task) {
+  _SocketOp *op = (_SocketOp *)op_task->dependency_arg;
+  Process *process = op_task->parent_process;
+  // Whoever waited on it has already been told it was cancelled.
+  if (NULL != op_task->cancel_error) {
+    _socket_op_delete(op);
+    return;
+  }
+  Entity result;
+  const char *error = NULL;
+  if (op->is_dropped) {
+    error = "Socket was closed.";
+  } else if (!_socket_op_try(op, process->heap, &result, &error)) {
+    // Woken spuriously.
+    if (_socket_op_watch(process->vm->reactor, op)) {
+      return;
+    }
+    error = "Could not wait on socket.";
+  }
+  _socket_op_complete(op, &result, error);
+}
+
+// Completes the op's task with [result], or with [error] if it is set, and
+// frees the op.
+void _socket_op_complete(_SocketOp *op, const Entity *result,
+                         const char *error) {
+  Task *op_task = op->task;
+  Process *process = op_task->parent_process;
+  bool is_error = NULL != error;
+  if (is_error) {
+    *task_mutable_resval(op_task) = entity_object(error_new(
+        op_task, NULL, string_new(process->heap, error, strlen(error))));
+    future_set_error(op->future);
   } else {
+    *task_mutable_resval(op_task) = *result;
+  }
+  op_task->state = is_error ? TASK_ERROR : TASK_COMPLETE;
+  process_complete_task(process, op_task, is_error);
+  _socket_op_delete(op);
+}
+
+Entity _Socket_accept(Task *task, Context *ctx, Object *obj, Entity *args) {
+  Socket *socket = (Socket *)obj->_internal_obj;
+  if (NULL == socket) {
+    return raise_error(task, ctx, "Weird Socket error.");
+  }
+  if (!socket_is_non_blocking(socket)) {
+    return entity_object(
+        vm_call_in_background(task, ctx, _accept_in_background, obj, args));
+  }
+  return _socket_op_start(
+      task, ctx,
+      _socket_op_create(SOCKET_OP_ACCEPT, obj, socket_get_socket(socket)));
+}
+
+Entity _SocketHandle_send(Task *task, Context *ctx, Object *obj, Entity *args) {
+  SocketHandle *sh = (SocketHandle *)obj->_internal_obj;
+  if (NULL == sh) {
+    return raise_error(task, ctx, "Weird Socket error.");
+  }
+  if (!sockethandle_is_non_blocking(sh)) {
+    return entity_object(
+        vm_call_in_background(task, ctx, _send_in_background, obj, args));
+  }
+  SocketBuffer *bufs;
+  int num_bufs;
+  size_t len;
+  if (!_send_buffers_create(args, &bufs, &num_bufs, &len)) {
     return raise_error(task, ctx, "Cannot send non-string.");
   }
+  // Try to send every fragment with one writev before copying anything.
+  SocketBuffer *pending = bufs;
+  while (num_bufs > 0) {
+    int64_t sent = sockethandle_send_buffers(sh, pending, num_bufs);
+    if (sent < 0) {
+      if (socket_was_interrupted()) {
+        continue;
+      }
+      if (socket_would_block()) {
+        break;
+      }
+      DEALLOC(bufs);
+      return raise_error(task, ctx, "Could not send to socket.");
+    }
+    _send_buffers_consume(&pending, &num_bufs, sent);
+    len -= sent;
+  }
+  if (0 == num_bufs) {
+    DEALLOC(bufs);
+    return NONE_ENTITY;
+  }
+  // The rest is copied, since the Strings may change before the socket is
+  // ready.
+  _SocketOp *op =
+      _socket_op_create(SOCKET_OP_SEND, obj, sockethandle_get_socket(sh));
+  op->len = len;
+  op->buf = ALLOC_ARRAY(char, len + 1);
+  size_t offset = 0;
+  int i;
+  for (i = 0; i < num_bufs; ++i) {
+    memcpy(op->buf + offset, pending[i].data, pending[i].len);
+    offset += pending[i].len;
+  }
+  DEALLOC(bufs);
+  return _socket_op_start(task, ctx, op);
+}
+
+// Starts a receive of kind [kind], which runs [in_background] on an I/O
+// thread if the handle is blocking.
+Entity _receive_frame(Task *task, Context *ctx, Object *obj, Entity *args,
+                      _FrameKind kind, const Function *in_background) {
+  SocketHandle *sh = (SocketHandle *)obj->_internal_obj;
+  if (NULL == sh) {
+    return raise_error(task, ctx, "Weird Socket error.");
+  }
+  if (!sockethandle_is_non_blocking(sh)) {
+    return entity_object(
+        vm_call_in_background(task, ctx, in_background, obj, args));
+  }
+  _SocketOp *op =
+      _socket_op_create(SOCKET_OP_RECEIVE, obj, sockethandle_get_socket(sh));
+  const char *error = _frame_args(kind, args, &op->frame, &op->target);
+  if (NULL != error) {
+    _socket_op_delete(op);
+    return raise_error(task, ctx, error);
+  }
+  // Copied, since the String may change before the frame arrives.
+  if (FRAME_UNTIL == kind) {
+    op->buf = ALLOC_ARRAY(char, op->frame.delim_len);
+    memcpy(op->buf, op->frame.delim, op->frame.delim_len);
+    op->frame.delim = op->buf;
+  }
+  return _socket_op_start(task, ctx, op);
 }
 
 Entity _SocketHandle_receive(Task *task, Context *ctx, Object *obj,
                              Entity *args) {
+  return _receive_frame(task, ctx, obj, args, FRAME_ANY,
+                        _receive_in_background);
+}
+
+Entity _SocketHandle_receive_exact(Task *task, Context *ctx, Object *obj,
+                                   Entity *args) {
+  return _receive_frame(task, ctx, obj, args, FRAME_EXACT,
+                        _receive_exact_in_background);
+}
+
+Entity _SocketHandle_receive_until(Task *task, Context *ctx, Object *obj,
+                                   Entity *args) {
+  return _receive_frame(task, ctx, obj, args, FRAME_UNTIL,
+                        _receive_until_in_background);
+}
+
+Entity _SocketHandle_receive_into(Task *task, Context *ctx, Object *obj,
+                                  Entity *args) {
+  return _receive_frame(task, ctx, obj, args, FRAME_INTO,
+                        _receive_into_in_background);
+}
+
+Entity _SocketHandle_receive_request(Task *task, Context *ctx, Object *obj,
+                                     Entity *args) {
+  return _receive_frame(task, ctx, obj, args, FRAME_HTTP,
+                        _receive_request_in_background);
+}
+
+// Opens the file given to send_file(), either a path or a file descriptor,
+// and works out how much of it to send. Returns an error message on failure.
+const char *_send_file_args(Entity *args, int *fd, int64_t *offset,
+                            size_t *len) {
+  const Entity *file = args, *e_offset = NULL, *e_len = NULL;
+  if (IS_TUPLE(args)) {
+    Tuple *tuple = (Tuple *)args->obj->_internal_obj;
+    file = tuple_get(tuple, 0);
+    e_offset = tuple_size(tuple) > 1 ? tuple_get(tuple, 1) : NULL;
+    e_len = tuple_size(tuple) > 2 ? tuple_get(tuple, 2) : NULL;
+  }
+  *offset = 0;
+  if (!IS_NONE(e_offset)) {
+    if (!IS_INT(e_offset) || pint(&e_offset->pri) < 0) {
+      return "Offset must be a non-negative Int.";
+    }
+    *offset = pint(&e_offset->pri);
+  }
+  if (!IS_NONE(e_len) && (!IS_INT(e_len) || pint(&e_len->pri) < 0)) {
+    return "Length must be a non-negative Int.";
+  }
+  if (IS_CLASS(file, Class_String)) {
+    String *path = (String *)file->obj->_internal_obj;
+    char *path_str = strndup(path->table, String_size(path));
+    *fd = open(path_str, O_RDONLY);
+    free(path_str);
+  } else if (IS_INT(file)) {
+    // Our own descriptor, so closing it cannot affect the caller's.
+    *fd = dup(pint(&file->pri));
+  } else {
+    return "Expected a file path or descriptor.";
+  }
+  if (*fd < 0) {
+    return "Could not open file.";
+  }
+  if (!IS_NONE(e_len)) {
+    *len = pint(&e_len->pri);
+    return NULL;
+  }
+  struct stat st;
+  if (0 != fstat(*fd, &st)) {
+    close(*fd);
+    return "Could not open file.";
+  }
+  *len = st.st_size > *offset ? st.st_size - *offset : 0;
+  return NULL;
+}
+
+Entity _SocketHandle_send_file_blocking(Task *task, Context *ctx, Object *obj,
+                                        Entity *args) {
+  SocketHandle *sh = (SocketHandle *)obj->_internal_obj;
+  if (NULL == sh) {
+    return raise_error(task, ctx, "Weird Socket error.");
+  }
+  int fd;
+  int64_t offset;
+  size_t len, sent = 0;
+  const char *error = _send_file_args(args, &fd, &offset, &len);
+  if (NULL != error) {
+    return raise_error(task, ctx, error);
+  }
+  while (sent < len && !task_is_cancelled(task)) {
+    int64_t chars_sent =
+        sockethandle_send_file(sh, fd, offset + sent, len - sent);
+    if (chars_sent < 0) {
+      if (socket_was_interrupted()) {
+        continue;
+      }
+      close(fd);
+      return raise_error(task, ctx, "Could not send file to socket.");
+    }
+    if (0 == chars_sent) {
+      break;
+    }
+    sent += chars_sent;
+  }
+  close(fd);
+  return entity_int(sent);
+}
+
+Entity _SocketHandle_send_file(Task *task, Context *ctx, Object *obj,
+                               Entity *args) {
   SocketHandle *sh = (SocketHandle *)obj->_internal_obj;
   if (NULL == sh) {
     return raise_error(task, ctx, "Weird Socket error.");
   }
+  if (!sockethandle_is_non_blocking(sh)) {
+    return entity_object(vm_call_in_background(
+        task, ctx, _send_file_in_background, obj, args));
+  }
+  _SocketOp *op =
+      _socket_op_create(SOCKET_OP_SEND_FILE, obj, sockethandle_get_socket(sh));
+  const char *error =
+      _send_file_args(args, &op->file_fd, &op->file_offset, &op->len);
+  if (NULL != error) {
+    op->file_fd = -1;
+    _socket_op_delete(op);
+    return raise_error(task, ctx, error);
+  }
+  return _socket_op_start(task, ctx, op);
+}
 
-  char buf[BUFFER_SIZE];
-  int chars_received = sockethandle_receive(sh, buf, BUFFER_SIZE);
+// Non-blocking mode needs the reactor.
+Entity _SocketHandle_send_handle_blocking(Task *task, Context *ctx,
+                                          Object *obj, Entity *args) {
+  SocketHandle *sh = (SocketHandle *)obj->_internal_obj;
+  if (NULL == sh) {
+    return raise_error(task, ctx, "Weird Socket error.");
+  }
+  int fd;
+  const char *error = _send_handle_args(args, &fd);
+  if (NULL != error) {
+    return raise_error(task, ctx, error);
+  }
+  int32_t sent;
+  while ((sent = sockethandle_send_fd(sh, fd)) < 0 &&
+         socket_was_interrupted() && !task_is_cancelled(task)) {
+  }
+  close(fd);
+  if (sent < 0 && !task_is_cancelled(task)) {
+    return raise_error(task, ctx, "Could not send handle.");
+  }
+  return NONE_ENTITY;
+}
 
-  return entity_object(
-      string_new(task->parent_process->heap, buf, chars_received));
+// SocketHandle.send_handle(handle) passes a SocketHandle, or a descriptor, to
+// the Process at the other end of a Unix domain socket, which gets its own
+// copy from receive_handle(). The sender should close its handle after.
+Entity _SocketHandle_send_handle(Task *task, Context *ctx, Object *obj,
+                                 Entity *args) {
+  SocketHandle *sh = (SocketHandle *)obj->_internal_obj;
+  if (NULL == sh) {
+    return raise_error(task, ctx, "Weird Socket error.");
+  }
+  if (!sockethandle_is_non_blocking(sh)) {
+    return entity_object(vm_call_in_background(
+        task, ctx, _send_handle_in_background, obj, args));
+  }
+  _SocketOp *op = _socket_op_create(SOCKET_OP_SEND_HANDLE, obj,
+                                    sockethandle_get_socket(sh));
+  const char *error = _send_handle_args(args, &op->file_fd);
+  if (NULL != error) {
+    op->file_fd = -1;
+    _socket_op_delete(op);
+    return raise_error(task, ctx, error);
+  }
+  return _socket_op_start(task, ctx, op);
+}
+
+Entity _SocketHandle_receive_handle_blocking(Task *task, Context *ctx,
+                                             Object *obj, Entity *args) {
+  SocketHandle *sh = (SocketHandle *)obj->_internal_obj;
+  if (NULL == sh) {
+    return raise_error(task, ctx, "Weird Socket error.");
+  }
+  int fd;
+  int32_t received;
+  while ((received = sockethandle_receive_fd(sh, &fd)) < 0 &&
+         socket_was_interrupted() && !task_is_cancelled(task)) {
+  }
+  if (task_is_cancelled(task)) {
+    if (fd >= 0) {
+      close(fd);
+    }
+    return NONE_ENTITY;
+  }
+  Entity result;
+  const char *error = NULL;
+  _received_handle(task->parent_process->heap, sh, received, fd, &result,
+                   &error);
+  return NULL == error ? result : raise_error(task, ctx, error);
+}
+
+Entity _SocketHandle_receive_handle(Task *task, Context *ctx, Object *obj,
+                                    Entity *args) {
+  SocketHandle *sh = (SocketHandle *)obj->_internal_obj;
+  if (NULL == sh) {
+    return raise_error(task, ctx, "Weird Socket error.");
+  }
+  // The handle would come with bytes after those already read ahead.
+  const char *data;
+  if (sockethandle_peek(sh, &data) > 0) {
+    return raise_error(task, ctx,
+                       "Cannot receive a handle with data read ahead.");
+  }
+  if (!sockethandle_is_non_blocking(sh)) {
+    return entity_object(vm_call_in_background(
+        task, ctx, _receive_handle_in_background, obj, args));
+  }
+  return _socket_op_start(
+      task, ctx,
+      _socket_op_create(SOCKET_OP_RECEIVE_HANDLE, obj,
+                        sockethandle_get_socket(sh)));
+}
+
+bool _set_blocking_arg(Task *task, Context *ctx, Entity *args,
+                       bool *is_blocking, Entity *error) {
+  *is_blocking = NULL != args && NONE != args->type;
+  if (!*is_blocking && NULL == task->parent_process->vm->reactor) {
+    *error = raise_error(task, ctx,
+                         "Non-blocking sockets are not supported here.");
+    return false;
+  }
+  return true;
+}
+
+Entity _Socket_set_blocking(Task *task, Context *ctx, Object *obj,
+                            Entity *args) {
+  Socket *socket = (Socket *)obj->_internal_obj;
+  bool is_blocking;
+  Entity error;
+  if (!_set_blocking_arg(task, ctx, args, &is_blocking, &error)) {
+    return error;
+  }
+  if (!socket_set_non_blocking(socket, !is_blocking)) {
+    return raise_error(task, ctx, "Could not change the socket's mode.");
+  }
+  return NONE_ENTITY;
+}
+
+Entity _SocketHandle_set_blocking(Task *task, Context *ctx, Object *obj,
+                                  Entity *args) {
+  SocketHandle *sh = (SocketHandle *)obj->_internal_obj;
+  bool is_blocking;
+  Entity error;
+  if (!_set_blocking_arg(task, ctx, args, &is_blocking, &error)) {
+    return error;
+  }
+  if (!sockethandle_set_non_blocking(sh, !is_blocking)) {
+    return raise_error(task, ctx, "Could not change the socket's mode.");
+  }
+  return NONE_ENTITY;
+}
+
+// Reads the (option, value) given to set_option(). A value of None or False
+// is 0. Returns false and sets [error] if they are not valid.
+bool _set_option_args(Task *task, Context *ctx, Entity *args,
+                      SocketOption *option, int *value, Entity *error) {
+  if (!IS_TUPLE(args) ||
+      2 != tuple_size((Tuple *)args->obj->_internal_obj)) {
+    *error = raise_error(task, ctx, "Expected (option, value).");
+    return false;
+  }
+  Tuple *tuple = (Tuple *)args->obj->_internal_obj;
+  const Entity *option_e = tuple_get(tuple, 0);
+  const Entity *value_e = tuple_get(tuple, 1);
+  if (!IS_INT(option_e) || pint(&option_e->pri) < SOCKET_OPTION_REUSE_ADDR ||
+      pint(&option_e->pri) > SOCKET_OPTION_NO_DELAY) {
+    *error = raise_error(task, ctx, "Unknown socket option.");
+    return false;
+  }
+  if (!IS_NONE(value_e) && !IS_INT(value_e)) {
+    *error = raise_error(task, ctx, "Socket option value must be an Int.");
+    return false;
+  }
+  *option = (SocketOption)pint(&option_e->pri);
+  *value = IS_NONE(value_e) ? 0 : pint(&value_e->pri);
+  return true;
+}
+
+Entity _Socket_set_option(Task *task, Context *ctx, Object *obj,
+                          Entity *args) {
+  Socket *socket = (Socket *)obj->_internal_obj;
+  SocketOption option;
+  int value;
+  Entity error;
+  if (!_set_option_args(task, ctx, args, &option, &value, &error)) {
+    return error;
+  }
+  if (!socket_set_option(socket, option, value)) {
+    return raise_error(task, ctx, "Could not set socket option.");
+  }
+  return NONE_ENTITY;
+}
+
+Entity _SocketHandle_set_option(Task *task, Context *ctx, Object *obj,
+                                Entity *args) {
+  SocketHandle *sh = (SocketHandle *)obj->_internal_obj;
+  if (NULL == sh) {
+    return raise_error(task, ctx, "Weird Socket error.");
+  }
+  SocketOption option;
+  int value;
+  Entity error;
+  if (!_set_option_args(task, ctx, args, &option, &value, &error)) {
+    return error;
+  }
+  if (!sockethandle_set_option(sh, option, value)) {
+    return raise_error(task, ctx, "Could not set socket option.");
+  }
+  return NONE_ENTITY;
 }
 
 Entity _init_sockets(Task *task, Context *ctx, Object *obj, Entity *args) {
@@ -187,19 +1521,73 @@ Entity _cleanup_sockets(Task *task, Context *ctx, Object *obj, Entity *args) {
 void socket_add_native(ModuleManager *mm, Module *socket) {
   native_function(socket, intern("__init"), _init_sockets);
   native_function(socket, intern("__cleanup"), _cleanup_sockets);
+  native_function(socket, intern("socketpair"), _socketpair);
+  native_function(socket, intern("handle_from_fd"), _handle_from_fd);
   Class_SocketHandle = native_class(socket, intern("SocketHandle"),
                                     _SocketHandle_init, _SocketHandle_delete);
   native_method(Class_SocketHandle, intern("new"), _SocketHandle_constructor);
-  native_background_method(Class_SocketHandle, intern("send"),
-                           _SocketHandle_send);
-  native_background_method(Class_SocketHandle, intern("receive"),
-                           _SocketHandle_receive);
+  native_method(Class_SocketHandle, intern("send"), _SocketHandle_send);
+  native_method(Class_SocketHandle, intern("receive"), _SocketHandle_receive);
+  native_method(Class_SocketHandle, intern("receive_exact"),
+                _SocketHandle_receive_exact);
+  native_method(Class_SocketHandle, intern("receive_until"),
+                _SocketHandle_receive_until);
+  native_method(Class_SocketHandle, intern("receive_into"),
+                _SocketHandle_receive_into);
+  native_method(Class_SocketHandle, intern("receive_request"),
+                _SocketHandle_receive_request);
+  native_method(Class_SocketHandle, intern("send_file"),
+                _SocketHandle_send_file);
+  native_method(Class_SocketHandle, intern("set_blocking"),
+                _SocketHandle_set_blocking);
+  native_method(Class_SocketHandle, intern("set_option"),
+                _SocketHandle_set_option);
+  native_method(Class_SocketHandle, intern("send_handle"),
+                _SocketHandle_send_handle);
+  native_method(Class_SocketHandle, intern("receive_handle"),
+                _SocketHandle_receive_handle);
+  native_method(Class_SocketHandle, intern("detach"), _SocketHandle_detach);
   native_method(Class_SocketHandle, intern("close"), _SocketHandle_close);
+  _send_in_background =
+      native_background_method(Class_SocketHandle, intern("$send"),
+                               _SocketHandle_send_blocking, BACKGROUND_IO);
+  _receive_in_background =
+      native_background_method(Class_SocketHandle, intern("$receive"),
+                               _SocketHandle_receive_blocking, BACKGROUND_IO);
+  _receive_exact_in_background = native_background_method(
+      Class_SocketHandle, intern("$receive_exact"),
+      _SocketHandle_receive_exact_blocking, BACKGROUND_IO);
+  _receive_until_in_background = native_background_method(
+      Class_SocketHandle, intern("$receive_until"),
+      _SocketHandle_receive_until_blocking, BACKGROUND_IO);
+  _receive_into_in_background = native_background_method(
+      Class_SocketHandle, intern("$receive_into"),
+      _SocketHandle_receive_into_blocking, BACKGROUND_IO);
+  _receive_request_in_background = native_background_method(
+      Class_SocketHandle, intern("$receive_request"),
+      _SocketHandle_receive_request_blocking, BACKGROUND_IO);
+  _send_file_in_background =
+      native_background_method(Class_SocketHandle, intern("$send_file"),
+                               _SocketHandle_send_file_blocking, BACKGROUND_IO);
+  _send_handle_in_background = native_background_method(
+      Class_SocketHandle, intern("$send_handle"),
+      _SocketHandle_send_handle_blocking, BACKGROUND_IO);
+  _receive_handle_in_background = native_background_method(
+      Class_SocketHandle, intern("$receive_handle"),
+      _SocketHandle_receive_handle_blocking, BACKGROUND_IO);
 
   Class_Socket =
       native_class(socket, intern("Socket"), _Socket_init, _Socket_delete);
   native_method(Class_Socket, intern("new"), _Socket_constructor);
-  native_background_method(Class_Socket, intern("accept"), _Socket_accept);
-  native_background_method(Class_Socket, intern("connect"), _Socket_connect);
+  native_method(Class_Socket, intern("accept"), _Socket_accept);
+  native_method(Class_Socket, intern("set_blocking"), _Socket_set_blocking);
+  native_method(Class_Socket, intern("set_option"), _Socket_set_option);
+  native_method(Class_Socket, intern("listen"), _Socket_listen);
+  native_method(Class_Socket, intern("receiver"), _Socket_receiver);
+  _accept_in_background =
+      native_background_method(Class_Socket, intern("$accept"),
+                               _Socket_accept_blocking, BACKGROUND_IO);
+  native_background_method(Class_Socket, intern("connect"), _Socket_connect,
+                           BACKGROUND_IO);
   native_method(Class_Socket, intern("close"), _Socket_close);
 }
\ No newline at end of file
@@ -22,6 +22,14 @@ typedef struct _Class Class;
 typedef struct _Module Module;
 typedef struct _Function Function;
 
+// The VM thread pool that runs a background native.
+typedef enum {
+  // Natives that mostly block on files, sockets and the like.
+  BACKGROUND_IO,
+  // Natives that keep a processor busy.
+  BACKGROUND_CPU,
+} BackgroundPool;
+
 typedef void (*ObjDelFn)(Object *);
 typedef void (*ObjInitFn)(Object *);
 // TODO: This should only be temporary until to_s() is supported.
@@ -34,6 +42,10 @@ struct _Object {
   const Node *_node_ref;
   const Class *_class;
   KeyedList _members;
+  // The FrozenRegion owning this object if it is immutable, otherwise NULL.
+  void *_frozen_region;
+  // Bytes charged to the owning heap's budget for this object.
+  size_t _heap_bytes;
 
   // If the object is reflected.
   union {
@@ -85,6 +97,7 @@ struct _Function {
   bool _is_async;
   bool _is_const;
   bool _is_background;
+  BackgroundPool _background_pool;
   union {
     uint32_t _ins_pos;
     void *_native_fn;  // NativeFn
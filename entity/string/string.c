@@ -5,20 +5,319 @@
 
 #include "entity/string/string.h"
 
+#include <stdatomic.h>
 #include <stdio.h>
+#include <string.h>
 
+#include "alloc/alloc.h"
+#include "alloc/arena/intern.h"
 #include "debug/debug.h"
 #include "entity/entity.h"
 #include "entity/object.h"
-#include "stdio.h"
-#include "struct/arraylike.h"
+#include "struct/struct_defaults.h"
 
-IMPL_ARRAYLIKE(String, char);
+#define DEDUP_INITIAL_CAPACITY 64
+
+struct _StringBuffer {
+  // Atomic, since Strings may be let go of by background natives.
+  atomic_uint_fast32_t refcount;
+  char chars[];
+};
+
+static inline bool _string_is_inline(const String *str) {
+  return str->table == str->_inline;
+}
+
+// Whether [str] may write to its storage without affecting other Strings.
+static inline bool _string_is_unique(const String *str) {
+  return !str->_is_interned &&
+         (NULL == str->_buffer || 1 == atomic_load(&str->_buffer->refcount));
+}
+
+static inline void _string_modified(String *str) {
+  str->_is_hashed = false;
+  str->table[str->_size] = '\0';
+}
+
+StringBuffer *_string_buffer_create(uint32_t capacity) {
+  StringBuffer *buffer =
+      (StringBuffer *)ALLOC_ARRAY(char, sizeof(StringBuffer) + capacity + 1);
+  atomic_init(&buffer->refcount, 1);
+  return buffer;
+}
+
+// Lets go of the storage held by [str] without touching its table. Returns
+// the number of bytes freed.
+uint32_t _string_drop_storage(String *str) {
+  uint32_t freed = 0;
+  if (NULL != str->_buffer &&
+      1 == atomic_fetch_sub(&str->_buffer->refcount, 1)) {
+    freed = sizeof(StringBuffer) + str->_capacity + 1;
+    DEALLOC(str->_buffer);
+  }
+  str->_buffer = NULL;
+  str->_is_interned = false;
+  return freed;
+}
+
+// Moves the contents of [str] into new, unshared storage for [capacity]
+// chars.
+void _string_move(String *str, uint32_t capacity) {
+  StringBuffer *old_buffer = str->_buffer;
+  const char *old_table = str->table;
+  StringBuffer *buffer = NULL;
+  char *table;
+  if (capacity <= STRING_INLINE_CAPACITY) {
+    table = str->_inline;
+    capacity = STRING_INLINE_CAPACITY;
+  } else {
+    buffer = _string_buffer_create(capacity);
+    table = buffer->chars;
+  }
+  memmove(table, old_table, str->_size + 1);
+  // Keep the old buffer alive until its contents are copied.
+  str->_buffer = old_buffer;
+  _string_drop_storage(str);
+  str->_buffer = buffer;
+  str->table = table;
+  str->_capacity = capacity;
+}
+
+// Ensures [str] owns its storage and has room for [size] chars plus the NUL
+// terminator.
+void _string_reserve(String *str, uint32_t size) {
+  bool is_unique = _string_is_unique(str);
+  if (is_unique && size <= str->_capacity) {
+    return;
+  }
+  uint32_t capacity = size;
+  if (size > str->_capacity && capacity < str->_capacity * 2) {
+    capacity = str->_capacity * 2;
+  }
+  if (is_unique && NULL != str->_buffer) {
+    str->_buffer = (StringBuffer *)REALLOC(
+        str->_buffer, char, sizeof(StringBuffer) + capacity + 1);
+    str->table = str->_buffer->chars;
+    str->_capacity = capacity;
+    return;
+  }
+  _string_move(str, capacity);
+}
+
+String *String_create_sz(size_t capacity) {
+  String *str = ALLOC2(String);
+  str->_size = 0;
+  str->_is_hashed = false;
+  str->_is_interned = false;
+  if (capacity <= STRING_INLINE_CAPACITY) {
+    str->_buffer = NULL;
+    str->table = str->_inline;
+    str->_capacity = STRING_INLINE_CAPACITY;
+  } else {
+    str->_buffer = _string_buffer_create(capacity);
+    str->table = str->_buffer->chars;
+    str->_capacity = capacity;
+  }
+  str->table[0] = '\0';
+  return str;
+}
+
+String *String_create_copy(const char *src, size_t size) {
+  String *str = String_create_sz(size);
+  memcpy(str->table, src, size);
+  str->_size = size;
+  _string_modified(str);
+  return str;
+}
+
+void String_delete(String *str) {
+  ASSERT(NOT_NULL(str));
+  _string_drop_storage(str);
+  DEALLOC(str);
+}
+
+inline uint32_t String_size(const String *str) { return str->_size; }
+
+inline char String_get(const String *str, uint32_t index) {
+  ASSERT(index < str->_size);
+  return str->table[index];
+}
+
+void String_set(String *str, uint32_t index, char c) {
+  if (index >= str->_size) {
+    _string_reserve(str, index + 1);
+    memset(str->table + str->_size, '\0', index + 1 - str->_size);
+    str->_size = index + 1;
+  } else {
+    _string_reserve(str, str->_size);
+  }
+  str->table[index] = c;
+  _string_modified(str);
+}
+
+void String_append(String *head, const String *tail) {
+  // Copy the size first in case [head] and [tail] are the same string.
+  uint32_t tail_size = tail->_size;
+  _string_reserve(head, head->_size + tail_size);
+  memmove(head->table + head->_size, tail->table, tail_size);
+  head->_size += tail_size;
+  _string_modified(head);
+}
+
+void String_append_chars(String *head, const char *chars, uint32_t size) {
+  _string_reserve(head, head->_size + size);
+  memcpy(head->table + head->_size, chars, size);
+  head->_size += size;
+  _string_modified(head);
+}
+
+void String_lshrink(String *str, uint32_t amount) {
+  ASSERT(amount <= str->_size);
+  _string_reserve(str, str->_size);
+  str->_size -= amount;
+  memmove(str->table, str->table + amount, str->_size);
+  _string_modified(str);
+}
+
+void String_rshrink(String *str, uint32_t amount) {
+  ASSERT(amount <= str->_size);
+  _string_reserve(str, str->_size);
+  str->_size -= amount;
+  _string_modified(str);
+}
+
+void String_clear(String *str) {
+  if (!_string_is_unique(str)) {
+    _string_drop_storage(str);
+    str->table = str->_inline;
+    str->_capacity = STRING_INLINE_CAPACITY;
+  }
+  str->_size = 0;
+  _string_modified(str);
+}
+
+size_t String_footprint(const String *str) {
+  size_t size = sizeof(String);
+  if (NULL != str->_buffer) {
+    size += sizeof(StringBuffer) + str->_capacity + 1;
+  }
+  return size;
+}
+
+bool String_equals(const String *a, const String *b) {
+  if (a->_size != b->_size) {
+    return false;
+  }
+  if (a->table == b->table) {
+    return true;
+  }
+  // Cached hashes can rule out a match without comparing the contents.
+  if (a->_is_hashed && b->_is_hashed && a->_hash != b->_hash) {
+    return false;
+  }
+  return 0 == memcmp(a->table, b->table, a->_size);
+}
+
+int32_t String_hash_uncached(const String *str) {
+  return str->_is_hashed ? str->_hash
+                         : string_hasher_len(str->table, str->_size);
+}
+
+int32_t String_hash(String *str) {
+  if (!str->_is_hashed) {
+    str->_hash = string_hasher_len(str->table, str->_size);
+    str->_is_hashed = true;
+  }
+  return str->_hash;
+}
+
+int32_t String_intern(String *str) {
+  // Inline strings have no storage to release, and the intern table is keyed
+  // on C strings.
+  if (str->_is_interned || _string_is_inline(str) ||
+      NULL != memchr(str->table, '\0', str->_size)) {
+    return -1;
+  }
+  char *interned = intern_range(str->table, 0, str->_size);
+  uint32_t freed = _string_drop_storage(str);
+  str->table = interned;
+  str->_capacity = str->_size;
+  str->_is_interned = true;
+  return freed;
+}
+
+// Makes [dst] share the storage of [src], which must not be inline.
+uint32_t _string_share(String *dst, String *src) {
+  uint32_t freed = _string_drop_storage(dst);
+  if (src->_is_interned) {
+    dst->_is_interned = true;
+  } else {
+    atomic_fetch_add(&src->_buffer->refcount, 1);
+    dst->_buffer = src->_buffer;
+  }
+  dst->table = src->table;
+  dst->_capacity = src->_capacity;
+  return freed;
+}
+
+void string_dedup_init(StringDedup *dedup) {
+  dedup->_capacity = DEDUP_INITIAL_CAPACITY;
+  dedup->_count = 0;
+  dedup->_slots = ALLOC_ARRAY(String *, dedup->_capacity);
+  memset(dedup->_slots, 0, sizeof(String *) * dedup->_capacity);
+}
+
+void string_dedup_finalize(StringDedup *dedup) { DEALLOC(dedup->_slots); }
+
+void _string_dedup_insert(StringDedup *dedup, String *str) {
+  uint32_t mask = dedup->_capacity - 1;
+  uint32_t i = (uint32_t)String_hash(str) & mask;
+  while (NULL != dedup->_slots[i]) {
+    i = (i + 1) & mask;
+  }
+  dedup->_slots[i] = str;
+  dedup->_count++;
+}
+
+void _string_dedup_grow(StringDedup *dedup) {
+  String **old_slots = dedup->_slots;
+  uint32_t old_capacity = dedup->_capacity;
+  dedup->_capacity *= 2;
+  dedup->_count = 0;
+  dedup->_slots = ALLOC_ARRAY(String *, dedup->_capacity);
+  memset(dedup->_slots, 0, sizeof(String *) * dedup->_capacity);
+  uint32_t i;
+  for (i = 0; i < old_capacity; ++i) {
+    if (NULL != old_slots[i]) {
+      _string_dedup_insert(dedup, old_slots[i]);
+    }
+  }
+  DEALLOC(old_slots);
+}
+
+uint32_t string_dedup_add(StringDedup *dedup, String *str) {
+  // Inline strings have no separate storage to share.
+  if (_string_is_inline(str)) {
+    return 0;
+  }
+  uint32_t mask = dedup->_capacity - 1;
+  uint32_t i = (uint32_t)String_hash(str) & mask;
+  for (; NULL != dedup->_slots[i]; i = (i + 1) & mask) {
+    String *canonical = dedup->_slots[i];
+    if (String_equals(canonical, str)) {
+      return canonical->table == str->table ? 0 : _string_share(str, canonical);
+    }
+  }
+  if (2 * (dedup->_count + 1) > dedup->_capacity) {
+    _string_dedup_grow(dedup);
+  }
+  _string_dedup_insert(dedup, str);
+  return 0;
+}
 
 void __string_create(Object *obj) { obj->_internal_obj = NULL; }
 
 void __string_init(Object *obj, const char *str, size_t size) {
-  // What is the runtime of strlen?
   String *string =
       (NULL == str) ? String_create_sz(size) : String_create_copy(str, size);
   obj->_internal_obj = string;
@@ -34,4 +333,4 @@ void __string_delete(Object *obj) {
 void __string_print(const Object *obj, FILE *out) {
   String *str = (String *)obj->_internal_obj;
   fprintf(out, "'%*s'", String_size(str), str->table);
-}
\ No newline at end of file
+}
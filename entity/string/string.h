@@ -6,15 +6,83 @@
 #ifndef ENTITY_STRING_STRING_H_
 #define ENTITY_STRING_STRING_H_
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 #include "entity/entity.h"
 #include "entity/object.h"
-#include "struct/arraylike.h"
 
-DEFINE_ARRAYLIKE(String, char);
+// Strings up to this many bytes are kept in the String itself instead of in a
+// separate allocation.
+#define STRING_INLINE_CAPACITY 15
+
+typedef struct _StringBuffer StringBuffer;
+
+typedef struct {
+  // Points at _inline, into _buffer or at interned chars. Always
+  // NUL-terminated.
+  char *table;
+  uint32_t _size;
+  uint32_t _capacity;
+  // Cached result of String_hash(), valid while _is_hashed.
+  int32_t _hash;
+  bool _is_hashed;
+  // Set when table points into the process-wide intern table.
+  bool _is_interned;
+  // Refcounted storage for strings too long to be inline. May be shared with
+  // other Strings, in which case it is copied before being modified.
+  StringBuffer *_buffer;
+  char _inline[STRING_INLINE_CAPACITY + 1];
+} String;
+
+// Content-keyed table used to make equal strings share storage.
+typedef struct {
+  String **_slots;
+  uint32_t _capacity;
+  uint32_t _count;
+} StringDedup;
+
+String *String_create_sz(size_t capacity);
+String *String_create_copy(const char *src, size_t size);
+void String_delete(String *str);
+
+uint32_t String_size(const String *str);
+char String_get(const String *str, uint32_t index);
+// Grows the string if [index] is past the end.
+void String_set(String *str, uint32_t index, char c);
+void String_append(String *head, const String *tail);
+void String_append_chars(String *head, const char *chars, uint32_t size);
+// Removes [amount] chars from the front.
+void String_lshrink(String *str, uint32_t amount);
+// Removes [amount] chars from the back.
+void String_rshrink(String *str, uint32_t amount);
+void String_clear(String *str);
+
+// Bytes held by [str], including storage it shares with other Strings.
+size_t String_footprint(const String *str);
+
+bool String_equals(const String *a, const String *b);
+// Hashes the contents. The hash is cached until the string is next modified.
+int32_t String_hash(String *str);
+// Same as String_hash() without caching, for frozen strings, which are read by
+// other processes' threads and must not be written.
+int32_t String_hash_uncached(const String *str);
+
+// Points [str] at the canonical interned copy of its contents. Returns the
+// number of bytes of storage released, or -1 if [str] was left as it is
+// because it is inline, already interned or cannot be interned.
+int32_t String_intern(String *str);
+
+void string_dedup_init(StringDedup *dedup);
+void string_dedup_finalize(StringDedup *dedup);
+// Makes [str] share storage with an equal string previously added, if any.
+// Returns the number of bytes of storage released.
+uint32_t string_dedup_add(StringDedup *dedup, String *str);
 
 void __string_create(Object *obj);
 void __string_init(Object *obj, const char *str, size_t size);
 void __string_delete(Object *obj);
 void __string_print(const Object *obj, FILE *out);
 
-#endif /* ENTITY_STRING_STRING_H_ */
\ No newline at end of file
+#endif /* ENTITY_STRING_STRING_H_ */
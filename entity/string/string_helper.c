@@ -11,5 +11,12 @@
 Object *string_new(Heap *heap, const char src[], size_t len) {
   Object *str = heap_new(heap, Class_String);
   __string_init(str, src, len);
+  heap_charge(heap, str, String_footprint((String *)str->_internal_obj));
   return str;
+}
+
+void string_recharge(Heap *heap, Object *str, size_t old_footprint) {
+  heap_charge(heap, str,
+              (int64_t)String_footprint((String *)str->_internal_obj) -
+                  (int64_t)old_footprint);
 }
\ No newline at end of file
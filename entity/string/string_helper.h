@@ -6,4 +6,6 @@
 #include "entity/object.h"
 #include "heap/heap.h"
 
-Object *string_new(Heap *heap, const char src[], size_t len);
\ No newline at end of file
+Object *string_new(Heap *heap, const char src[], size_t len);
+// Updates the heap budget after [str] was resized from [old_footprint] bytes.
+void string_recharge(Heap *heap, Object *str, size_t old_footprint);
\ No newline at end of file
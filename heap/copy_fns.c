@@ -38,4 +38,6 @@ void string_copy(Heap *heap, Map *cpy_map, Object *target_obj,
                  Object *src_obj) {
   String *src = (String *)src_obj->_internal_obj;
   __string_init(target_obj, src->table, String_size(src));
+  heap_charge(heap, target_obj,
+              String_footprint((String *)target_obj->_internal_obj));
 }
\ No newline at end of file
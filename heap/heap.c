@@ -5,6 +5,7 @@
 
 #include "heap/heap.h"
 
+#include <stdatomic.h>
 #include <stdint.h>
 
 #include "alloc/alloc.h"
@@ -17,12 +18,52 @@
 #include "entity/tuple/tuple.h"
 #include "struct/alist.h"
 #include "struct/keyed_list.h"
+#include "struct/map.h"
+#include "struct/set.h"
+#include "util/sync/mutex.h"
 
 struct _Heap {
   MGraph *mg;
   __Arena object_arena;
+  // FrozenRegion -> the Node standing in for it on this heap. Edges to frozen
+  // objects are recorded as edges to that Node, so the region is released
+  // once a collection finds nothing here still references it.
+  Map frozen_regions;
+  // Edges added with heap_inc_edge() rather than through members, Arrays or
+  // Tuples, e.g. a Process pinning the Future of an op in flight. Object ->
+  // Map of child -> count. Only kept so heap dumps can follow them.
+  Map pins;
+  // Objects passed to heap_make_root().
+  Set roots;
+
+  HeapLimits limits;
+  // Atomic since background natives allocate on pool threads while the heap
+  // owner runs.
+  _Atomic uint32_t num_objects;
+  _Atomic uint64_t num_bytes;
+  atomic_bool budget_exceeded;
+  // Cleared by heap_hold_budget() so a program can handle going over budget.
+  // Set again once a collection finds the heap back under its limits, or the
+  // limits change.
+  atomic_bool budget_armed;
+};
+
+// An immutable object graph living on its own heap. Objects in it are shared
+// between heaps, so edges to them are recorded in a heap's MGraph against the
+// Node for their region instead.
+struct _FrozenRegion {
+  Heap *heap;
+  Mutex refcount_lock;
+  uint32_t refcount;
 };
 
+void _frozen_region_retain(Heap *heap, FrozenRegion *region);
+void _frozen_region_release(FrozenRegion *region);
+void _frozen_region_unlink(FrozenRegion *region, Heap *heap);
+
+void _heap_inc_edge(Heap *heap, Object *parent, Object *child);
+void _heap_dec_edge(Heap *heap, Object *parent, Object *child);
+
 Object *_object_create(Heap *heap, const Class *class);
 void _object_delete(Object *object, Heap *heap);
 
@@ -32,6 +73,15 @@ Heap *heap_create(HeapConf *config) {
   config->mgraph_config.ctx = heap;
   heap->mg = mgraph_create(&config->mgraph_config);
   __arena_init(&heap->object_arena, sizeof(Object), "Object");
+  map_init_default(&heap->frozen_regions);
+  map_init_default(&heap->pins);
+  set_init_default(&heap->roots);
+  heap->limits.max_objects = 0;
+  heap->limits.max_bytes = 0;
+  atomic_init(&heap->num_objects, 0);
+  atomic_init(&heap->num_bytes, 0);
+  atomic_init(&heap->budget_exceeded, false);
+  atomic_init(&heap->budget_armed, true);
   return heap;
 }
 
@@ -39,11 +89,25 @@ void heap_delete(Heap *heap) {
   ASSERT(NOT_NULL(heap), NOT_NULL(heap->mg));
   mgraph_delete(heap->mg);
   __arena_finalize(&heap->object_arena);
+  // Regions whose Nodes were not already deleted with the MGraph.
+  M_iter regions = map_iter(&heap->frozen_regions);
+  for (; has(&regions); inc(&regions)) {
+    _frozen_region_release((FrozenRegion *)key(&regions));
+  }
+  map_finalize(&heap->frozen_regions);
+  // Deleting the objects already dropped their pins.
+  map_finalize(&heap->pins);
+  set_finalize(&heap->roots);
   DEALLOC(heap);
 }
 
 uint32_t heap_collect_garbage(Heap *heap) {
-  return mgraph_collect_garbage(heap->mg);
+  uint32_t deleted = mgraph_collect_garbage(heap->mg);
+  if (!atomic_load_explicit(&heap->budget_armed, memory_order_relaxed) &&
+      !heap_over_budget(heap)) {
+    atomic_store(&heap->budget_armed, true);
+  }
+  return deleted;
 }
 
 Object *heap_new(Heap *heap, const Class *class) {
@@ -51,11 +115,126 @@ Object *heap_new(Heap *heap, const Class *class) {
   Object *object = _object_create(heap, class);
   // Blessed
   object->_node_ref = mgraph_insert(heap->mg, object, (Deleter)_object_delete);
+  atomic_fetch_add_explicit(&heap->num_objects, 1, memory_order_relaxed);
+  heap_charge(heap, object, sizeof(Object));
   return object;
 }
 
+void heap_set_limits(Heap *heap, const HeapLimits *limits) {
+  ASSERT(NOT_NULL(heap), NOT_NULL(limits));
+  heap->limits = *limits;
+  atomic_store(&heap->budget_armed, true);
+  atomic_store(&heap->budget_exceeded, heap_over_budget(heap));
+}
+
+void heap_usage(const Heap *heap, HeapUsage *usage) {
+  ASSERT(NOT_NULL(heap), NOT_NULL(usage));
+  usage->num_objects =
+      atomic_load_explicit(&heap->num_objects, memory_order_relaxed);
+  usage->num_bytes =
+      atomic_load_explicit(&heap->num_bytes, memory_order_relaxed);
+}
+
+inline bool heap_over_budget(const Heap *heap) {
+  HeapUsage usage;
+  heap_usage(heap, &usage);
+  return (0 != heap->limits.max_objects &&
+          usage.num_objects > heap->limits.max_objects) ||
+         (0 != heap->limits.max_bytes &&
+          usage.num_bytes > heap->limits.max_bytes);
+}
+
+void heap_charge(Heap *heap, Object *obj, int64_t bytes) {
+  ASSERT(NOT_NULL(heap), NOT_NULL(obj));
+  obj->_heap_bytes += bytes;
+  // Negative charges wrap around to a subtraction.
+  atomic_fetch_add_explicit(&heap->num_bytes, (uint64_t)bytes,
+                            memory_order_relaxed);
+  if (bytes > 0 &&
+      atomic_load_explicit(&heap->budget_armed, memory_order_relaxed) &&
+      heap_over_budget(heap)) {
+    atomic_store(&heap->budget_exceeded, true);
+  }
+}
+
+bool heap_take_budget_exceeded(Heap *heap) {
+  // Checked after every instruction, so only write when there is news.
+  return atomic_load_explicit(&heap->budget_exceeded, memory_order_relaxed) &&
+         atomic_exchange(&heap->budget_exceeded, false);
+}
+
+void heap_hold_budget(Heap *heap) {
+  atomic_store(&heap->budget_armed, false);
+  atomic_store(&heap->budget_exceeded, false);
+}
+
 void heap_make_root(Heap *heap, Object *obj) {
   mgraph_root(heap->mg, (Node *)obj->_node_ref);
+  set_insert(&heap->roots, obj);
+}
+
+void heap_for_each_root(Heap *heap, void (*fn)(Object *, void *), void *arg) {
+  ASSERT(NOT_NULL(heap), NOT_NULL(fn));
+  M_iter roots = set_iter(&heap->roots);
+  for (; has(&roots); inc(&roots)) {
+    fn((Object *)value(&roots), arg);
+  }
+}
+
+void heap_for_each_pin(Heap *heap, Object *obj, void (*fn)(Object *, void *),
+                       void *arg) {
+  ASSERT(NOT_NULL(heap), NOT_NULL(obj), NOT_NULL(fn));
+  Map *children = (Map *)map_lookup(&heap->pins, obj);
+  if (NULL == children) {
+    return;
+  }
+  M_iter pins = map_iter(children);
+  for (; has(&pins); inc(&pins)) {
+    fn((Object *)key(&pins), arg);
+  }
+}
+
+void _heap_pin(Heap *heap, Object *parent, Object *child) {
+  Map *children = (Map *)map_lookup(&heap->pins, parent);
+  if (NULL == children) {
+    children = map_create_default();
+    map_insert(&heap->pins, parent, children);
+  }
+  uintptr_t count = (uintptr_t)map_lookup(children, child);
+  if (0 != count) {
+    map_remove(children, child);
+  }
+  map_insert(children, child, (void *)(count + 1));
+}
+
+void _heap_unpin(Heap *heap, Object *parent, Object *child) {
+  Map *children = (Map *)map_lookup(&heap->pins, parent);
+  if (NULL == children) {
+    return;
+  }
+  uintptr_t count = (uintptr_t)map_lookup(children, child);
+  if (0 == count) {
+    return;
+  }
+  map_remove(children, child);
+  if (count > 1) {
+    map_insert(children, child, (void *)(count - 1));
+  } else if (0 == map_size(children)) {
+    map_remove(&heap->pins, parent);
+    map_delete(children);
+  }
+}
+
+void heap_inc_edge(Heap *heap, Object *parent, Object *child) {
+  ASSERT(NOT_NULL(heap), NOT_NULL(parent), NOT_NULL(child));
+  _heap_inc_edge(heap, parent, child);
+  _heap_pin(heap, parent, child);
+}
+
+void heap_dec_edge(Heap *heap, Object *parent, Object *child) {
+  ASSERT(NOT_NULL(heap), NOT_NULL(parent), NOT_NULL(child));
+  _heap_dec_edge(heap, parent, child);
+  _heap_unpin(heap, parent, child);
 }
 
 void object_set_member(Heap *heap, Object *parent, const char key[],
@@ -65,13 +244,13 @@ void object_set_member(Heap *heap, Object *parent, const char key[],
   Entity *old_member =
       (Entity *)keyedlist_insert(&parent->_members, key, (void **)&entry_pos);
   ASSERT(NOT_NULL(entry_pos));
-  if (NULL != old_member && OBJECT == etype(old_member)) {
-    mgraph_dec(heap->mg, (Node *)parent->_node_ref,
-               (Node *)object_m(old_member)->_node_ref);
+  if (NULL == old_member) {
+    heap_charge(heap, parent, sizeof(Entity) + sizeof(char *));
+  } else if (OBJECT == etype(old_member)) {
+    _heap_dec_edge(heap, parent, object_m(old_member));
   }
   if (OBJECT == etype(child)) {
-    mgraph_inc(heap->mg, (Node *)parent->_node_ref,
-               (Node *)object(child)->_node_ref);
+    _heap_inc_edge(heap, parent, (Object *)object(child));
   }
   (*entry_pos) = *child;
 }
@@ -83,11 +262,12 @@ Entity *object_set_member_obj(Heap *heap, Object *parent, const char key[],
   Entity *old_member =
       (Entity *)keyedlist_insert(&parent->_members, key, (void **)&entry_pos);
   ASSERT(NOT_NULL(entry_pos));
-  if (NULL != old_member && OBJECT == etype(old_member)) {
-    mgraph_dec(heap->mg, (Node *)parent->_node_ref,
-               (Node *)object_m(old_member)->_node_ref);
+  if (NULL == old_member) {
+    heap_charge(heap, parent, sizeof(Entity) + sizeof(char *));
+  } else if (OBJECT == etype(old_member)) {
+    _heap_dec_edge(heap, parent, object_m(old_member));
   }
-  mgraph_inc(heap->mg, (Node *)parent->_node_ref, (Node *)child->_node_ref);
+  _heap_inc_edge(heap, parent, (Object *)child);
   entry_pos->type = OBJECT;
   entry_pos->obj = (Object *)child;
   return entry_pos;
@@ -97,6 +277,8 @@ Object *_object_create(Heap *heap, const Class *class) {
   ASSERT(NOT_NULL(heap));
   Object *object = (Object *)__arena_alloc(&heap->object_arena);
   object->_class = class;
+  object->_frozen_region = NULL;
+  object->_heap_bytes = 0;
   keyedlist_init(&object->_members, Entity, DEFAULT_ARRAY_SZ);
   if (NULL != class->_init_fn) {
     class->_init_fn(object);
@@ -120,6 +302,14 @@ void _object_delete(Object *object, Heap *heap) {
   // } else {
   //   printf("DELETING a '%s'\n", object->_class->_name);
   // }
+  atomic_fetch_sub_explicit(&heap->num_objects, 1, memory_order_relaxed);
+  atomic_fetch_sub_explicit(&heap->num_bytes, object->_heap_bytes,
+                            memory_order_relaxed);
+  Map *pinned = (Map *)map_lookup(&heap->pins, object);
+  if (NULL != pinned) {
+    map_remove(&heap->pins, object);
+    map_delete(pinned);
+  }
   if (NULL != object->_class->_delete_fn) {
     object->_class->_delete_fn(object);
   }
@@ -127,13 +317,29 @@ void _object_delete(Object *object, Heap *heap) {
   __arena_dealloc(&heap->object_arena, object);
 }
 
-void heap_inc_edge(Heap *heap, Object *parent, Object *child) {
+void _heap_inc_edge(Heap *heap, Object *parent, Object *child) {
   ASSERT(NOT_NULL(heap), NOT_NULL(parent), NOT_NULL(child));
+  if (NULL != child->_frozen_region) {
+    Node *region_node =
+        (Node *)map_lookup(&heap->frozen_regions, child->_frozen_region);
+    if (NULL != region_node) {
+      mgraph_inc(heap->mg, (Node *)parent->_node_ref, region_node);
+    }
+    return;
+  }
   mgraph_inc(heap->mg, (Node *)parent->_node_ref, (Node *)child->_node_ref);
 }
 
-void heap_dec_edge(Heap *heap, Object *parent, Object *child) {
+void _heap_dec_edge(Heap *heap, Object *parent, Object *child) {
   ASSERT(NOT_NULL(heap), NOT_NULL(parent), NOT_NULL(child));
+  if (NULL != child->_frozen_region) {
+    Node *region_node =
+        (Node *)map_lookup(&heap->frozen_regions, child->_frozen_region);
+    if (NULL != region_node) {
+      mgraph_dec(heap->mg, (Node *)parent->_node_ref, region_node);
+    }
+    return;
+  }
   mgraph_dec(heap->mg, (Node *)parent->_node_ref, (Node *)child->_node_ref);
 }
 
@@ -141,32 +347,40 @@ void array_add(Heap *heap, Object *array, const Entity *child) {
   ASSERT(NOT_NULL(heap), NOT_NULL(array), NOT_NULL(child));
   Entity *e = Array_add_last((Array *)array->_internal_obj);
   *e = *child;
+  heap_charge(heap, array, sizeof(Entity));
   if (OBJECT != child->type) {
     return;
   }
-  mgraph_inc(heap->mg, (Node *)array->_node_ref, (Node *)child->obj->_node_ref);
+  _heap_inc_edge(heap, array, child->obj);
 }
 
 Entity array_remove(Heap *heap, Object *array, int32_t index) {
   ASSERT(NOT_NULL(heap), NOT_NULL(array), index >= 0);
   Entity e = Array_remove((Array *)array->_internal_obj, index);
+  heap_charge(heap, array, -(int64_t)sizeof(Entity));
   if (OBJECT == e.type) {
-    mgraph_dec(heap->mg, (Node *)array->_node_ref, (Node *)e.obj->_node_ref);
+    _heap_dec_edge(heap, array, e.obj);
   }
   return e;
 }
 
 void array_set(Heap *heap, Object *array, int32_t index, const Entity *child) {
   ASSERT(NOT_NULL(heap), NOT_NULL(array), NOT_NULL(child), index >= 0);
-  Entity *e = Array_set_ref((Array *)array->_internal_obj, index);
+  Array *arr = (Array *)array->_internal_obj;
+  int32_t old_size = Array_size(arr);
+  Entity *e = Array_set_ref(arr, index);
+  if (index >= old_size) {
+    heap_charge(heap, array,
+                (int64_t)(Array_size(arr) - old_size) * sizeof(Entity));
+  }
   if (NULL != e && OBJECT == e->type) {
-    mgraph_dec(heap->mg, (Node *)array->_node_ref, (Node *)e->obj->_node_ref);
+    _heap_dec_edge(heap, array, e->obj);
   }
   *e = *child;
   if (OBJECT != child->type) {
     return;
   }
-  mgraph_inc(heap->mg, (Node *)array->_node_ref, (Node *)child->obj->_node_ref);
+  _heap_inc_edge(heap, array, child->obj);
 }
 
 // Does this need to handle overwrites?
@@ -175,10 +389,13 @@ void tuple_set(Heap *heap, Object *array, int32_t index, const Entity *child) {
   ASSERT(index >= 0, index < tuple_size((Tuple *)array->_internal_obj));
   Entity *e = tuple_get_mutable((Tuple *)array->_internal_obj, index);
   *e = *child;
+  // Tuples are created before they are attached to an object, so slots are
+  // charged as they are filled.
+  heap_charge(heap, array, sizeof(Entity));
   if (OBJECT != child->type) {
     return;
   }
-  mgraph_inc(heap->mg, (Node *)array->_node_ref, (Node *)child->obj->_node_ref);
+  _heap_inc_edge(heap, array, child->obj);
 }
 
 Entity entity_copy(Heap *heap, Map *copy_map, const Entity *e) {
@@ -191,6 +408,10 @@ Entity entity_copy(Heap *heap, Map *copy_map, const Entity *e) {
       ASSERT(OBJECT == e->type);
   }
   Object *obj = e->obj;
+  if (NULL != obj->_frozen_region) {
+    _frozen_region_retain(heap, (FrozenRegion *)obj->_frozen_region);
+    return *e;
+  }
   // Guarantee only one copied version of each object.
   Object *cpy = (Object *)map_lookup(copy_map, obj);
   if (NULL != cpy) {
@@ -209,4 +430,61 @@ Entity entity_copy(Heap *heap, Map *copy_map, const Entity *e) {
     object_set_member(heap, cpy, kl_key(&members), &member_cpy);
   }
   return entity_object(cpy);
-}
\ No newline at end of file
+}
+inline bool object_is_frozen(const Object *obj) {
+  return NULL != obj->_frozen_region;
+}
+
+void _frozen_region_retain(Heap *heap, FrozenRegion *region) {
+  if (NULL != map_lookup(&heap->frozen_regions, region)) {
+    return;
+  }
+  SYNCHRONIZED(region->refcount_lock, { region->refcount++; });
+  map_insert(&heap->frozen_regions, region,
+             mgraph_insert(heap->mg, region, (Deleter)_frozen_region_unlink));
+}
+
+// Deleter for the Node of [region] on [heap], once nothing there references
+// the region.
+void _frozen_region_unlink(FrozenRegion *region, Heap *heap) {
+  map_remove(&heap->frozen_regions, region);
+  _frozen_region_release(region);
+}
+
+void _frozen_region_release(FrozenRegion *region) {
+  uint32_t refcount;
+  SYNCHRONIZED(region->refcount_lock, { refcount = --region->refcount; });
+  if (0 != refcount) {
+    return;
+  }
+  heap_delete(region->heap);
+  mutex_close(region->refcount_lock);
+  DEALLOC(region);
+}
+
+Entity heap_freeze(Heap *heap, const Entity *e) {
+  ASSERT(NOT_NULL(heap), NOT_NULL(e));
+  if (OBJECT != e->type || NULL != e->obj->_frozen_region) {
+    return entity_copy(heap, NULL, e);
+  }
+  FrozenRegion *region = ALLOC2(FrozenRegion);
+  HeapConf conf = {.mgraph_config = {.eager_delete_edges = true}};
+  region->heap = heap_create(&conf);
+  region->refcount_lock = mutex_create();
+  region->refcount = 0;
+
+  Map copy_map;
+  map_init_default(&copy_map);
+  Entity frozen = entity_copy(region->heap, &copy_map, e);
+  // Only mark objects once the copy is complete so edges inside the region
+  // are tracked by its own MGraph.
+  M_iter copies = map_iter(&copy_map);
+  for (; has(&copies); inc(&copies)) {
+    ((Object *)value(&copies))->_frozen_region = region;
+  }
+  map_finalize(&copy_map);
+  heap_make_root(region->heap, frozen.obj);
+
+  _frozen_region_retain(heap, region);
+  return frozen;
+}
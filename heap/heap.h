@@ -6,23 +6,63 @@
 #ifndef HEAP_HEAP_H_
 #define HEAP_HEAP_H_
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #include "entity/entity.h"
 #include "entity/object.h"
 
 typedef struct _Heap Heap;
+typedef struct _FrozenRegion FrozenRegion;
 
 typedef struct {
   MGraphConf mgraph_config;
 } HeapConf;
 
+// Budget for a single heap. A zero field means no limit.
+typedef struct {
+  uint32_t max_objects;
+  uint64_t max_bytes;
+} HeapLimits;
+
+typedef struct {
+  uint32_t num_objects;
+  // Approximate bytes held by live objects, including their payloads.
+  uint64_t num_bytes;
+} HeapUsage;
+
 Heap *heap_create(HeapConf *config);
 void heap_delete(Heap *heap);
 Object *heap_new(Heap *heap, const Class *class);
 uint32_t heap_collect_garbage(Heap *heap);
 void heap_make_root(Heap *heap, Object *obj);
 
+void heap_set_limits(Heap *heap, const HeapLimits *limits);
+void heap_usage(const Heap *heap, HeapUsage *usage);
+// Accounts for [bytes] of payload (string chars, array slots, ...) allocated
+// for [obj] on [heap]. Negative values release bytes. Whatever is still
+// charged to [obj] is released when it is deleted.
+void heap_charge(Heap *heap, Object *obj, int64_t bytes);
+// Whether the heap is over its limits.
+bool heap_over_budget(const Heap *heap);
+// Whether an allocation has pushed the heap over its limits since the last
+// call. Allocations never fail; the VM checks this at its next safe point.
+bool heap_take_budget_exceeded(Heap *heap);
+// Stops flagging the heap as over budget until a collection finds it back
+// under its limits or new limits are set. Called once the VM has raised for
+// it, so the program has room to handle the error.
+void heap_hold_budget(Heap *heap);
+
+// Records an edge that is not a member, Array or Tuple slot of [parent], e.g.
+// a Process pinning the Future of an op in flight. Such edges are remembered
+// so heap dumps can follow them.
 void heap_inc_edge(Heap *heap, Object *parent, Object *child);
 void heap_dec_edge(Heap *heap, Object *parent, Object *child);
+// Calls [fn] for each object passed to heap_make_root().
+void heap_for_each_root(Heap *heap, void (*fn)(Object *, void *), void *arg);
+// Calls [fn] for each object [obj] has an edge to from heap_inc_edge().
+void heap_for_each_pin(Heap *heap, Object *obj, void (*fn)(Object *, void *),
+                       void *arg);
 
 void object_set_member(Heap *heap, Object *parent, const char key[],
                        const Entity *child);
@@ -34,6 +74,14 @@ Entity array_remove(Heap *heap, Object *array, int32_t index);
 void array_set(Heap *heap, Object *array, int32_t index, const Entity *child);
 void tuple_set(Heap *heap, Object *array, int32_t index, const Entity *child);
 
+// Frozen objects are shared by reference instead of copied.
 Entity entity_copy(Heap *heap, Map *copy_map, const Entity *e);
 
+// Copies [e] once into an immutable region that can be handed to any heap
+// without copying. [heap] and every heap it is later copied into hold a
+// reference to the region until a collection finds none of their objects
+// reference it, and the region is freed when the last reference is dropped.
+Entity heap_freeze(Heap *heap, const Entity *e);
+bool object_is_frozen(const Object *obj);
+
 #endif /* HEAP_HEAP_H_ */
\ No newline at end of file
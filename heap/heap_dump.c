@@ -0,0 +1,255 @@
+// heap_dump.c
+//
+// Created on: Oct 18, 2026
+//     Author: Jeff Manzione
+
+#include "heap/heap_dump.h"
+
+#include <stdint.h>
+
+#include "alloc/alloc.h"
+#include "debug/debug.h"
+#include "entity/array/array.h"
+#include "entity/class/classes.h"
+#include "entity/function/function.h"
+#include "entity/object.h"
+#include "entity/string/string.h"
+#include "entity/tuple/tuple.h"
+#include "program/serialization/buffer.h"
+#include "program/serialization/serialize.h"
+#include "struct/alist.h"
+#include "struct/keyed_list.h"
+#include "struct/map.h"
+#include "struct/struct_defaults.h"
+
+#define DUMP_BUFFER_SIZE 4096
+
+typedef struct {
+  WBuffer buffer;
+  // Object -> (id + 1).
+  Map object_ids;
+  // Class -> (id + 1).
+  Map class_ids;
+  // Objects in id order. Doubles as the BFS queue.
+  AList objects;
+  // Ids of the refs of the object currently being written.
+  AList refs;
+  Heap *heap;
+  HeapDumpStats *stats;
+} _HeapDump;
+
+void heap_roots_add(AList *roots, Object *obj, HeapRootKind kind,
+                    const char name[]) {
+  ASSERT(NOT_NULL(roots));
+  if (NULL == obj) {
+    return;
+  }
+  HeapRoot *root = (HeapRoot *)alist_add(roots);
+  root->obj = obj;
+  root->kind = kind;
+  root->name = (NULL == name) ? "" : name;
+}
+
+void object_for_each_ref(Object *obj, void (*fn)(Object *, void *),
+                         void *arg) {
+  ASSERT(NOT_NULL(obj), NOT_NULL(fn));
+  KL_iter members = keyedlist_iter(&obj->_members);
+  for (; kl_has(&members); kl_inc(&members)) {
+    Entity *member = (Entity *)kl_value(&members);
+    if (OBJECT == member->type) {
+      fn(member->obj, arg);
+    }
+  }
+  if (Class_Array == obj->_class) {
+    Array *array = (Array *)obj->_internal_obj;
+    int i;
+    for (i = 0; i < Array_size(array); ++i) {
+      Entity *e = Array_get_ref(array, i);
+      if (OBJECT == e->type) {
+        fn(e->obj, arg);
+      }
+    }
+  } else if (Class_Tuple == obj->_class) {
+    Tuple *tuple = (Tuple *)obj->_internal_obj;
+    int i;
+    for (i = 0; i < tuple_size(tuple); ++i) {
+      const Entity *e = tuple_get(tuple, i);
+      if (OBJECT == e->type) {
+        fn(e->obj, arg);
+      }
+    }
+  } else if (Class_FunctionRef == obj->_class) {
+    Object *fn_obj = function_ref_get_object(obj);
+    if (NULL != fn_obj) {
+      fn(fn_obj, arg);
+    }
+  }
+}
+
+size_t object_shallow_size(const Object *obj) {
+  ASSERT(NOT_NULL(obj));
+  size_t size = sizeof(Object);
+  KL_iter members = keyedlist_iter((KeyedList *)&obj->_members);
+  for (; kl_has(&members); kl_inc(&members)) {
+    size += sizeof(Entity) + sizeof(char *);
+  }
+  if (Class_String == obj->_class) {
+    const String *str = (const String *)obj->_internal_obj;
+    size += sizeof(String);
+    // Storage shared with other strings is counted in full for each of them.
+    if (NULL != str->_buffer) {
+      size += str->_capacity + 1;
+    }
+  } else if (Class_Array == obj->_class) {
+    size += sizeof(Array) +
+            Array_size((Array *)obj->_internal_obj) * sizeof(Entity);
+  } else if (Class_Tuple == obj->_class) {
+    size += tuple_size((Tuple *)obj->_internal_obj) * sizeof(Entity);
+  }
+  return size;
+}
+
+uint32_t _class_id(_HeapDump *dump, const Class *class) {
+  uint32_t id = (uint32_t)(uintptr_t)map_lookup(&dump->class_ids, class);
+  if (0 != id) {
+    return id - 1;
+  }
+  id = (uint32_t)map_size(&dump->class_ids);
+  map_insert(&dump->class_ids, class, (void *)(uintptr_t)(id + 1));
+
+  uint8_t tag = SNAPSHOT_CLASS;
+  serialize_type(&dump->buffer, uint8_t, tag);
+  serialize_type(&dump->buffer, uint32_t, id);
+  serialize_str(&dump->buffer, class->_name);
+  serialize_str(&dump->buffer,
+                NULL == class->_module ? "" : class->_module->_name);
+  return id;
+}
+
+uint32_t _object_id(_HeapDump *dump, Object *obj) {
+  uint32_t id = (uint32_t)(uintptr_t)map_lookup(&dump->object_ids, obj);
+  if (0 != id) {
+    return id - 1;
+  }
+  id = alist_len(&dump->objects);
+  map_insert(&dump->object_ids, obj, (void *)(uintptr_t)(id + 1));
+  *((Object **)alist_add(&dump->objects)) = obj;
+  return id;
+}
+
+void _add_ref(Object *child, void *arg) {
+  _HeapDump *dump = (_HeapDump *)arg;
+  *((uint32_t *)alist_add(&dump->refs)) = _object_id(dump, child);
+}
+
+void _write_object(_HeapDump *dump, uint32_t id, Object *obj) {
+  alist_clear(&dump->refs);
+  object_for_each_ref(obj, _add_ref, dump);
+  heap_for_each_pin(dump->heap, obj, _add_ref, dump);
+
+  uint32_t class_id = _class_id(dump, obj->_class);
+  uint32_t shallow_size = (uint32_t)object_shallow_size(obj);
+  uint32_t num_refs = alist_len(&dump->refs);
+
+  uint8_t tag = SNAPSHOT_OBJECT;
+  serialize_type(&dump->buffer, uint8_t, tag);
+  serialize_type(&dump->buffer, uint32_t, id);
+  serialize_type(&dump->buffer, uint32_t, class_id);
+  serialize_type(&dump->buffer, uint32_t, shallow_size);
+  serialize_type(&dump->buffer, uint32_t, num_refs);
+  AL_iter refs = alist_iter(&dump->refs);
+  for (; al_has(&refs); al_inc(&refs)) {
+    serialize_type(&dump->buffer, uint32_t, *(uint32_t *)al_value(&refs));
+  }
+
+  dump->stats->num_objects++;
+  dump->stats->num_refs += num_refs;
+  dump->stats->total_bytes += shallow_size;
+}
+
+typedef struct {
+  Map visited;
+  AList queue;
+} _HeapWalk;
+
+void _walk_ref(Object *child, void *arg) {
+  _HeapWalk *walk = (_HeapWalk *)arg;
+  if (map_insert(&walk->visited, child, child)) {
+    *((Object **)alist_add(&walk->queue)) = child;
+  }
+}
+
+void heap_walk(Heap *heap, const AList *roots, void (*fn)(Object *, void *),
+               void *arg) {
+  ASSERT(NOT_NULL(heap), NOT_NULL(roots), NOT_NULL(fn));
+  _HeapWalk walk;
+  map_init_default(&walk.visited);
+  alist_init(&walk.queue, Object *, DEFAULT_ARRAY_SZ);
+  AL_iter root_iter = alist_iter((AList *)roots);
+  for (; al_has(&root_iter); al_inc(&root_iter)) {
+    _walk_ref(((HeapRoot *)al_value(&root_iter))->obj, &walk);
+  }
+  uint32_t i;
+  for (i = 0; i < alist_len(&walk.queue); ++i) {
+    Object *obj = *(Object **)alist_get(&walk.queue, i);
+    fn(obj, arg);
+    object_for_each_ref(obj, _walk_ref, &walk);
+    heap_for_each_pin(heap, obj, _walk_ref, &walk);
+  }
+  alist_finalize(&walk.queue);
+  map_finalize(&walk.visited);
+}
+
+void heap_dump(Heap *heap, const AList *roots, FILE *file,
+               HeapDumpStats *stats) {
+  ASSERT(NOT_NULL(heap), NOT_NULL(roots), NOT_NULL(file), NOT_NULL(stats));
+  _HeapDump dump;
+  dump.heap = heap;
+  buffer_init(&dump.buffer, file, DUMP_BUFFER_SIZE);
+  map_init_default(&dump.object_ids);
+  map_init_default(&dump.class_ids);
+  alist_init(&dump.objects, Object *, DEFAULT_ARRAY_SZ);
+  alist_init(&dump.refs, uint32_t, DEFAULT_ARRAY_SZ);
+  dump.stats = stats;
+  stats->num_objects = 0;
+  stats->num_refs = 0;
+  stats->total_bytes = 0;
+
+  buffer_write(&dump.buffer, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_LEN);
+  uint32_t version = SNAPSHOT_VERSION;
+  serialize_type(&dump.buffer, uint32_t, version);
+
+  AL_iter root_iter = alist_iter((AList *)roots);
+  for (; al_has(&root_iter); al_inc(&root_iter)) {
+    _object_id(&dump, ((HeapRoot *)al_value(&root_iter))->obj);
+  }
+
+  // Ids are handed out in discovery order, so walking the list in order is a
+  // BFS that writes each object exactly once and in id order.
+  uint32_t i;
+  for (i = 0; i < alist_len(&dump.objects); ++i) {
+    _write_object(&dump, i, *(Object **)alist_get(&dump.objects, i));
+  }
+
+  root_iter = alist_iter((AList *)roots);
+  for (; al_has(&root_iter); al_inc(&root_iter)) {
+    HeapRoot *root = (HeapRoot *)al_value(&root_iter);
+    uint8_t tag = SNAPSHOT_ROOT;
+    uint32_t id = _object_id(&dump, root->obj);
+    uint8_t kind = (uint8_t)root->kind;
+    serialize_type(&dump.buffer, uint8_t, tag);
+    serialize_type(&dump.buffer, uint32_t, id);
+    serialize_type(&dump.buffer, uint8_t, kind);
+    serialize_str(&dump.buffer, root->name);
+  }
+
+  uint8_t tag = SNAPSHOT_END;
+  serialize_type(&dump.buffer, uint8_t, tag);
+  serialize_type(&dump.buffer, uint32_t, stats->num_objects);
+
+  buffer_finalize(&dump.buffer);
+  alist_finalize(&dump.refs);
+  alist_finalize(&dump.objects);
+  map_finalize(&dump.class_ids);
+  map_finalize(&dump.object_ids);
+}
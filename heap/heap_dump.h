@@ -0,0 +1,53 @@
+// heap_dump.h
+//
+// Created on: Oct 18, 2026
+//     Author: Jeff Manzione
+
+#ifndef HEAP_HEAP_DUMP_H_
+#define HEAP_HEAP_DUMP_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "entity/object.h"
+#include "heap/heap.h"
+#include "heap/snapshot.h"
+#include "struct/alist.h"
+
+typedef struct {
+  Object *obj;
+  HeapRootKind kind;
+  const char *name;
+} HeapRoot;
+
+typedef struct {
+  uint32_t num_objects;
+  uint32_t num_refs;
+  uint64_t total_bytes;
+} HeapDumpStats;
+
+// Adds a root to [roots] (an AList of HeapRoot).
+void heap_roots_add(AList *roots, Object *obj, HeapRootKind kind,
+                    const char name[]);
+
+// Writes every object reachable from [roots] to [file] in the snapshot format
+// described in heap/snapshot.h. Edges [heap] recorded with heap_inc_edge() are
+// followed along with members, Array and Tuple slots.
+//
+// All bookkeeping is malloc'd, so the heap being dumped is never allocated on
+// or modified. The caller must prevent concurrent mutation of the heap.
+void heap_dump(Heap *heap, const AList *roots, FILE *file,
+               HeapDumpStats *stats);
+
+// Calls [fn] once for every object reachable from [roots]. Like heap_dump(),
+// it never allocates on the heap being walked.
+void heap_walk(Heap *heap, const AList *roots, void (*fn)(Object *, void *),
+               void *arg);
+
+// Calls [fn] for each object directly referenced by [obj].
+void object_for_each_ref(Object *obj, void (*fn)(Object *, void *), void *arg);
+
+// Approximate number of bytes held by [obj], excluding referenced objects.
+size_t object_shallow_size(const Object *obj);
+
+#endif /* HEAP_HEAP_DUMP_H_ */
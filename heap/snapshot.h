@@ -0,0 +1,46 @@
+// snapshot.h
+//
+// Created on: Oct 18, 2026
+//     Author: Jeff Manzione
+//
+// On-disk layout of a heap snapshot written by heap_dump() and read by jvheap.
+//
+// A snapshot starts with a header followed by a stream of tagged records:
+//
+//   header:  char[4] magic, uint32_t version
+//   CLASS:   uint8_t tag, uint32_t class_id, str class_name, str module_name
+//   OBJECT:  uint8_t tag, uint32_t object_id, uint32_t class_id,
+//            uint32_t shallow_size, uint32_t num_refs, uint32_t[num_refs] ids
+//   ROOT:    uint8_t tag, uint32_t object_id, uint8_t root_kind, str name
+//   END:     uint8_t tag, uint32_t num_objects
+//
+// Strings are NUL-terminated. A CLASS record always precedes the first OBJECT
+// record that references it. Object ids are dense, starting at 0, and are
+// written in increasing order.
+
+#ifndef HEAP_SNAPSHOT_H_
+#define HEAP_SNAPSHOT_H_
+
+#define SNAPSHOT_MAGIC "JVHD"
+#define SNAPSHOT_MAGIC_LEN 4
+#define SNAPSHOT_VERSION 1
+
+typedef enum {
+  SNAPSHOT_CLASS = 'C',
+  SNAPSHOT_OBJECT = 'O',
+  SNAPSHOT_ROOT = 'R',
+  SNAPSHOT_END = 'E',
+} SnapshotTag;
+
+typedef enum {
+  HEAP_ROOT_PROCESS = 0,
+  HEAP_ROOT_MODULE,
+  HEAP_ROOT_TASK_STACK,
+  HEAP_ROOT_TASK_RESVAL,
+  HEAP_ROOT_TASK_CONTEXT,
+  // Passed to heap_make_root() and not already listed as one of the above.
+  HEAP_ROOT_HEAP,
+  HEAP_ROOT__END,
+} HeapRootKind;
+
+#endif /* HEAP_SNAPSHOT_H_ */
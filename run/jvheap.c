@@ -0,0 +1,559 @@
+// jvheap.c
+//
+// Created on: Oct 18, 2026
+//     Author: Jeff Manzione
+//
+// Reads heap snapshots written by heap_dump().
+//
+//   jvheap <snapshot>          Summarizes a snapshot: totals, the largest
+//                              classes and the objects retaining the most.
+//   jvheap <before> <after>    Shows per-class growth between two snapshots.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc/alloc.h"
+#include "alloc/arena/intern.h"
+#include "heap/snapshot.h"
+#include "program/serialization/deserialize.h"
+#include "struct/alist.h"
+#include "struct/map.h"
+#include "struct/struct_defaults.h"
+
+#define MAX_NAME_SZ 1024
+#define TOP_N 20
+#define NO_IDOM UINT32_MAX
+
+typedef struct {
+  const char *name;
+  const char *module;
+} _SnapshotClass;
+
+typedef struct {
+  uint32_t class_id;
+  uint32_t shallow_size;
+  uint32_t refs_start;
+  uint32_t num_refs;
+} _SnapshotObject;
+
+typedef struct {
+  uint32_t id;
+  HeapRootKind kind;
+  const char *name;
+} _SnapshotRoot;
+
+typedef struct {
+  AList classes;  // _SnapshotClass
+  AList objects;  // _SnapshotObject
+  AList refs;     // uint32_t
+  AList roots;    // _SnapshotRoot
+} Snapshot;
+
+typedef struct {
+  const char *name;
+  const char *module;
+  int64_t count[2];
+  int64_t bytes[2];
+} _ClassStats;
+
+static const char *_ROOT_KIND_NAMES[] = {
+    "process", "module", "task-stack", "task-resval", "task-context", "heap"};
+
+const char *_read_str(FILE *file) {
+  char buffer[MAX_NAME_SZ];
+  int i = 0, c;
+  while (EOF != (c = fgetc(file)) && '\0' != c) {
+    if (i < MAX_NAME_SZ - 1) {
+      buffer[i++] = (char)c;
+    }
+  }
+  return intern_range(buffer, 0, i);
+}
+
+bool _read_u32(FILE *file, uint32_t *val) {
+  return sizeof(uint32_t) == deserialize_type(file, uint32_t, val);
+}
+
+// Whether every class, ref and root id names a record in [snapshot], which
+// the analyses below index with unchecked.
+bool _snapshot_ids_valid(const Snapshot *snapshot) {
+  uint32_t num_objects = alist_len(&snapshot->objects);
+  uint32_t i;
+  for (i = 0; i < num_objects; ++i) {
+    const _SnapshotObject *obj =
+        (_SnapshotObject *)alist_get(&snapshot->objects, i);
+    if (obj->class_id >= alist_len(&snapshot->classes)) {
+      return false;
+    }
+  }
+  for (i = 0; i < alist_len(&snapshot->refs); ++i) {
+    if (*(uint32_t *)alist_get(&snapshot->refs, i) >= num_objects) {
+      return false;
+    }
+  }
+  for (i = 0; i < alist_len(&snapshot->roots); ++i) {
+    if (((_SnapshotRoot *)alist_get(&snapshot->roots, i))->id >= num_objects) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool snapshot_read(Snapshot *snapshot, const char fn[]) {
+  alist_init(&snapshot->classes, _SnapshotClass, DEFAULT_ARRAY_SZ);
+  alist_init(&snapshot->objects, _SnapshotObject, DEFAULT_ARRAY_SZ);
+  alist_init(&snapshot->refs, uint32_t, DEFAULT_ARRAY_SZ);
+  alist_init(&snapshot->roots, _SnapshotRoot, DEFAULT_ARRAY_SZ);
+
+  FILE *file = fopen(fn, "rb");
+  if (NULL == file) {
+    fprintf(stderr, "Could not open '%s'.\n", fn);
+    return false;
+  }
+  char magic[SNAPSHOT_MAGIC_LEN];
+  uint32_t version;
+  if (SNAPSHOT_MAGIC_LEN != deserialize_bytes(file, SNAPSHOT_MAGIC_LEN, magic,
+                                              SNAPSHOT_MAGIC_LEN) ||
+      0 != memcmp(magic, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_LEN) ||
+      !_read_u32(file, &version) || SNAPSHOT_VERSION != version) {
+    fprintf(stderr, "'%s' is not a heap snapshot.\n", fn);
+    fclose(file);
+    return false;
+  }
+  bool is_complete = false, is_valid = true;
+  uint8_t tag;
+  while (is_valid && !is_complete &&
+         1 == deserialize_type(file, uint8_t, &tag)) {
+    uint32_t id, i;
+    switch (tag) {
+      case SNAPSHOT_CLASS: {
+        // Classes and objects are written in id order.
+        if (!_read_u32(file, &id) || id != alist_len(&snapshot->classes)) {
+          is_valid = false;
+          break;
+        }
+        _SnapshotClass *class = (_SnapshotClass *)alist_add(&snapshot->classes);
+        class->name = _read_str(file);
+        class->module = _read_str(file);
+        break;
+      }
+      case SNAPSHOT_OBJECT: {
+        if (!_read_u32(file, &id) || id != alist_len(&snapshot->objects)) {
+          is_valid = false;
+          break;
+        }
+        _SnapshotObject *obj = (_SnapshotObject *)alist_add(&snapshot->objects);
+        is_valid = _read_u32(file, &obj->class_id) &&
+                   _read_u32(file, &obj->shallow_size) &&
+                   _read_u32(file, &obj->num_refs);
+        obj->refs_start = alist_len(&snapshot->refs);
+        for (i = 0; is_valid && i < obj->num_refs; ++i) {
+          is_valid = _read_u32(file, (uint32_t *)alist_add(&snapshot->refs));
+        }
+        break;
+      }
+      case SNAPSHOT_ROOT: {
+        _SnapshotRoot *root = (_SnapshotRoot *)alist_add(&snapshot->roots);
+        uint8_t kind;
+        is_valid = _read_u32(file, &root->id) &&
+                   1 == deserialize_type(file, uint8_t, &kind);
+        if (!is_valid) {
+          break;
+        }
+        root->kind = kind < HEAP_ROOT__END ? (HeapRootKind)kind : HEAP_ROOT__END;
+        root->name = _read_str(file);
+        break;
+      }
+      case SNAPSHOT_END:
+        is_valid = _read_u32(file, &id) &&
+                   id == alist_len(&snapshot->objects);
+        is_complete = is_valid;
+        break;
+      default:
+        is_valid = false;
+        break;
+    }
+  }
+  fclose(file);
+  if (is_complete && !_snapshot_ids_valid(snapshot)) {
+    is_valid = false;
+  }
+  if (!is_valid) {
+    fprintf(stderr, "'%s' is corrupt.\n", fn);
+    return false;
+  }
+  if (!is_complete) {
+    fprintf(stderr, "'%s' is truncated.\n", fn);
+  }
+  return is_complete;
+}
+
+void snapshot_finalize(Snapshot *snapshot) {
+  alist_finalize(&snapshot->classes);
+  alist_finalize(&snapshot->objects);
+  alist_finalize(&snapshot->refs);
+  alist_finalize(&snapshot->roots);
+}
+
+_SnapshotObject *_object(const Snapshot *snapshot, uint32_t id) {
+  return (_SnapshotObject *)alist_get(&snapshot->objects, id);
+}
+
+_SnapshotClass *_class(const Snapshot *snapshot, uint32_t id) {
+  return (_SnapshotClass *)alist_get(&snapshot->classes, id);
+}
+
+uint32_t _ref(const Snapshot *snapshot, const _SnapshotObject *obj,
+              uint32_t i) {
+  return *(uint32_t *)alist_get(&snapshot->refs, obj->refs_start + i);
+}
+
+// Node 0 is a synthetic root pointing at every snapshot root; object i is
+// node i + 1.
+uint32_t _num_succ(const Snapshot *snapshot, uint32_t node) {
+  return 0 == node ? alist_len(&snapshot->roots)
+                   : _object(snapshot, node - 1)->num_refs;
+}
+
+uint32_t _succ(const Snapshot *snapshot, uint32_t node, uint32_t i) {
+  if (0 == node) {
+    return ((_SnapshotRoot *)alist_get(&snapshot->roots, i))->id + 1;
+  }
+  return _ref(snapshot, _object(snapshot, node - 1), i) + 1;
+}
+
+// Fills [postorder] with the nodes in DFS postorder and [po_index] with each
+// node's position in it. Returns the number of reachable nodes.
+uint32_t _postorder(const Snapshot *snapshot, uint32_t num_nodes,
+                    uint32_t *postorder, uint32_t *po_index) {
+  uint32_t *stack_node = ALLOC_ARRAY(uint32_t, num_nodes);
+  uint32_t *stack_edge = ALLOC_ARRAY(uint32_t, num_nodes);
+  bool *visited = ALLOC_ARRAY(bool, num_nodes);
+  memset(visited, 0, sizeof(bool) * num_nodes);
+  uint32_t i, sp = 0, count = 0;
+  for (i = 0; i < num_nodes; ++i) {
+    po_index[i] = NO_IDOM;
+  }
+  stack_node[sp] = 0;
+  stack_edge[sp++] = 0;
+  visited[0] = true;
+  while (sp > 0) {
+    uint32_t node = stack_node[sp - 1];
+    if (stack_edge[sp - 1] < _num_succ(snapshot, node)) {
+      uint32_t succ = _succ(snapshot, node, stack_edge[sp - 1]++);
+      if (!visited[succ]) {
+        visited[succ] = true;
+        stack_node[sp] = succ;
+        stack_edge[sp++] = 0;
+      }
+      continue;
+    }
+    po_index[node] = count;
+    postorder[count++] = node;
+    --sp;
+  }
+  DEALLOC(visited);
+  DEALLOC(stack_edge);
+  DEALLOC(stack_node);
+  return count;
+}
+
+uint32_t _intersect(const uint32_t *idom, const uint32_t *po_index,
+                    uint32_t a, uint32_t b) {
+  while (a != b) {
+    while (po_index[a] < po_index[b]) {
+      a = idom[a];
+    }
+    while (po_index[b] < po_index[a]) {
+      b = idom[b];
+    }
+  }
+  return a;
+}
+
+// Computes the immediate dominator of every node using the iterative
+// algorithm from Cooper, Harvey and Kennedy, "A Simple, Fast Dominance
+// Algorithm".
+void _dominators(const Snapshot *snapshot, uint32_t num_nodes, uint32_t *idom,
+                 uint32_t *po_index) {
+  uint32_t *postorder = ALLOC_ARRAY(uint32_t, num_nodes);
+  uint32_t num_reachable = _postorder(snapshot, num_nodes, postorder, po_index);
+
+  // Predecessors in CSR form.
+  uint32_t *pred_start = ALLOC_ARRAY(uint32_t, num_nodes + 1);
+  memset(pred_start, 0, sizeof(uint32_t) * (num_nodes + 1));
+  uint32_t node, i;
+  for (node = 0; node < num_nodes; ++node) {
+    for (i = 0; i < _num_succ(snapshot, node); ++i) {
+      pred_start[_succ(snapshot, node, i) + 1]++;
+    }
+  }
+  for (node = 0; node < num_nodes; ++node) {
+    pred_start[node + 1] += pred_start[node];
+  }
+  uint32_t *pred_fill = ALLOC_ARRAY(uint32_t, num_nodes);
+  memcpy(pred_fill, pred_start, sizeof(uint32_t) * num_nodes);
+  uint32_t *preds = ALLOC_ARRAY(uint32_t, pred_start[num_nodes] + 1);
+  for (node = 0; node < num_nodes; ++node) {
+    for (i = 0; i < _num_succ(snapshot, node); ++i) {
+      preds[pred_fill[_succ(snapshot, node, i)]++] = node;
+    }
+  }
+
+  for (node = 0; node < num_nodes; ++node) {
+    idom[node] = NO_IDOM;
+  }
+  idom[0] = 0;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    // Reverse postorder, skipping the synthetic root.
+    int32_t p;
+    for (p = (int32_t)num_reachable - 2; p >= 0; --p) {
+      node = postorder[p];
+      uint32_t new_idom = NO_IDOM;
+      for (i = pred_start[node]; i < pred_start[node + 1]; ++i) {
+        uint32_t pred = preds[i];
+        if (NO_IDOM == idom[pred]) {
+          continue;
+        }
+        new_idom = (NO_IDOM == new_idom)
+                       ? pred
+                       : _intersect(idom, po_index, pred, new_idom);
+      }
+      if (idom[node] != new_idom) {
+        idom[node] = new_idom;
+        changed = true;
+      }
+    }
+  }
+  DEALLOC(preds);
+  DEALLOC(pred_fill);
+  DEALLOC(pred_start);
+  DEALLOC(postorder);
+}
+
+const char *_root_name(const Snapshot *snapshot, uint32_t id,
+                       const char **kind) {
+  AL_iter roots = alist_iter((AList *)&snapshot->roots);
+  for (; al_has(&roots); al_inc(&roots)) {
+    _SnapshotRoot *root = (_SnapshotRoot *)al_value(&roots);
+    if (root->id == id) {
+      *kind = root->kind < HEAP_ROOT__END ? _ROOT_KIND_NAMES[root->kind] : "?";
+      return root->name;
+    }
+  }
+  *kind = NULL;
+  return NULL;
+}
+
+void _print_retention_path(const Snapshot *snapshot, const uint32_t *idom,
+                           uint32_t node) {
+  printf("      ");
+  while (0 != idom[node]) {
+    _SnapshotClass *class = _class(snapshot, _object(snapshot, node - 1)->class_id);
+    printf("%s <- ", class->name);
+    node = idom[node];
+  }
+  _SnapshotClass *class = _class(snapshot, _object(snapshot, node - 1)->class_id);
+  const char *kind;
+  const char *name = _root_name(snapshot, node - 1, &kind);
+  if (NULL == kind) {
+    printf("%s <- (shared by several roots)\n", class->name);
+  } else {
+    printf("%s <- [%s%s%s]\n", class->name, kind, '\0' == name[0] ? "" : " ",
+           name);
+  }
+}
+
+static const uint64_t *_sort_sizes;
+
+int _by_size_desc(const void *a, const void *b) {
+  uint64_t sa = _sort_sizes[*(const uint32_t *)a];
+  uint64_t sb = _sort_sizes[*(const uint32_t *)b];
+  return sa < sb ? 1 : (sa > sb ? -1 : 0);
+}
+
+int _by_bytes_desc(const void *a, const void *b) {
+  const _ClassStats *ca = (const _ClassStats *)a;
+  const _ClassStats *cb = (const _ClassStats *)b;
+  int64_t da = ca->bytes[1] - ca->bytes[0];
+  int64_t db = cb->bytes[1] - cb->bytes[0];
+  return da < db ? 1 : (da > db ? -1 : 0);
+}
+
+void _sort_class_stats(AList *stats) {
+  if (alist_len(stats) > 0) {
+    qsort(alist_get(stats, 0), alist_len(stats), sizeof(_ClassStats),
+          _by_bytes_desc);
+  }
+}
+
+// Aggregates per-class counts into column [col] of [stats].
+void _add_class_stats(const Snapshot *snapshot, Map *index, AList *stats,
+                      int col) {
+  char key[MAX_NAME_SZ * 2 + 2];
+  AL_iter objs = alist_iter((AList *)&snapshot->objects);
+  for (; al_has(&objs); al_inc(&objs)) {
+    _SnapshotObject *obj = (_SnapshotObject *)al_value(&objs);
+    _SnapshotClass *class = _class(snapshot, obj->class_id);
+    snprintf(key, sizeof(key), "%s.%s", class->module, class->name);
+    const char *k = intern(key);
+    uint32_t pos = (uint32_t)(uintptr_t)map_lookup(index, k);
+    if (0 == pos) {
+      _ClassStats *s = (_ClassStats *)alist_add(stats);
+      memset(s, 0, sizeof(_ClassStats));
+      s->name = class->name;
+      s->module = class->module;
+      pos = alist_len(stats);
+      map_insert(index, k, (void *)(uintptr_t)pos);
+    }
+    _ClassStats *s = (_ClassStats *)alist_get(stats, pos - 1);
+    s->count[col]++;
+    s->bytes[col] += obj->shallow_size;
+  }
+}
+
+void _summarize(const Snapshot *snapshot) {
+  uint32_t num_objects = alist_len(&snapshot->objects);
+  uint32_t num_nodes = num_objects + 1;
+  uint64_t total_bytes = 0;
+  AL_iter objs = alist_iter((AList *)&snapshot->objects);
+  for (; al_has(&objs); al_inc(&objs)) {
+    total_bytes += ((_SnapshotObject *)al_value(&objs))->shallow_size;
+  }
+  printf("%u objects, %u refs, %u roots, %llu bytes\n\n", num_objects,
+         alist_len(&snapshot->refs), alist_len(&snapshot->roots),
+         (unsigned long long)total_bytes);
+
+  Map index;
+  map_init_default(&index);
+  AList stats;
+  alist_init(&stats, _ClassStats, DEFAULT_ARRAY_SZ);
+  _add_class_stats(snapshot, &index, &stats, 1);
+  _sort_class_stats(&stats);
+  printf("Top classes by shallow size:\n");
+  printf("  %12s %10s  %s\n", "bytes", "count", "class");
+  uint32_t i;
+  for (i = 0; i < alist_len(&stats) && i < TOP_N; ++i) {
+    _ClassStats *s = (_ClassStats *)alist_get(&stats, i);
+    printf("  %12lld %10lld  %s.%s\n", (long long)s->bytes[1],
+           (long long)s->count[1], s->module, s->name);
+  }
+  alist_finalize(&stats);
+  map_finalize(&index);
+
+  uint32_t *idom = ALLOC_ARRAY(uint32_t, num_nodes);
+  uint32_t *po_index = ALLOC_ARRAY(uint32_t, num_nodes);
+  _dominators(snapshot, num_nodes, idom, po_index);
+
+  // A node's dominator always finishes later in postorder, so accumulating
+  // in postorder rolls every retained size up into its dominator.
+  uint64_t *retained = ALLOC_ARRAY(uint64_t, num_nodes);
+  uint32_t *order = ALLOC_ARRAY(uint32_t, num_nodes);
+  uint32_t num_reachable = 0, node;
+  retained[0] = 0;
+  for (node = 1; node < num_nodes; ++node) {
+    retained[node] = _object(snapshot, node - 1)->shallow_size;
+  }
+  for (node = 0; node < num_nodes; ++node) {
+    if (NO_IDOM != po_index[node]) {
+      order[po_index[node]] = node;
+      num_reachable++;
+    }
+  }
+  for (i = 0; i + 1 < num_reachable; ++i) {
+    node = order[i];
+    retained[idom[node]] += retained[node];
+  }
+
+  // Rank objects (not the synthetic root) by retained size.
+  uint32_t num_ranked = 0;
+  for (node = 1; node < num_nodes; ++node) {
+    if (NO_IDOM != po_index[node]) {
+      order[num_ranked++] = node;
+    }
+  }
+  _sort_sizes = retained;
+  qsort(order, num_ranked, sizeof(uint32_t), _by_size_desc);
+
+  printf("\nTop retainers:\n");
+  printf("  %12s %10s  %s\n", "retained", "shallow", "object");
+  for (i = 0; i < num_ranked && i < TOP_N; ++i) {
+    node = order[i];
+    _SnapshotObject *obj = _object(snapshot, node - 1);
+    _SnapshotClass *class = _class(snapshot, obj->class_id);
+    printf("  %12llu %10u  %s.%s#%u\n", (unsigned long long)retained[node],
+           obj->shallow_size, class->module, class->name, node - 1);
+    _print_retention_path(snapshot, idom, node);
+  }
+  DEALLOC(order);
+  DEALLOC(retained);
+  DEALLOC(po_index);
+  DEALLOC(idom);
+}
+
+void _diff(const Snapshot *before, const Snapshot *after) {
+  Map index;
+  map_init_default(&index);
+  AList stats;
+  alist_init(&stats, _ClassStats, DEFAULT_ARRAY_SZ);
+  _add_class_stats(before, &index, &stats, 0);
+  _add_class_stats(after, &index, &stats, 1);
+  _sort_class_stats(&stats);
+
+  int64_t total_count = 0, total_bytes = 0;
+  printf("Growth by class:\n");
+  printf("  %12s %10s %12s %10s  %s\n", "+bytes", "+count", "bytes", "count",
+         "class");
+  AL_iter rows = alist_iter(&stats);
+  for (; al_has(&rows); al_inc(&rows)) {
+    _ClassStats *s = (_ClassStats *)al_value(&rows);
+    int64_t dcount = s->count[1] - s->count[0];
+    int64_t dbytes = s->bytes[1] - s->bytes[0];
+    total_count += dcount;
+    total_bytes += dbytes;
+    if (0 == dcount && 0 == dbytes) {
+      continue;
+    }
+    printf("  %+12lld %+10lld %12lld %10lld  %s.%s\n", (long long)dbytes,
+           (long long)dcount, (long long)s->bytes[1], (long long)s->count[1],
+           s->module, s->name);
+  }
+  printf("\nTotal: %+lld bytes, %+lld objects\n", (long long)total_bytes,
+         (long long)total_count);
+  alist_finalize(&stats);
+  map_finalize(&index);
+}
+
+int main(int argc, const char *argv[]) {
+  if (argc < 2 || argc > 3) {
+    fprintf(stderr, "Usage: %s <snapshot> [<later_snapshot>]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  alloc_init();
+  intern_init();
+
+  int status = EXIT_SUCCESS;
+  Snapshot before, after;
+  if (!snapshot_read(&before, argv[1])) {
+    status = EXIT_FAILURE;
+  } else if (2 == argc) {
+    _summarize(&before);
+  } else {
+    if (snapshot_read(&after, argv[2])) {
+      _diff(&before, &after);
+    } else {
+      status = EXIT_FAILURE;
+    }
+    snapshot_finalize(&after);
+  }
+  snapshot_finalize(&before);
+
+  intern_finalize();
+  alloc_finalize();
+  return status;
+}
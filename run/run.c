@@ -59,6 +59,18 @@ void run(const Set *source_files, ArgStore *store) {
       argstore_lookup_string(store, ArgKey__LIB_LOCATION);
 
   VM *vm = vm_create(lib_location);
+  HeapLimits heap_limits = {
+      .max_objects = argstore_lookup_int(store, ArgKey__MAX_HEAP_OBJECTS),
+      .max_bytes = (uint64_t)argstore_lookup_int(store, ArgKey__MAX_HEAP_MB)
+                   << 20};
+  vm_set_heap_limits(vm, &heap_limits);
+  int32_t scheduler_threads =
+      argstore_lookup_int(store, ArgKey__SCHEDULER_THREADS);
+  vm_set_scheduler_threads(vm, scheduler_threads > 0 ? scheduler_threads : 0);
+  int32_t io_threads = argstore_lookup_int(store, ArgKey__IO_THREADS);
+  int32_t cpu_threads = argstore_lookup_int(store, ArgKey__CPU_THREADS);
+  vm_set_background_threads(vm, io_threads > 0 ? io_threads : 1,
+                            cpu_threads > 0 ? cpu_threads : 0);
   ModuleManager *mm = vm_module_manager(vm);
   Module *main_module = NULL;
 
@@ -22,6 +22,11 @@ typedef enum {
   ArgKey__ASSEMBLY_OUT_DIR,
   ArgKey__OPTIMIZE,
   ArgKey__LIB_LOCATION,
+  ArgKey__MAX_HEAP_OBJECTS,
+  ArgKey__MAX_HEAP_MB,
+  ArgKey__SCHEDULER_THREADS,
+  ArgKey__IO_THREADS,
+  ArgKey__CPU_THREADS,
   ArgKey__END,
 } ArgKey;
 
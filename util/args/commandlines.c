@@ -26,4 +26,15 @@ void argconfig_run(ArgConfig *const config) {
   ASSERT(NOT_NULL(config));
   argconfig_add(config, ArgKey__LIB_LOCATION, "lib_location", '\0',
                 arg_string(path_to_libs()));
+  // Per-process heap budgets. 0 means unlimited.
+  argconfig_add(config, ArgKey__MAX_HEAP_OBJECTS, "max_heap_objects", '\0',
+                arg_int(0));
+  argconfig_add(config, ArgKey__MAX_HEAP_MB, "max_heap_mb", '\0', arg_int(0));
+  // Threads shared by all processes but main. 0 means one per processor.
+  argconfig_add(config, ArgKey__SCHEDULER_THREADS, "scheduler_threads", '\0',
+                arg_int(0));
+  // Threads for background natives that block, e.g. on files and sockets.
+  argconfig_add(config, ArgKey__IO_THREADS, "io_threads", '\0', arg_int(6));
+  // Threads for compute-bound background natives. 0 means one per processor.
+  argconfig_add(config, ArgKey__CPU_THREADS, "cpu_threads", '\0', arg_int(0));
 }
\ No newline at end of file
@@ -0,0 +1,246 @@
+// http_parser.c
+//
+// Created on: Oct 18, 2026
+//     Author: Jeff Manzione
+
+#include "util/http_parser.h"
+
+#include <ctype.h>
+#include <string.h>
+
+#define HEAD_END "\r\n\r\n"
+#define HEAD_END_LEN 4
+// Content-Length values with more digits than this are rejected.
+#define MAX_CONTENT_LENGTH_DIGITS 18
+
+static inline HttpSpan _span(const char *data, const char *start,
+                             const char *end) {
+  HttpSpan span;
+  span.start = start - data;
+  span.len = end - start;
+  return span;
+}
+
+static inline bool _is_ows(char c) { return ' ' == c || '\t' == c; }
+
+static bool _span_equals(const char *data, HttpSpan span, const char *str,
+                         size_t len) {
+  if (span.len != len) {
+    return false;
+  }
+  size_t i;
+  for (i = 0; i < len; ++i) {
+    if (tolower((unsigned char)data[span.start + i]) !=
+        tolower((unsigned char)str[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Returns the end of the line starting at [pos], or NULL if it holds a bare
+// '\n' or a '\r' not followed by '\n'. Proxies may split lines differently
+// on those, so they are rejected. [end] is where the blank line ending the
+// head starts.
+static const char *_line_end(const char *pos, const char *end) {
+  for (; pos < end; ++pos) {
+    if ('\n' == *pos) {
+      return NULL;
+    }
+    if ('\r' == *pos) {
+      return '\n' == pos[1] ? pos : NULL;
+    }
+  }
+  return end;
+}
+
+// Parses "METHOD target HTTP/1.x" from [pos] to [end].
+static bool _parse_request_line(const char *data, const char *pos,
+                                const char *end, HttpRequestHead *head) {
+  const char *space = memchr(pos, ' ', end - pos);
+  if (NULL == space || space == pos) {
+    return false;
+  }
+  head->method = _span(data, pos, space);
+  pos = space + 1;
+  space = memchr(pos, ' ', end - pos);
+  if (NULL == space || space == pos) {
+    return false;
+  }
+  head->target = _span(data, pos, space);
+  const char *question = memchr(pos, '?', space - pos);
+  if (NULL == question) {
+    head->path = head->target;
+    head->query = _span(data, space, space);
+  } else {
+    head->path = _span(data, pos, question);
+    head->query = _span(data, question + 1, space);
+  }
+  pos = space + 1;
+  if (end - pos != 8 || 0 != memcmp(pos, "HTTP/1.", 7) ||
+      !isdigit((unsigned char)pos[7])) {
+    return false;
+  }
+  head->version = _span(data, pos, end);
+  // HTTP/1.1 connections are persistent unless the client says otherwise.
+  head->keep_alive = '0' != pos[7];
+  return true;
+}
+
+// Parses "Name: value" from [pos] to [end].
+static bool _parse_header(const char *data, const char *pos, const char *end,
+                          HttpRequestHead *head) {
+  if (head->num_headers >= HTTP_MAX_HEADERS || _is_ows(*pos)) {
+    // Too many, or an obsolete folded line.
+    return false;
+  }
+  const char *colon = memchr(pos, ':', end - pos);
+  if (NULL == colon || colon == pos) {
+    return false;
+  }
+  const char *name_end = colon;
+  const char *name;
+  for (name = pos; name < name_end; ++name) {
+    if (_is_ows(*name)) {
+      return false;
+    }
+  }
+  const char *value = colon + 1;
+  while (value < end && _is_ows(*value)) {
+    ++value;
+  }
+  const char *value_end = end;
+  while (value_end > value && _is_ows(value_end[-1])) {
+    --value_end;
+  }
+  uint32_t i = head->num_headers++;
+  head->header_names[i] = _span(data, pos, name_end);
+  head->header_values[i] = _span(data, value, value_end);
+  return true;
+}
+
+static bool _parse_content_length(const char *data, HttpSpan value,
+                                  size_t *content_length) {
+  if (0 == value.len || value.len > MAX_CONTENT_LENGTH_DIGITS) {
+    return false;
+  }
+  size_t length = 0;
+  uint32_t i;
+  for (i = 0; i < value.len; ++i) {
+    char c = data[value.start + i];
+    if (!isdigit((unsigned char)c)) {
+      return false;
+    }
+    length = length * 10 + (c - '0');
+  }
+  *content_length = length;
+  return true;
+}
+
+// Applies the comma-separated tokens of a Connection header.
+static void _parse_connection(const char *data, HttpSpan value,
+                              HttpRequestHead *head) {
+  const char *pos = data + value.start, *end = pos + value.len;
+  while (pos < end) {
+    const char *comma = memchr(pos, ',', end - pos);
+    const char *token_end = NULL == comma ? end : comma;
+    const char *token = pos;
+    while (token < token_end && _is_ows(*token)) {
+      ++token;
+    }
+    const char *trimmed_end = token_end;
+    while (trimmed_end > token && _is_ows(trimmed_end[-1])) {
+      --trimmed_end;
+    }
+    HttpSpan span = _span(data, token, trimmed_end);
+    if (_span_equals(data, span, "close", 5)) {
+      head->keep_alive = false;
+    } else if (_span_equals(data, span, "keep-alive", 10)) {
+      head->keep_alive = true;
+    }
+    pos = token_end + 1;
+  }
+}
+
+// Parses the complete head from [data] to [end], where the blank line starts.
+static bool _parse_head(const char *data, const char *end,
+                        HttpRequestHead *head) {
+  const char *pos = data;
+  // Clients may send blank lines between pipelined requests.
+  while (end - pos >= 2 && '\r' == pos[0] && '\n' == pos[1]) {
+    pos += 2;
+  }
+  const char *line_end = _line_end(pos, end);
+  if (NULL == line_end || !_parse_request_line(data, pos, line_end, head)) {
+    return false;
+  }
+  head->num_headers = 0;
+  head->content_length = 0;
+  for (pos = line_end + 2; pos < end; pos = line_end + 2) {
+    line_end = _line_end(pos, end);
+    if (NULL == line_end || !_parse_header(data, pos, line_end, head)) {
+      return false;
+    }
+  }
+  bool has_content_length = false;
+  uint32_t i;
+  for (i = 0; i < head->num_headers; ++i) {
+    HttpSpan name = head->header_names[i];
+    HttpSpan value = head->header_values[i];
+    if (_span_equals(data, name, "Content-Length", 14)) {
+      size_t content_length;
+      // Repeats must agree, or the body could be framed differently by a
+      // proxy in front.
+      if (!_parse_content_length(data, value, &content_length) ||
+          (has_content_length && content_length != head->content_length)) {
+        return false;
+      }
+      head->content_length = content_length;
+      has_content_length = true;
+    } else if (_span_equals(data, name, "Transfer-Encoding", 17)) {
+      return false;
+    } else if (_span_equals(data, name, "Connection", 10)) {
+      _parse_connection(data, value, head);
+    }
+  }
+  return true;
+}
+
+void http_parser_init(HttpParser *parser) { parser->scanned = 0; }
+
+HttpParseStatus http_parse_request(HttpParser *parser, const char *data,
+                                   size_t len, HttpRequestHead *head) {
+  // The end of the head may straddle what was scanned before.
+  size_t from =
+      parser->scanned >= HEAD_END_LEN ? parser->scanned - HEAD_END_LEN + 1 : 0;
+  const char *pos = data + from, *end = data + len;
+  while (end - pos >= HEAD_END_LEN &&
+         NULL != (pos = memchr(pos, '\r', end - pos - HEAD_END_LEN + 1))) {
+    if (0 == memcmp(pos, HEAD_END, HEAD_END_LEN)) {
+      // Blank lines before the request line are skipped, not the end.
+      const char *start = data;
+      while (end - start >= 2 && '\r' == start[0] && '\n' == start[1]) {
+        start += 2;
+      }
+      if (pos >= start) {
+        head->head_len = pos + HEAD_END_LEN - data;
+        return _parse_head(data, pos, head) ? HTTP_PARSE_DONE
+                                            : HTTP_PARSE_ERROR;
+      }
+    }
+    ++pos;
+  }
+  parser->scanned = len;
+  return HTTP_PARSE_INCOMPLETE;
+}
+
+int http_request_find_header(const HttpRequestHead *head, const char *data,
+                             const char *name, size_t name_len) {
+  uint32_t i;
+  for (i = 0; i < head->num_headers; ++i) {
+    if (_span_equals(data, head->header_names[i], name, name_len)) {
+      return i;
+    }
+  }
+  return -1;
+}
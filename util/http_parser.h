@@ -0,0 +1,69 @@
+// http_parser.h
+//
+// Created on: Oct 18, 2026
+//     Author: Jeff Manzione
+//
+// Incremental parser for the head of HTTP/1.x requests.
+//
+// Nothing is copied: the parts of a request are spans of the bytes it was
+// parsed from, so they stay valid if those bytes are moved. Chunked request
+// bodies are not supported.
+
+#ifndef UTIL_HTTP_PARSER_H_
+#define UTIL_HTTP_PARSER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Requests with more headers than this are rejected.
+#define HTTP_MAX_HEADERS 64
+
+// [len] bytes from [start] of the request.
+typedef struct {
+  uint32_t start, len;
+} HttpSpan;
+
+typedef struct {
+  HttpSpan method;
+  // The request target, and its parts before and after the '?'.
+  HttpSpan target, path, query;
+  // E.g. "HTTP/1.1".
+  HttpSpan version;
+  HttpSpan header_names[HTTP_MAX_HEADERS];
+  HttpSpan header_values[HTTP_MAX_HEADERS];
+  uint32_t num_headers;
+  // Bytes taken by the request line, the headers and the blank line after
+  // them. The body follows.
+  size_t head_len;
+  size_t content_length;
+  // Whether the client wants the connection kept open after the response.
+  bool keep_alive;
+} HttpRequestHead;
+
+typedef enum {
+  HTTP_PARSE_DONE,
+  HTTP_PARSE_INCOMPLETE,
+  HTTP_PARSE_ERROR,
+} HttpParseStatus;
+
+// Remembers how far a request has been scanned, so bytes that arrive later
+// can be parsed without scanning the earlier ones again.
+typedef struct {
+  size_t scanned;
+} HttpParser;
+
+void http_parser_init(HttpParser *parser);
+
+// Parses the head of the request at the start of [data], which holds [len]
+// bytes. Call again with the same bytes plus any that arrived since while it
+// returns HTTP_PARSE_INCOMPLETE. Fills [head] once it returns
+// HTTP_PARSE_DONE.
+HttpParseStatus http_parse_request(HttpParser *parser, const char *data,
+                                   size_t len, HttpRequestHead *head);
+
+// Returns the index of the header named [name], ignoring case, or -1.
+int http_request_find_header(const HttpRequestHead *head, const char *data,
+                             const char *name, size_t name_len);
+
+#endif /* UTIL_HTTP_PARSER_H_ */
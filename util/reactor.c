@@ -0,0 +1,260 @@
+// reactor.c
+//
+// Created on: Oct 18, 2026
+//     Author: Jeff Manzione
+
+#include "util/reactor.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "util/platform.h"
+
+#if defined(OS_LINUX)
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "alloc/alloc.h"
+#include "debug/debug.h"
+#include "struct/map.h"
+#include "struct/struct_defaults.h"
+#include "util/sync/mutex.h"
+#include "util/sync/thread.h"
+
+#define MAX_EVENTS 64
+
+// Callbacks waiting on one descriptor.
+typedef struct {
+  int fd;
+  ReactorFn read_fn, write_fn;
+  void *read_arg, *write_arg;
+} _Watch;
+
+struct __Reactor {
+  int epoll_fd;
+  // Written to wake the thread up for shutdown.
+  int wake_fd;
+  Mutex lock;
+  // fd + 1 -> _Watch.
+  Map watches;
+  bool is_shutdown;
+  ThreadHandle thread;
+};
+
+static inline void *_fd_key(int fd) { return (void *)(intptr_t)(fd + 1); }
+
+// The descriptor is armed for one firing of whatever is still watched.
+static uint32_t _watch_interest(const _Watch *watch) {
+  return (NULL == watch->read_fn ? 0 : EPOLLIN) |
+         (NULL == watch->write_fn ? 0 : EPOLLOUT) | EPOLLONESHOT;
+}
+
+bool _reactor_arm(Reactor *reactor, int op, const _Watch *watch) {
+  struct epoll_event ev;
+  ev.events = _watch_interest(watch);
+  ev.data.fd = watch->fd;
+  if (0 == epoll_ctl(reactor->epoll_fd, op, watch->fd, &ev)) {
+    return true;
+  }
+  // Closing a descriptor takes it out of the epoll set, so one that was
+  // closed and reopened without being unwatched has to be added again.
+  return EPOLL_CTL_MOD == op && ENOENT == errno &&
+         0 == epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, watch->fd, &ev);
+}
+
+void _reactor_fire(Reactor *reactor, int fd, uint32_t events) {
+  ReactorFn read_fn = NULL, write_fn = NULL;
+  void *read_arg = NULL, *write_arg = NULL;
+  SYNCHRONIZED(reactor->lock, {
+    _Watch *watch = (_Watch *)map_lookup(&reactor->watches, _fd_key(fd));
+    if (NULL != watch) {
+      if (0 != (events & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+        read_fn = watch->read_fn;
+        read_arg = watch->read_arg;
+        watch->read_fn = NULL;
+      }
+      if (0 != (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+        write_fn = watch->write_fn;
+        write_arg = watch->write_arg;
+        watch->write_fn = NULL;
+      }
+      if (NULL != watch->read_fn || NULL != watch->write_fn) {
+        _reactor_arm(reactor, EPOLL_CTL_MOD, watch);
+      }
+    }
+  });
+  // Callbacks may watch again, so call them without the lock.
+  if (NULL != read_fn) {
+    read_fn(read_arg, REACTOR_READ);
+  }
+  if (NULL != write_fn) {
+    write_fn(write_arg, REACTOR_WRITE);
+  }
+}
+
+void *_reactor_run(void *ptr) {
+  Reactor *reactor = (Reactor *)ptr;
+  struct epoll_event events[MAX_EVENTS];
+  for (;;) {
+    int num_events = epoll_wait(reactor->epoll_fd, events, MAX_EVENTS, -1);
+    if (num_events < 0) {
+      if (EINTR == errno) {
+        continue;
+      }
+      ERROR("epoll_wait failed.");
+    }
+    int i;
+    for (i = 0; i < num_events; ++i) {
+      if (events[i].data.fd == reactor->wake_fd) {
+        bool is_shutdown;
+        SYNCHRONIZED(reactor->lock, { is_shutdown = reactor->is_shutdown; });
+        if (is_shutdown) {
+          return NULL;
+        }
+        continue;
+      }
+      _reactor_fire(reactor, events[i].data.fd, events[i].events);
+    }
+  }
+}
+
+Reactor *reactor_create() {
+  int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd < 0) {
+    return NULL;
+  }
+  Reactor *reactor = ALLOC2(Reactor);
+  reactor->epoll_fd = epoll_fd;
+  reactor->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.fd = reactor->wake_fd;
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, reactor->wake_fd, &ev);
+  reactor->lock = mutex_create();
+  map_init_default(&reactor->watches);
+  reactor->is_shutdown = false;
+  reactor->thread = thread_create(AS_VOID_FN(_reactor_run), reactor);
+  return reactor;
+}
+
+void reactor_delete(Reactor *reactor) {
+  ASSERT(NOT_NULL(reactor));
+  SYNCHRONIZED(reactor->lock, { reactor->is_shutdown = true; });
+  uint64_t one = 1;
+  if (write(reactor->wake_fd, &one, sizeof(one)) < 0) {
+    ERROR("Could not wake the reactor.");
+  }
+  thread_join(reactor->thread, INFINITE);
+  M_iter watches = map_iter(&reactor->watches);
+  for (; has(&watches); inc(&watches)) {
+    DEALLOC(value(&watches));
+  }
+  map_finalize(&reactor->watches);
+  mutex_close(reactor->lock);
+  close(reactor->wake_fd);
+  close(reactor->epoll_fd);
+  DEALLOC(reactor);
+}
+
+bool reactor_watch(Reactor *reactor, int fd, ReactorEvent event, ReactorFn fn,
+                   void *arg) {
+  ASSERT(NOT_NULL(reactor), NOT_NULL(fn), fd >= 0);
+  bool is_watched;
+  SYNCHRONIZED(reactor->lock, {
+    _Watch *watch = (_Watch *)map_lookup(&reactor->watches, _fd_key(fd));
+    int op = EPOLL_CTL_MOD;
+    if (NULL == watch) {
+      op = EPOLL_CTL_ADD;
+      watch = ALLOC2(_Watch);
+      watch->fd = fd;
+      watch->read_fn = NULL;
+      watch->write_fn = NULL;
+      map_insert(&reactor->watches, _fd_key(fd), watch);
+    }
+    ReactorFn *watch_fn =
+        REACTOR_READ == event ? &watch->read_fn : &watch->write_fn;
+    void **watch_arg =
+        REACTOR_READ == event ? &watch->read_arg : &watch->write_arg;
+    is_watched = NULL == *watch_fn;
+    if (is_watched) {
+      *watch_fn = fn;
+      *watch_arg = arg;
+      is_watched = _reactor_arm(reactor, op, watch);
+      if (!is_watched) {
+        *watch_fn = NULL;
+      }
+    }
+    if (!is_watched && EPOLL_CTL_ADD == op) {
+      map_remove(&reactor->watches, _fd_key(fd));
+      DEALLOC(watch);
+    }
+  });
+  return is_watched;
+}
+
+void reactor_unwatch(Reactor *reactor, int fd) {
+  ASSERT(NOT_NULL(reactor));
+  _Watch *watch;
+  SYNCHRONIZED(reactor->lock, {
+    watch = (_Watch *)map_lookup(&reactor->watches, _fd_key(fd));
+    if (NULL != watch) {
+      map_remove(&reactor->watches, _fd_key(fd));
+      epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    }
+  });
+  if (NULL == watch) {
+    return;
+  }
+  if (NULL != watch->read_fn) {
+    watch->read_fn(watch->read_arg, 0);
+  }
+  if (NULL != watch->write_fn) {
+    watch->write_fn(watch->write_arg, 0);
+  }
+  DEALLOC(watch);
+}
+
+void reactor_unwatch_event(Reactor *reactor, int fd, ReactorEvent event) {
+  ASSERT(NOT_NULL(reactor));
+  ReactorFn fn = NULL;
+  void *arg = NULL;
+  SYNCHRONIZED(reactor->lock, {
+    _Watch *watch = (_Watch *)map_lookup(&reactor->watches, _fd_key(fd));
+    if (NULL != watch) {
+      ReactorFn *watch_fn =
+          REACTOR_READ == event ? &watch->read_fn : &watch->write_fn;
+      fn = *watch_fn;
+      arg = REACTOR_READ == event ? watch->read_arg : watch->write_arg;
+      *watch_fn = NULL;
+      if (NULL == watch->read_fn && NULL == watch->write_fn) {
+        map_remove(&reactor->watches, _fd_key(fd));
+        epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+        DEALLOC(watch);
+      } else if (NULL != fn) {
+        _reactor_arm(reactor, EPOLL_CTL_MOD, watch);
+      }
+    }
+  });
+  if (NULL != fn) {
+    fn(arg, 0);
+  }
+}
+
+#else
+
+Reactor *reactor_create() { return NULL; }
+
+void reactor_delete(Reactor *reactor) {}
+
+bool reactor_watch(Reactor *reactor, int fd, ReactorEvent event, ReactorFn fn,
+                   void *arg) {
+  return false;
+}
+
+void reactor_unwatch(Reactor *reactor, int fd) {}
+
+void reactor_unwatch_event(Reactor *reactor, int fd, ReactorEvent event) {}
+
+#endif
@@ -0,0 +1,48 @@
+// reactor.h
+//
+// Created on: Oct 18, 2026
+//     Author: Jeff Manzione
+//
+// Tells callers when file descriptors are ready, so no thread has to block on
+// them. Backed by epoll, and unavailable elsewhere.
+//
+// A single thread owned by the reactor waits for readiness and calls the
+// callbacks, so callbacks must be quick and must not block. Each watch fires
+// at most once and must be renewed to hear about the descriptor again.
+
+#ifndef UTIL_REACTOR_H_
+#define UTIL_REACTOR_H_
+
+#include <stdbool.h>
+
+typedef struct __Reactor Reactor;
+
+typedef enum {
+  REACTOR_READ = 1,
+  REACTOR_WRITE = 2,
+} ReactorEvent;
+
+// [event] is the event that was watched for, or 0 if the watch was dropped
+// by reactor_unwatch().
+typedef void (*ReactorFn)(void *arg, int event);
+
+// Returns NULL if there is no reactor on this platform.
+Reactor *reactor_create();
+// Pending watches are dropped without being called.
+void reactor_delete(Reactor *reactor);
+
+// Calls [fn] with [arg] once [fd] is ready for [event], which is one of
+// REACTOR_READ or REACTOR_WRITE. A descriptor may be watched for both at
+// once, but only once for each. Errors and hangups count as ready. Returns
+// false if [fd] is already watched for [event] or cannot be watched, e.g.
+// because it is a regular file.
+bool reactor_watch(Reactor *reactor, int fd, ReactorEvent event, ReactorFn fn,
+                   void *arg);
+// Stops watching [fd], calling its pending callbacks with 0. Must be called
+// before [fd] is closed.
+void reactor_unwatch(Reactor *reactor, int fd);
+// Stops watching [fd] for [event] only, calling its callback with 0 if it has
+// not fired yet. A watch for the other event is left alone.
+void reactor_unwatch_event(Reactor *reactor, int fd, ReactorEvent event);
+
+#endif /* UTIL_REACTOR_H_ */
@@ -5,13 +5,21 @@
 
 #include "socket.h"
 
+#include <errno.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <string.h>
 
 #ifdef OS_LINUX
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
 #include <sys/socket.h>
+#include <sys/sendfile.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include <unistd.h>
 #else
 #include <winsock2.h>
@@ -23,18 +31,87 @@
 #define INVALID_SOCKET 0
 #endif
 
+// Most buffers handed to the kernel in one vectored send.
+#define MAX_SEND_BUFFERS 64
+// Smallest read made into a handle's read-ahead buffer.
+#define MIN_RECEIVE_AHEAD 4096
+// Room made for each read on a datagram socket, which would otherwise
+// truncate the datagram.
+#define MAX_DATAGRAM 65536
+
 struct __Socket {
-  struct sockaddr_in in;
+  // The address it binds or connects to.
+  struct sockaddr_storage addr;
+  int addr_len;
   SOCKET sock;
+  int type;
   bool is_closed;
+  bool is_non_blocking;
 };
 
 struct __SocketHandle {
-  struct sockaddr_in client;
+  struct sockaddr_storage client;
   SOCKET client_sock;
   bool is_closed;
+  bool is_non_blocking;
+  // Each receive then reads one whole datagram.
+  bool is_datagram;
+  // Read ahead but not yet taken, at buffer + buffer_start.
+  char *buffer;
+  size_t buffer_start, buffer_len, buffer_capacity;
 };
 
+void _sockethandle_init(SocketHandle *sh) {
+  sh->is_closed = false;
+  sh->is_non_blocking = false;
+  sh->is_datagram = false;
+  sh->buffer = NULL;
+  sh->buffer_start = 0;
+  sh->buffer_len = 0;
+  sh->buffer_capacity = 0;
+}
+
+bool _set_non_blocking(SOCKET sock, bool non_blocking) {
+#if defined(OS_WINDOWS)
+  u_long mode = non_blocking ? 1 : 0;
+  return 0 == ioctlsocket(sock, FIONBIO, &mode);
+#else
+  int flags = fcntl(sock, F_GETFL, 0);
+  if (flags < 0) {
+    return false;
+  }
+  flags = non_blocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+  return 0 == fcntl(sock, F_SETFL, flags);
+#endif
+}
+
+bool _set_option(SOCKET sock, SocketOption option, int value) {
+  int level = SOL_SOCKET, name;
+  switch (option) {
+  case SOCKET_OPTION_REUSE_ADDR:
+    name = SO_REUSEADDR;
+    break;
+  case SOCKET_OPTION_REUSE_PORT:
+#if defined(SO_REUSEPORT)
+    name = SO_REUSEPORT;
+    break;
+#else
+    return false;
+#endif
+  case SOCKET_OPTION_KEEP_ALIVE:
+    name = SO_KEEPALIVE;
+    break;
+  case SOCKET_OPTION_NO_DELAY:
+    level = IPPROTO_TCP;
+    name = TCP_NODELAY;
+    break;
+  default:
+    return false;
+  }
+  return 0 == setsockopt(sock, level, name, (const char *)&value,
+                         sizeof(value));
+}
+
 void sockets_init() {
 #if defined(OS_WINDOWS)
   WSADATA wsaData;
@@ -48,27 +125,61 @@ void sockets_cleanup() {
 #endif
 }
 
+Socket *_socket_alloc(int type) {
+  Socket *sock = ALLOC2(Socket);
+  memset(&sock->addr, 0, sizeof(sock->addr));
+  sock->addr_len = 0;
+  sock->type = type;
+  sock->is_closed = false;
+  sock->is_non_blocking = false;
+  return sock;
+}
+
 Socket *socket_create(int domain, int type, int protocol, unsigned long host,
                       uint16_t port) {
-  Socket *sock = ALLOC2(Socket);
+  Socket *sock = _socket_alloc(type);
   sock->sock = socket(domain, type, protocol);
-  sock->in.sin_family = domain;
-  sock->in.sin_addr.s_addr = host;
-  sock->in.sin_port = htons(port);
-  sock->is_closed = false;
+  struct sockaddr_in *in = (struct sockaddr_in *)&sock->addr;
+  in->sin_family = domain;
+  in->sin_addr.s_addr = host;
+  in->sin_port = htons(port);
+  sock->addr_len = sizeof(struct sockaddr_in);
   return sock;
 }
 
-bool socket_is_valid(const Socket *socket) {
+Socket *socket_create_unix(int type, const char *path, size_t path_len) {
+  Socket *sock = _socket_alloc(type);
 #if defined(OS_WINDOWS)
-  return socket->sock != INVALID_SOCKET;
+  sock->sock = INVALID_SOCKET;
 #else
-  return socket->sock >= 0;
+  struct sockaddr_un *un = (struct sockaddr_un *)&sock->addr;
+  // Paths are NUL-terminated, abstract names are not.
+  bool is_abstract = path_len > 0 && '\0' == path[0];
+  if (0 == path_len ||
+      path_len + (is_abstract ? 0 : 1) > sizeof(un->sun_path)) {
+    sock->sock = (SOCKET)-1;
+    return sock;
+  }
+  un->sun_family = AF_UNIX;
+  memcpy(un->sun_path, path, path_len);
+  sock->addr_len = offsetof(struct sockaddr_un, sun_path) + path_len +
+                   (is_abstract ? 0 : 1);
+  sock->sock = socket(AF_UNIX, type, 0);
 #endif
+  return sock;
+}
+
+bool socket_is_valid(const Socket *socket) {
+  return socket->sock != INVALID_SOCKET && socket->sock != (SOCKET)-1;
+}
+
+bool socket_is_datagram(const Socket *socket) {
+  return SOCK_DGRAM == socket->type;
 }
 
 SocketStatus socket_bind(Socket *socket) {
-  return bind(socket->sock, (struct sockaddr *)&socket->in, sizeof(socket->in));
+  return bind(socket->sock, (struct sockaddr *)&socket->addr,
+              socket->addr_len);
 }
 
 SocketStatus socket_listen(Socket *socket, int num_connections) {
@@ -77,7 +188,7 @@ SocketStatus socket_listen(Socket *socket, int num_connections) {
 
 SocketHandle *socket_accept(Socket *socket) {
   SocketHandle *sh = ALLOC2(SocketHandle);
-  sh->is_closed = false;
+  _sockethandle_init(sh);
   int addr_len = sizeof(sh->client);
   sh->client_sock = accept(socket->sock, (struct sockaddr *)&sh->client,
 #ifdef OS_LINUX
@@ -89,10 +200,38 @@ SocketHandle *socket_accept(Socket *socket) {
 
 SocketHandle *socket_connect(Socket *socket) {
   SocketHandle *sh = ALLOC2(SocketHandle);
-  sh->is_closed = false;
-  connect(socket->sock, (struct sockaddr *)&socket->in, sizeof(socket->in));
+  _sockethandle_init(sh);
+  connect(socket->sock, (struct sockaddr *)&socket->addr, socket->addr_len);
   sh->client_sock = socket->sock;
+  // Shares the socket's descriptor, and so its mode.
+  sh->is_non_blocking = socket->is_non_blocking;
+  sh->is_datagram = socket_is_datagram(socket);
+  return sh;
+}
+
+SocketHandle *socket_receiver(Socket *socket) {
+#if defined(OS_WINDOWS)
+  return sockethandle_create(INVALID_SOCKET);
+#else
+  SocketHandle *sh = sockethandle_create(dup(socket->sock));
+  // The duplicate shares the socket's mode.
+  sh->is_non_blocking = socket->is_non_blocking;
   return sh;
+#endif
+}
+
+bool socket_pair(int type, SocketHandle **first, SocketHandle **second) {
+#if defined(OS_WINDOWS)
+  return false;
+#else
+  int fds[2];
+  if (0 != socketpair(AF_UNIX, type, 0, fds)) {
+    return false;
+  }
+  *first = sockethandle_create(fds[0]);
+  *second = sockethandle_create(fds[1]);
+  return true;
+#endif
 }
 
 void socket_close(Socket *socket) {
@@ -111,6 +250,39 @@ void socket_delete(Socket *socket) {
   DEALLOC(socket);
 }
 
+SOCKET socket_get_socket(Socket *socket) { return socket->sock; }
+
+bool socket_set_non_blocking(Socket *socket, bool non_blocking) {
+  if (!_set_non_blocking(socket->sock, non_blocking)) {
+    return false;
+  }
+  socket->is_non_blocking = non_blocking;
+  return true;
+}
+
+bool socket_is_non_blocking(const Socket *socket) {
+  return socket->is_non_blocking;
+}
+
+bool socket_set_option(Socket *socket, SocketOption option, int value) {
+  return _set_option(socket->sock, option, value);
+}
+
+SocketHandle *sockethandle_create(SOCKET sock) {
+  SocketHandle *sh = ALLOC2(SocketHandle);
+  _sockethandle_init(sh);
+  memset(&sh->client, 0, sizeof(sh->client));
+  sh->client_sock = sock;
+#if !defined(OS_WINDOWS)
+  int type;
+  socklen_t type_len = sizeof(type);
+  if (0 == getsockopt(sock, SOL_SOCKET, SO_TYPE, &type, &type_len)) {
+    sh->is_datagram = SOCK_DGRAM == type;
+  }
+#endif
+  return sh;
+}
+
 bool sockethandle_is_valid(const SocketHandle *sh) {
   return sh->client_sock != INVALID_SOCKET && sh->client_sock != -1;
 }
@@ -120,12 +292,208 @@ int32_t sockethandle_send(SocketHandle *sh, const char *const msg,
   return send(sh->client_sock, msg, msg_len, 0);
 }
 
+int64_t sockethandle_send_buffers(SocketHandle *sh, const SocketBuffer *bufs,
+                                  int num_bufs) {
+  if (num_bufs > MAX_SEND_BUFFERS) {
+    num_bufs = MAX_SEND_BUFFERS;
+  }
+  int i;
+#if defined(OS_WINDOWS)
+  WSABUF wsa_bufs[MAX_SEND_BUFFERS];
+  for (i = 0; i < num_bufs; ++i) {
+    wsa_bufs[i].buf = (char *)bufs[i].data;
+    wsa_bufs[i].len = (ULONG)bufs[i].len;
+  }
+  DWORD sent;
+  if (0 != WSASend(sh->client_sock, wsa_bufs, num_bufs, &sent, 0, NULL, NULL)) {
+    return -1;
+  }
+  return sent;
+#else
+  struct iovec iov[MAX_SEND_BUFFERS];
+  for (i = 0; i < num_bufs; ++i) {
+    iov[i].iov_base = (void *)bufs[i].data;
+    iov[i].iov_len = bufs[i].len;
+  }
+  return writev(sh->client_sock, iov, num_bufs);
+#endif
+}
+
 int32_t sockethandle_receive(SocketHandle *sh, char *buf, int buf_len) {
   return recv(sh->client_sock, buf, buf_len, 0);
 }
 
+int64_t sockethandle_send_file(SocketHandle *sh, int fd, int64_t offset,
+                               size_t len) {
+#if defined(OS_LINUX)
+  off_t file_offset = offset;
+  return sendfile(sh->client_sock, fd, &file_offset, len);
+#else
+  return -1;
+#endif
+}
+
+int32_t sockethandle_receive_ahead(SocketHandle *sh, size_t min_len) {
+  size_t min_read = sh->is_datagram ? MAX_DATAGRAM : MIN_RECEIVE_AHEAD;
+  if (min_len < min_read) {
+    min_len = min_read;
+  }
+  if (sh->buffer_start + sh->buffer_len + min_len > sh->buffer_capacity) {
+    // Reclaim the space already taken before growing.
+    if (sh->buffer_start > 0) {
+      memmove(sh->buffer, sh->buffer + sh->buffer_start, sh->buffer_len);
+      sh->buffer_start = 0;
+    }
+    if (sh->buffer_len + min_len > sh->buffer_capacity) {
+      size_t capacity = sh->buffer_capacity * 2;
+      if (capacity < sh->buffer_len + min_len) {
+        capacity = sh->buffer_len + min_len;
+      }
+      sh->buffer = NULL == sh->buffer ? ALLOC_ARRAY(char, capacity)
+                                      : REALLOC(sh->buffer, char, capacity);
+      sh->buffer_capacity = capacity;
+    }
+  }
+  size_t room = sh->buffer_capacity - sh->buffer_start - sh->buffer_len;
+  if (room > INT32_MAX) {
+    room = INT32_MAX;
+  }
+  int32_t received = recv(sh->client_sock,
+                          sh->buffer + sh->buffer_start + sh->buffer_len,
+                          (int)room, 0);
+  if (received > 0) {
+    sh->buffer_len += received;
+  }
+  return received;
+}
+
+size_t sockethandle_peek(const SocketHandle *sh, const char **data) {
+  *data = NULL == sh->buffer ? NULL : sh->buffer + sh->buffer_start;
+  return sh->buffer_len;
+}
+
+void sockethandle_take(SocketHandle *sh, size_t len) {
+  if (len >= sh->buffer_len) {
+    sh->buffer_start = 0;
+    sh->buffer_len = 0;
+    return;
+  }
+  sh->buffer_start += len;
+  sh->buffer_len -= len;
+}
+
+int32_t sockethandle_send_fd(SocketHandle *sh, int fd) {
+#if defined(OS_WINDOWS)
+  return -1;
+#else
+  // The descriptor rides on a single byte.
+  char byte = 0;
+  struct iovec iov;
+  iov.iov_base = &byte;
+  iov.iov_len = 1;
+  union {
+    struct cmsghdr header;
+    char buf[CMSG_SPACE(sizeof(int))];
+  } control;
+  memset(&control, 0, sizeof(control));
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+  return sendmsg(sh->client_sock, &msg, 0);
+#endif
+}
+
+int32_t sockethandle_receive_fd(SocketHandle *sh, int *fd) {
+  *fd = -1;
+#if defined(OS_WINDOWS)
+  return -1;
+#else
+  char byte;
+  struct iovec iov;
+  iov.iov_base = &byte;
+  iov.iov_len = 1;
+  union {
+    struct cmsghdr header;
+    char buf[CMSG_SPACE(sizeof(int))];
+  } control;
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+  int32_t received = recvmsg(sh->client_sock, &msg, MSG_CMSG_CLOEXEC);
+  if (received <= 0) {
+    return received;
+  }
+  // Only the first descriptor is kept. Any others the peer sent are closed
+  // rather than leaked into this process.
+  struct cmsghdr *cmsg;
+  for (cmsg = CMSG_FIRSTHDR(&msg); NULL != cmsg;
+       cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (SOL_SOCKET != cmsg->cmsg_level || SCM_RIGHTS != cmsg->cmsg_type) {
+      continue;
+    }
+    size_t num_fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    for (size_t i = 0; i < num_fds; ++i) {
+      int received_fd;
+      memcpy(&received_fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+      if (*fd < 0) {
+        *fd = received_fd;
+      } else {
+        close(received_fd);
+      }
+    }
+  }
+  // Descriptors that did not fit were dropped by the kernel, so what the peer
+  // meant to pass is incomplete.
+  if (msg.msg_flags & MSG_CTRUNC) {
+    if (*fd >= 0) {
+      close(*fd);
+      *fd = -1;
+    }
+    errno = EMSGSIZE;
+    return -1;
+  }
+  return received;
+#endif
+}
+
 SOCKET sockethandle_get_socket(SocketHandle *sh) { return sh->client_sock; }
 
+SOCKET sockethandle_detach(SocketHandle *sh) {
+  // Marked closed so deleting the handle leaves the descriptor open.
+  sh->is_closed = true;
+  return sh->client_sock;
+}
+
+bool sockethandle_set_non_blocking(SocketHandle *sh, bool non_blocking) {
+  if (!_set_non_blocking(sh->client_sock, non_blocking)) {
+    return false;
+  }
+  sh->is_non_blocking = non_blocking;
+  return true;
+}
+
+bool sockethandle_is_non_blocking(const SocketHandle *sh) {
+  return sh->is_non_blocking;
+}
+
+bool sockethandle_set_option(SocketHandle *sh, SocketOption option,
+                             int value) {
+  return _set_option(sh->client_sock, option, value);
+}
+
+bool sockethandle_is_closed(const SocketHandle *sh) { return sh->is_closed; }
+
 void sockethandle_close(SocketHandle *sh) {
   sh->is_closed = true;
 #ifdef OS_WINDOWS
@@ -139,6 +507,9 @@ void sockethandle_delete(SocketHandle *sh) {
   if (!sh->is_closed) {
     sockethandle_close(sh);
   }
+  if (NULL != sh->buffer) {
+    DEALLOC(sh->buffer);
+  }
   DEALLOC(sh);
 }
 
@@ -147,4 +518,20 @@ unsigned long socket_inet_address(const char *host, size_t host_len) {
   unsigned long addr = inet_addr(host_str);
   free(host_str);
   return addr;
-}
\ No newline at end of file
+}
+
+bool socket_was_interrupted() {
+#if defined(OS_WINDOWS)
+  return WSAEINTR == WSAGetLastError();
+#else
+  return EINTR == errno;
+#endif
+}
+
+bool socket_would_block() {
+#if defined(OS_WINDOWS)
+  return WSAEWOULDBLOCK == WSAGetLastError();
+#else
+  return EAGAIN == errno || EWOULDBLOCK == errno;
+#endif
+}
@@ -18,6 +18,10 @@ typedef uint32_t SOCKET;
 
 typedef unsigned long ulong;
 
+// AF_UNIX and SOCK_STREAM, the same on every platform that has them.
+#define SOCKET_DOMAIN_UNIX 1
+#define SOCKET_TYPE_STREAM 1
+
 typedef struct __Socket Socket;
 typedef struct __SocketAddress SocketAddress;
 
@@ -25,33 +29,121 @@ typedef int SocketStatus;
 
 typedef struct __SocketHandle SocketHandle;
 
+// Options settable on sockets and handles. Accepted handles inherit those of
+// the listening socket.
+typedef enum {
+  SOCKET_OPTION_REUSE_ADDR,
+  // Lets several sockets bind the same address and port, with the kernel
+  // spreading incoming connections between them. Set before binding.
+  SOCKET_OPTION_REUSE_PORT,
+  SOCKET_OPTION_KEEP_ALIVE,
+  // Disables Nagle's algorithm, so small writes go out right away.
+  SOCKET_OPTION_NO_DELAY,
+} SocketOption;
+
+// One piece of a vectored send.
+typedef struct {
+  const char *data;
+  size_t len;
+} SocketBuffer;
+
 void sockets_init();
 
 void sockets_cleanup();
 
 Socket *socket_create(int domain, int type, int protocol, unsigned long host,
                       uint16_t port);
+// A Unix domain socket of [type] (SOCK_STREAM or SOCK_DGRAM) for the [path_len]
+// bytes at [path]. A [path] starting with '\0' is a name in the abstract
+// namespace, which leaves nothing in the filesystem. Invalid if the path is
+// too long or Unix domain sockets are not supported here.
+Socket *socket_create_unix(int type, const char *path, size_t path_len);
 
 bool socket_is_valid(const Socket *socket);
+bool socket_is_datagram(const Socket *socket);
 
 SocketStatus socket_bind(Socket *socket);
 
 SocketStatus socket_listen(Socket *socket, int num_connections);
 
+// On a non-blocking socket, the handle is invalid and socket_would_block() is
+// true if no connection is waiting.
 SocketHandle *socket_accept(Socket *socket);
 SocketHandle *socket_connect(Socket *socket);
+// A handle on a duplicate of the bound [socket]'s descriptor, used to receive
+// on datagram sockets, which accept no connections.
+SocketHandle *socket_receiver(Socket *socket);
+// Creates a pair of connected Unix domain sockets of [type]. Returns false on
+// failure or where unsupported.
+bool socket_pair(int type, SocketHandle **first, SocketHandle **second);
 
 void socket_close(Socket *socket);
 
 void socket_delete(Socket *socket);
 
+SOCKET socket_get_socket(Socket *socket);
+
+// Non-blocking sockets fail with socket_would_block() instead of waiting.
+// Returns false if the mode could not be changed.
+bool socket_set_non_blocking(Socket *socket, bool non_blocking);
+bool socket_is_non_blocking(const Socket *socket);
+
+// Returns false if [option] could not be set or is not supported here.
+bool socket_set_option(Socket *socket, SocketOption option, int value);
+
+// Takes ownership of the connected socket [sock].
+SocketHandle *sockethandle_create(SOCKET sock);
+
 bool sockethandle_is_valid(const SocketHandle *sh);
 
 SocketStatus sockethandle_send(SocketHandle *sh, const char *const msg,
                                int msg_len);
+// Sends as much of [bufs] as the socket takes in one call. Returns the number
+// of bytes sent, or -1 on failure.
+int64_t sockethandle_send_buffers(SocketHandle *sh, const SocketBuffer *bufs,
+                                  int num_bufs);
 int32_t sockethandle_receive(SocketHandle *sh, char *buf, int buf_len);
 
+// Framed reads receive ahead into a buffer kept by the handle, which grows as
+// needed. Anything read ahead must be taken before receiving from the socket
+// again.
+//
+// Receives whatever the socket has into the buffer, first making room for at
+// least [min_len] more bytes. Returns the number of bytes received, 0 once
+// the peer has closed the connection, or -1 on failure.
+int32_t sockethandle_receive_ahead(SocketHandle *sh, size_t min_len);
+// Points [data] at the bytes read ahead and returns how many there are.
+size_t sockethandle_peek(const SocketHandle *sh, const char **data);
+// Drops the first [len] bytes read ahead.
+void sockethandle_take(SocketHandle *sh, size_t len);
+// Sends up to [len] bytes of the file [fd] from [offset] without copying them
+// through user space. Returns the number of bytes sent, or -1 on failure or
+// where unsupported.
+int64_t sockethandle_send_file(SocketHandle *sh, int fd, int64_t offset,
+                               size_t len);
+
+// Passes a duplicate of the descriptor [fd] over a Unix domain socket with
+// SCM_RIGHTS, along with one byte. Returns the number of bytes sent, or -1 on
+// failure or where unsupported.
+int32_t sockethandle_send_fd(SocketHandle *sh, int fd);
+// Receives a descriptor passed by sockethandle_send_fd() into [fd], which is
+// -1 if the byte came without one. Returns like sockethandle_receive(), and
+// fails if more descriptors came than fit. Must not be mixed with other
+// receives on the same handle, since they would drop the descriptors that
+// come with the bytes they read.
+int32_t sockethandle_receive_fd(SocketHandle *sh, int *fd);
+
 SOCKET sockethandle_get_socket(SocketHandle *sh);
+// Gives up ownership of the descriptor, which stays open when the handle is
+// deleted. Callers should check sockethandle_peek() first, since anything
+// read ahead is lost.
+SOCKET sockethandle_detach(SocketHandle *sh);
+
+bool sockethandle_set_non_blocking(SocketHandle *sh, bool non_blocking);
+bool sockethandle_is_non_blocking(const SocketHandle *sh);
+bool sockethandle_set_option(SocketHandle *sh, SocketOption option,
+                             int value);
+bool sockethandle_is_closed(const SocketHandle *sh);
 
 void sockethandle_close(SocketHandle *sh);
 
@@ -59,4 +151,11 @@ void sockethandle_delete(SocketHandle *sh);
 
 unsigned long socket_inet_address(const char *host, size_t host_len);
 
+// Whether the last failed socket call was interrupted, e.g. by
+// thread_interrupt(), instead of failing outright.
+bool socket_was_interrupted();
+// Whether the last failed call on a non-blocking socket would have had to
+// wait.
+bool socket_would_block();
+
 #endif /* UTIL_SOCKET_H_ */
\ No newline at end of file
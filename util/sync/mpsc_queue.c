@@ -0,0 +1,61 @@
+// mpsc_queue.c
+//
+// Created on: Oct 18, 2026
+//     Author: Jeff Manzione
+
+#include "util/sync/mpsc_queue.h"
+
+void mpsc_queue_init(MpscQueue *queue) {
+  atomic_init(&queue->stub.next, NULL);
+  atomic_init(&queue->head, &queue->stub);
+  queue->tail = &queue->stub;
+  atomic_init(&queue->size, 0);
+}
+
+void _mpsc_queue_link(MpscQueue *queue, MpscNode *node) {
+  atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+  MpscNode *prev =
+      atomic_exchange_explicit(&queue->head, node, memory_order_acq_rel);
+  // Until this store the consumer cannot see [node] or anything after it.
+  atomic_store_explicit(&prev->next, node, memory_order_release);
+}
+
+void mpsc_queue_push(MpscQueue *queue, MpscNode *node) {
+  atomic_fetch_add(&queue->size, 1);
+  _mpsc_queue_link(queue, node);
+}
+
+MpscNode *mpsc_queue_pop(MpscQueue *queue) {
+  MpscNode *tail = queue->tail;
+  MpscNode *next = atomic_load_explicit(&tail->next, memory_order_acquire);
+  if (&queue->stub == tail) {
+    if (NULL == next) {
+      return NULL;
+    }
+    queue->tail = next;
+    tail = next;
+    next = atomic_load_explicit(&next->next, memory_order_acquire);
+  }
+  if (NULL != next) {
+    queue->tail = next;
+    atomic_fetch_sub(&queue->size, 1);
+    return tail;
+  }
+  if (atomic_load_explicit(&queue->head, memory_order_acquire) != tail) {
+    // A producer is between swapping head and linking its node.
+    return NULL;
+  }
+  // [tail] is the last node. Put the stub behind it so it can be unlinked.
+  _mpsc_queue_link(queue, &queue->stub);
+  next = atomic_load_explicit(&tail->next, memory_order_acquire);
+  if (NULL != next) {
+    queue->tail = next;
+    atomic_fetch_sub(&queue->size, 1);
+    return tail;
+  }
+  return NULL;
+}
+
+bool mpsc_queue_is_empty(MpscQueue *queue) {
+  return 0 == atomic_load(&queue->size);
+}
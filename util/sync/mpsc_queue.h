@@ -0,0 +1,47 @@
+// mpsc_queue.h
+//
+// Created on: Oct 18, 2026
+//     Author: Jeff Manzione
+//
+// Lock-free intrusive queue with many producers and a single consumer.
+//
+// Items embed an MpscNode. Any thread may push, but only one thread at a time
+// may pop. A push that is still in progress may briefly hide the items behind
+// it from mpsc_queue_pop() even though mpsc_queue_is_empty() is false.
+
+#ifndef UTIL_SYNC_MPSC_QUEUE_H_
+#define UTIL_SYNC_MPSC_QUEUE_H_
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct __MpscNode MpscNode;
+
+struct __MpscNode {
+  MpscNode *_Atomic next;
+};
+
+typedef struct {
+  // Most recently pushed node. Written by producers.
+  MpscNode *_Atomic head;
+  // Next node to pop. Only touched by the consumer.
+  MpscNode *tail;
+  MpscNode stub;
+  atomic_uint_fast32_t size;
+} MpscQueue;
+
+// Gets the item containing [node].
+#define MPSC_ITEM(node, type, field)                                           \
+  ((type *)((char *)(node)-offsetof(type, field)))
+
+void mpsc_queue_init(MpscQueue *queue);
+// Safe to call from any thread.
+void mpsc_queue_push(MpscQueue *queue, MpscNode *node);
+// Returns NULL if no item is ready. Must only be called by the consumer.
+MpscNode *mpsc_queue_pop(MpscQueue *queue);
+// Safe to call from any thread.
+bool mpsc_queue_is_empty(MpscQueue *queue);
+
+#endif /* UTIL_SYNC_MPSC_QUEUE_H_ */
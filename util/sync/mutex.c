@@ -12,17 +12,30 @@
 #ifdef OS_WINDOWS
 #include <process.h>
 #include <windows.h>
+#else
+#include <time.h>
 #endif
 
 #include "alloc/alloc.h"
 #include "debug/debug.h"
 
+#if !defined(OS_WINDOWS)
+struct __Mutex {
+  pthread_mutex_t mutex;
+  // Only written while the mutex is held.
+  uint64_t acquisitions;
+  uint64_t contentions;
+};
+#endif
+
 inline Mutex mutex_create() {
 #ifdef OS_WINDOWS
   return CreateMutex(NULL, false, NULL);
 #else
-  Mutex mutex = ALLOC2(pthread_mutex_t);
-  pthread_mutex_init(mutex, NULL);
+  Mutex mutex = ALLOC2(struct __Mutex);
+  pthread_mutex_init(&mutex->mutex, NULL);
+  mutex->acquisitions = 0;
+  mutex->contentions = 0;
   return mutex;
 #endif
 }
@@ -31,7 +44,20 @@ inline WaitStatus mutex_lock(Mutex mutex) {
 #ifdef OS_WINDOWS
   return WaitForSingleObject(mutex, INFINITE);
 #else
-  return pthread_mutex_lock(mutex);
+  // Try first so that waits can be counted.
+  bool is_contended = false;
+  WaitStatus status = pthread_mutex_trylock(&mutex->mutex);
+  if (0 != status) {
+    is_contended = true;
+    status = pthread_mutex_lock(&mutex->mutex);
+  }
+  if (0 == status) {
+    mutex->acquisitions++;
+    if (is_contended) {
+      mutex->contentions++;
+    }
+  }
+  return status;
 #endif
 }
 
@@ -39,7 +65,7 @@ inline void mutex_unlock(Mutex mutex) {
 #ifdef OS_WINDOWS
   ReleaseMutex(mutex);
 #else
-  pthread_mutex_unlock(mutex);
+  pthread_mutex_unlock(&mutex->mutex);
 #endif
 }
 
@@ -47,11 +73,21 @@ inline void mutex_close(Mutex mutex) {
 #ifdef OS_WINDOWS
   CloseHandle(mutex);
 #else
-  pthread_mutex_destroy(mutex);
+  pthread_mutex_destroy(&mutex->mutex);
   DEALLOC(mutex);
 #endif
 }
 
+LockStats mutex_stats(Mutex mutex) {
+  LockStats stats = {.acquisitions = 0, .contentions = 0};
+#if !defined(OS_WINDOWS)
+  // Read without the lock, so the counts may be slightly stale.
+  stats.acquisitions = mutex->acquisitions;
+  stats.contentions = mutex->contentions;
+#endif
+  return stats;
+}
+
 struct __Condition {
 #if !defined(OS_WINDOWS)
   pthread_cond_t cond;
@@ -65,7 +101,14 @@ inline Condition *mutex_condition(Mutex mutex) {
 #ifdef OS_WINDOWS
   ERROR("Unimplemented.");
 #else
-  pthread_cond_init(&cond->cond, NULL);
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+#if defined(OS_LINUX)
+  // So timed waits are not thrown off by changes to the wall clock.
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+#endif
+  pthread_cond_init(&cond->cond, &attr);
+  pthread_condattr_destroy(&attr);
 #endif
   return cond;
 }
@@ -87,10 +130,41 @@ inline void mutex_condition_broadcast(Condition *cond) {
 #endif
 }
 
+inline void mutex_condition_signal(Condition *cond) {
+#ifdef OS_WINDOWS
+  ERROR("Unimplemented.");
+#else
+  pthread_cond_signal(&cond->cond);
+#endif
+}
+
 inline void mutex_condition_wait(Condition *cond) {
 #ifdef OS_WINDOWS
   ERROR("Unimplemented.");
 #else
-  pthread_cond_wait(&cond->cond, cond->mutex);
+  pthread_cond_wait(&cond->cond, &cond->mutex->mutex);
+  // Waking reacquires the mutex.
+  cond->mutex->acquisitions++;
+#endif
+}
+
+void mutex_condition_wait_timed(Condition *cond, uint64_t duration_ms) {
+#ifdef OS_WINDOWS
+  ERROR("Unimplemented.");
+#else
+  struct timespec deadline;
+#if defined(OS_LINUX)
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+#else
+  clock_gettime(CLOCK_REALTIME, &deadline);
+#endif
+  deadline.tv_sec += duration_ms / 1000;
+  deadline.tv_nsec += (long)(duration_ms % 1000) * 1000000;
+  if (deadline.tv_nsec >= 1000000000) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000;
+  }
+  pthread_cond_timedwait(&cond->cond, &cond->mutex->mutex, &deadline);
+  cond->mutex->acquisitions++;
 #endif
 }
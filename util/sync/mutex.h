@@ -6,6 +6,8 @@
 #ifndef UTIL_SYNC_MUTEX_H_
 #define UTIL_SYNC_MUTEX_H_
 
+#include <stdint.h>
+
 #include "util/platform.h"
 #include "util/sync/constants.h"
 
@@ -15,9 +17,15 @@ typedef struct __Condition Condition;
 typedef void *Mutex;
 #else
 #include <pthread.h>
-typedef pthread_mutex_t *Mutex;
+typedef struct __Mutex *Mutex;
 #endif
 
+// How often a Mutex was taken and how often a caller had to wait for it.
+typedef struct {
+  uint64_t acquisitions;
+  uint64_t contentions;
+} LockStats;
+
 #define SYNCHRONIZED(mutex, block)                                             \
   {                                                                            \
     mutex_lock(mutex);                                                         \
@@ -29,10 +37,16 @@ Mutex mutex_create();
 WaitStatus mutex_lock(Mutex mutex);
 void mutex_unlock(Mutex mutex);
 void mutex_close(Mutex mutex);
+// Not tracked on Windows, where the counts are always 0.
+LockStats mutex_stats(Mutex mutex);
 
 Condition *mutex_condition(Mutex mutex);
 void mutex_condition_delete(Condition *cond);
 void mutex_condition_broadcast(Condition *cond);
+void mutex_condition_signal(Condition *cond);
 void mutex_condition_wait(Condition *cond);
+// Waits at most [duration_ms], measured on the monotonic clock where there is
+// one.
+void mutex_condition_wait_timed(Condition *cond, uint64_t duration_ms);
 
 #endif /* UTIL_SYNC_MUTEX_H_ */
\ No newline at end of file
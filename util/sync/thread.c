@@ -10,6 +10,27 @@
 #ifdef OS_WINDOWS
 #include <process.h>
 #include <windows.h>
+#else
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+#ifndef OS_WINDOWS
+// Sent by thread_interrupt(). Installed without SA_RESTART so blocking calls
+// fail with EINTR instead of being resumed.
+#define INTERRUPT_SIGNAL SIGUSR2
+
+static pthread_once_t _interrupt_handler_once = PTHREAD_ONCE_INIT;
+
+void _on_interrupt(int signal) {}
+
+void _install_interrupt_handler() {
+  struct sigaction action;
+  action.sa_handler = _on_interrupt;
+  action.sa_flags = 0;
+  sigemptyset(&action.sa_mask);
+  sigaction(INTERRUPT_SIGNAL, &action, NULL);
+}
 #endif
 
 ThreadHandle thread_create(VoidFn fn, void *arg) {
@@ -38,3 +59,37 @@ void thread_close(ThreadHandle thread) {
   pthread_cancel(thread);
 #endif
 }
+
+unsigned int thread_num_processors() {
+#ifdef OS_WINDOWS
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+#else
+  long num_processors = sysconf(_SC_NPROCESSORS_ONLN);
+  return num_processors > 0 ? (unsigned int)num_processors : 1;
+#endif
+}
+
+ThreadHandle thread_self() {
+#ifdef OS_WINDOWS
+  // A handle from GetCurrentThread() only means the current thread, so use
+  // the id instead.
+  return GetCurrentThreadId();
+#else
+  return pthread_self();
+#endif
+}
+
+void thread_interrupt(ThreadHandle thread) {
+#ifdef OS_WINDOWS
+  HANDLE handle = OpenThread(THREAD_TERMINATE, FALSE, (DWORD)thread);
+  if (NULL != handle) {
+    CancelSynchronousIo(handle);
+    CloseHandle(handle);
+  }
+#else
+  pthread_once(&_interrupt_handler_once, _install_interrupt_handler);
+  pthread_kill(thread, INTERRUPT_SIGNAL);
+#endif
+}
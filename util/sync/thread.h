@@ -26,5 +26,15 @@ typedef void *(*VoidFn)(void *);
 ThreadHandle thread_create(VoidFn fn, void *arg);
 WaitStatus thread_join(ThreadHandle thread, unsigned long duration);
 void thread_close(ThreadHandle thread);
+// Number of processors available to run threads. Always at least 1.
+unsigned int thread_num_processors();
+
+// Identifies the calling thread to thread_interrupt().
+ThreadHandle thread_self();
+// Makes a blocking system call in [thread] return early, with EINTR or
+// ERROR_OPERATION_ABORTED on Windows, where the OS allows it. Has no effect on
+// a thread that is not blocked, other than possibly interrupting its next
+// blocking call.
+void thread_interrupt(ThreadHandle thread);
 
 #endif /* UTIL_SYNC_THREAD_H_ */
\ No newline at end of file
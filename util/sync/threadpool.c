@@ -1,78 +1,300 @@
 #include "util/sync/threadpool.h"
 
+#include <stdatomic.h>
+#include <stdbool.h>
+
 #include "alloc/alloc.h"
 #include "struct/q.h"
+#include "util/platform.h"
 #include "util/sync/mutex.h"
-#include "util/sync/semaphore.h"
 #include "util/sync/thread.h"
 
-typedef struct {
+#if defined(OS_WINDOWS)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// Finished work items kept for reuse beyond this many are freed.
+#define MAX_FREE_WORK 256
+
+typedef struct __Work _Work;
+
+struct __Work {
   VoidFnPtr fn;
   VoidFnPtr callback;
   VoidPtr fn_args;
-} _Work;
+  uint64_t submitted_ns;
+  _Work *next_free;
+};
+
+typedef struct {
+  Mutex lock;
+  Q work;
+  // The owning thread waits on this once every deque is empty.
+  Condition *wakeup;
+  bool is_sleeping, is_woken;
+} _WorkDeque;
+
+typedef struct {
+  ThreadPool *tp;
+  uint32_t index;
+} _Worker;
 
 struct __ThreadPool {
   size_t num_threads;
   ThreadHandle *threads;
+  _Worker *workers;
+  _WorkDeque *deques;
+  // Threads waiting for work, so submitting can skip looking for one when
+  // every thread is busy.
+  atomic_uint_fast32_t num_sleeping;
+  // Spreads work submitted from outside the pool across the deques.
+  atomic_uint_fast32_t next_deque;
 
-  Semaphore thread_sem;
-  Mutex work_mutex;
-  Q work;
+  Mutex free_lock;
+  _Work *free_work;
+  uint32_t num_free;
+
+  atomic_uint_fast64_t submitted, completed, stolen;
+  atomic_uint_fast32_t queue_depth, max_queue_depth;
+  atomic_uint_fast64_t total_wait_ns, max_wait_ns, total_run_ns;
 };
 
-void _do_work(ThreadPool *tp) {
+// The pool and deque of the current thread if it belongs to a pool.
+static _Thread_local _Worker *_current_worker = NULL;
+
+uint64_t _now_ns() {
+#if defined(OS_WINDOWS)
+  return GetTickCount64() * 1000000;
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+#endif
+}
+
+void _atomic_max_32(atomic_uint_fast32_t *max, uint32_t value) {
+  uint_fast32_t current = atomic_load(max);
+  while (value > current &&
+         !atomic_compare_exchange_weak(max, &current, value)) {
+  }
+}
+
+void _atomic_max_64(atomic_uint_fast64_t *max, uint64_t value) {
+  uint_fast64_t current = atomic_load(max);
+  while (value > current &&
+         !atomic_compare_exchange_weak(max, &current, value)) {
+  }
+}
+
+_Work *_work_alloc(ThreadPool *tp) {
   _Work *w = NULL;
-  for (;;) {
-    semaphore_wait(tp->thread_sem);
-    SYNCHRONIZED(tp->work_mutex, {
-      if (!Q_is_empty(&tp->work)) {
-        w = (_Work *)Q_pop(&tp->work);
-      } else {
-        semaphore_post(tp->thread_sem);
+  SYNCHRONIZED(tp->free_lock, {
+    if (NULL != tp->free_work) {
+      w = tp->free_work;
+      tp->free_work = w->next_free;
+      tp->num_free--;
+    }
+  });
+  return NULL == w ? ALLOC2(_Work) : w;
+}
+
+void _work_free(ThreadPool *tp, _Work *w) {
+  bool is_pooled = false;
+  SYNCHRONIZED(tp->free_lock, {
+    if (tp->num_free < MAX_FREE_WORK) {
+      w->next_free = tp->free_work;
+      tp->free_work = w;
+      tp->num_free++;
+      is_pooled = true;
+    }
+  });
+  if (!is_pooled) {
+    DEALLOC(w);
+  }
+}
+
+// Takes work from the front of this thread's deque, otherwise steals from the
+// back of another's.
+_Work *_take_work(ThreadPool *tp, uint32_t index) {
+  _Work *w = NULL;
+  _WorkDeque *deque = &tp->deques[index];
+  SYNCHRONIZED(deque->lock, {
+    if (!Q_is_empty(&deque->work)) {
+      w = (_Work *)Q_pop(&deque->work);
+    }
+  });
+  uint32_t i;
+  for (i = 1; NULL == w && i < tp->num_threads; ++i) {
+    deque = &tp->deques[(index + i) % tp->num_threads];
+    SYNCHRONIZED(deque->lock, {
+      if (!Q_is_empty(&deque->work)) {
+        w = (_Work *)Q_remove(&deque->work, Q_size(&deque->work) - 1);
       }
     });
     if (NULL != w) {
-      w->fn(w->fn_args);
-      w->callback(w->fn_args);
-      DEALLOC(w);
-      w = NULL;
+      atomic_fetch_add(&tp->stolen, 1);
     }
   }
+  return w;
+}
+
+// Blocks until work is added to the worker's deque or another thread asks
+// it to steal. The worker counts as sleeping before it looks for work one last
+// time, so a submitter either sees it sleeping and wakes it, or the work is
+// found by that look. Returns the work found, or NULL once woken.
+_Work *_sleep(ThreadPool *tp, uint32_t index) {
+  _WorkDeque *deque = &tp->deques[index];
+  SYNCHRONIZED(deque->lock, { deque->is_sleeping = true; });
+  atomic_fetch_add(&tp->num_sleeping, 1);
+  _Work *w = _take_work(tp, index);
+  SYNCHRONIZED(deque->lock, {
+    while (NULL == w && !deque->is_woken) {
+      mutex_condition_wait(deque->wakeup);
+    }
+    deque->is_sleeping = false;
+    deque->is_woken = false;
+  });
+  atomic_fetch_sub(&tp->num_sleeping, 1);
+  return w;
+}
+
+// Must hold the deque's lock. Returns false if its thread is not sleeping.
+bool _wake(_WorkDeque *deque) {
+  if (!deque->is_sleeping || deque->is_woken) {
+    return false;
+  }
+  deque->is_woken = true;
+  mutex_condition_signal(deque->wakeup);
+  return true;
+}
+
+void _do_work(_Worker *worker) {
+  ThreadPool *tp = worker->tp;
+  _current_worker = worker;
+  for (;;) {
+    _Work *w = _take_work(tp, worker->index);
+    if (NULL == w && NULL == (w = _sleep(tp, worker->index))) {
+      continue;
+    }
+    atomic_fetch_sub(&tp->queue_depth, 1);
+    uint64_t start_ns = _now_ns();
+    uint64_t wait_ns = start_ns - w->submitted_ns;
+    atomic_fetch_add(&tp->total_wait_ns, wait_ns);
+    _atomic_max_64(&tp->max_wait_ns, wait_ns);
+
+    w->fn(w->fn_args);
+    w->callback(w->fn_args);
+
+    atomic_fetch_add(&tp->total_run_ns, _now_ns() - start_ns);
+    atomic_fetch_add(&tp->completed, 1);
+    _work_free(tp, w);
+  }
 }
 
 ThreadPool *threadpool_create(size_t num_threads) {
   ThreadPool *tp = ALLOC2(ThreadPool);
-  Q_init(&tp->work);
-
   tp->num_threads = num_threads;
-  tp->work_mutex = mutex_create();
-  tp->thread_sem = semaphore_create(0);
+  atomic_init(&tp->num_sleeping, 0);
+  atomic_init(&tp->next_deque, 0);
+  tp->free_lock = mutex_create();
+  tp->free_work = NULL;
+  tp->num_free = 0;
+  atomic_init(&tp->submitted, 0);
+  atomic_init(&tp->completed, 0);
+  atomic_init(&tp->stolen, 0);
+  atomic_init(&tp->queue_depth, 0);
+  atomic_init(&tp->max_queue_depth, 0);
+  atomic_init(&tp->total_wait_ns, 0);
+  atomic_init(&tp->max_wait_ns, 0);
+  atomic_init(&tp->total_run_ns, 0);
+  tp->deques = ALLOC_ARRAY2(_WorkDeque, num_threads);
+  tp->workers = ALLOC_ARRAY2(_Worker, num_threads);
   tp->threads = ALLOC_ARRAY2(ThreadHandle, num_threads);
   int i;
   for (i = 0; i < num_threads; ++i) {
-    tp->threads[i] = thread_create((VoidFn)_do_work, (VoidPtr)tp);
+    tp->deques[i].lock = mutex_create();
+    Q_init(&tp->deques[i].work);
+    tp->deques[i].wakeup = mutex_condition(tp->deques[i].lock);
+    tp->deques[i].is_sleeping = false;
+    tp->deques[i].is_woken = false;
+    tp->workers[i].tp = tp;
+    tp->workers[i].index = i;
+  }
+  for (i = 0; i < num_threads; ++i) {
+    tp->threads[i] = thread_create((VoidFn)_do_work, (VoidPtr)&tp->workers[i]);
   }
   return tp;
 }
 
 void threadpool_delete(ThreadPool *tp) {
-  Q_finalize(&tp->work);
   int i;
+  // Threads may be blocked in a native indefinitely, so they are not joined.
   for (i = 0; i < tp->num_threads; ++i) {
     thread_close(tp->threads[i]);
   }
+  for (i = 0; i < tp->num_threads; ++i) {
+    _WorkDeque *deque = &tp->deques[i];
+    while (!Q_is_empty(&deque->work)) {
+      DEALLOC(Q_pop(&deque->work));
+    }
+    Q_finalize(&deque->work);
+  }
+  while (NULL != tp->free_work) {
+    _Work *next = tp->free_work->next_free;
+    DEALLOC(tp->free_work);
+    tp->free_work = next;
+  }
+  DEALLOC(tp->deques);
+  DEALLOC(tp->workers);
+  DEALLOC(tp->threads);
   DEALLOC(tp);
 }
 
 void threadpool_execute(ThreadPool *tp, VoidFnPtr fn, VoidFnPtr callback,
                         VoidPtr fn_args) {
-  _Work *w = ALLOC2(_Work);
+  _Work *w = _work_alloc(tp);
   w->fn = fn;
   w->callback = callback;
   w->fn_args = fn_args;
-  SYNCHRONIZED(tp->work_mutex, {
-    *Q_add_last(&tp->work) = w;
-    semaphore_post(tp->thread_sem);
+  w->submitted_ns = _now_ns();
+  // Work submitted by one of the pool's own threads stays with it.
+  uint32_t index =
+      (NULL != _current_worker && tp == _current_worker->tp)
+          ? _current_worker->index
+          : atomic_fetch_add(&tp->next_deque, 1) % tp->num_threads;
+  // Counted before it can be taken so the depth never goes below 0.
+  atomic_fetch_add(&tp->submitted, 1);
+  _atomic_max_32(&tp->max_queue_depth,
+                 atomic_fetch_add(&tp->queue_depth, 1) + 1);
+  _WorkDeque *deque = &tp->deques[index];
+  bool is_woken;
+  SYNCHRONIZED(deque->lock, {
+    *Q_add_last(&deque->work) = w;
+    is_woken = _wake(deque);
   });
+  // Its thread is busy, so have a sleeping one steal the work.
+  uint32_t i;
+  for (i = 1; !is_woken && i < tp->num_threads &&
+              atomic_load(&tp->num_sleeping) > 0;
+       ++i) {
+    deque = &tp->deques[(index + i) % tp->num_threads];
+    SYNCHRONIZED(deque->lock, { is_woken = _wake(deque); });
+  }
+}
+
+ThreadPoolStats threadpool_stats(ThreadPool *tp) {
+  ThreadPoolStats stats = {
+      .num_threads = tp->num_threads,
+      .submitted = atomic_load(&tp->submitted),
+      .completed = atomic_load(&tp->completed),
+      .stolen = atomic_load(&tp->stolen),
+      .queue_depth = atomic_load(&tp->queue_depth),
+      .max_queue_depth = atomic_load(&tp->max_queue_depth),
+      .total_wait_ns = atomic_load(&tp->total_wait_ns),
+      .max_wait_ns = atomic_load(&tp->max_wait_ns),
+      .total_run_ns = atomic_load(&tp->total_run_ns),
+  };
+  return stats;
 }
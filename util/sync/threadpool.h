@@ -1,6 +1,7 @@
 #ifndef UTIL_SYNC_THREADPOOL_H_
 #define UTIL_SYNC_THREADPOOL_H_
 
+#include <stdint.h>
 #include <stdlib.h>
 
 typedef void (*VoidFnPtr)(void *);
@@ -8,9 +9,30 @@ typedef void *VoidPtr;
 
 typedef struct __ThreadPool ThreadPool;
 
+typedef struct {
+  size_t num_threads;
+  // Work items submitted and finished since the pool was created.
+  uint64_t submitted;
+  uint64_t completed;
+  // Work items taken from another thread's deque.
+  uint64_t stolen;
+  // Work items waiting for a thread, now and at most.
+  uint32_t queue_depth;
+  uint32_t max_queue_depth;
+  // Time between submission and a thread starting a work item.
+  uint64_t total_wait_ns;
+  uint64_t max_wait_ns;
+  // Time spent running fn and callback.
+  uint64_t total_run_ns;
+} ThreadPoolStats;
+
 ThreadPool *threadpool_create(size_t num_threads);
 void threadpool_delete(ThreadPool *threadpool);
+// Runs [fn] then [callback] with [args] on one of the pool's threads. Each
+// thread has its own deque of work and steals from the others when it runs
+// out.
 void threadpool_execute(ThreadPool *threadpool, VoidFnPtr fn,
                         VoidFnPtr callback, VoidPtr args);
+ThreadPoolStats threadpool_stats(ThreadPool *threadpool);
 
-#endif /* UTIL_SYNC_THREADPOOL_H_ */
\ No newline at end of file
+#endif /* UTIL_SYNC_THREADPOOL_H_ */
@@ -0,0 +1,296 @@
+// timer_wheel.c
+//
+// Created on: Oct 18, 2026
+//     Author: Jeff Manzione
+
+#include "util/sync/timer_wheel.h"
+
+#include <stddef.h>
+
+#include "alloc/alloc.h"
+#include "debug/debug.h"
+#include "struct/map.h"
+#include "struct/struct_defaults.h"
+#include "util/platform.h"
+#include "util/sync/mutex.h"
+#include "util/sync/thread.h"
+
+#if defined(OS_WINDOWS)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#define WHEEL_LEVELS 4
+#define WHEEL_SLOT_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_SLOT_BITS)
+#define WHEEL_SLOT_MASK (WHEEL_SLOTS - 1)
+// Timers further out than this are parked in the last level and moved again
+// when it comes around.
+#define WHEEL_RANGE_MS (1ULL << (WHEEL_SLOT_BITS * WHEEL_LEVELS))
+
+typedef struct __Timer _Timer;
+
+struct __Timer {
+  TimerId id;
+  uint64_t expiry_ms;
+  TimerFn fn;
+  void *arg;
+  // Head of the slot list this timer is in.
+  _Timer **slot;
+  _Timer *prev, *next;
+};
+
+struct __TimerWheel {
+  Mutex lock;
+  Condition *cond;
+  ThreadHandle thread;
+  bool is_shutdown;
+  // Every timer due at or before this tick has been taken off the wheel.
+  uint64_t current_ms;
+  _Timer *slots[WHEEL_LEVELS][WHEEL_SLOTS];
+  // TimerId -> _Timer, for cancellation.
+  Map timers;
+  TimerId next_id;
+  uint32_t num_pending;
+};
+
+uint64_t timer_wheel_now_ms() {
+#if defined(OS_WINDOWS)
+  return GetTickCount64();
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+#endif
+}
+
+void _timer_link(_Timer **slot, _Timer *timer) {
+  timer->slot = slot;
+  timer->prev = NULL;
+  timer->next = *slot;
+  if (NULL != *slot) {
+    (*slot)->prev = timer;
+  }
+  *slot = timer;
+}
+
+void _timer_unlink(_Timer *timer) {
+  if (NULL != timer->prev) {
+    timer->prev->next = timer->next;
+  } else {
+    *timer->slot = timer->next;
+  }
+  if (NULL != timer->next) {
+    timer->next->prev = timer->prev;
+  }
+  timer->slot = NULL;
+  timer->prev = NULL;
+  timer->next = NULL;
+}
+
+// Puts [timer] in the slot for its expiry relative to current_ms. A timer due
+// at current_ms goes in the level 0 slot about to be expired.
+void _wheel_place(TimerWheel *wheel, _Timer *timer) {
+  uint64_t expiry = timer->expiry_ms;
+  if (expiry < wheel->current_ms) {
+    expiry = wheel->current_ms;
+  }
+  uint64_t delta = expiry - wheel->current_ms;
+  if (delta >= WHEEL_RANGE_MS) {
+    expiry = wheel->current_ms + WHEEL_RANGE_MS - 1;
+    delta = WHEEL_RANGE_MS - 1;
+  }
+  int level = 0;
+  while (level < WHEEL_LEVELS - 1 &&
+         delta >= (1ULL << (WHEEL_SLOT_BITS * (level + 1)))) {
+    ++level;
+  }
+  int slot = (expiry >> (WHEEL_SLOT_BITS * level)) & WHEEL_SLOT_MASK;
+  _timer_link(&wheel->slots[level][slot], timer);
+}
+
+// Moves the timers of a slot down to the levels below it.
+void _wheel_cascade(TimerWheel *wheel, int level, int slot) {
+  _Timer *timer = wheel->slots[level][slot];
+  wheel->slots[level][slot] = NULL;
+  while (NULL != timer) {
+    _Timer *next = timer->next;
+    _wheel_place(wheel, timer);
+    timer = next;
+  }
+}
+
+int _level_slot(uint64_t tick, int level) {
+  return (tick >> (WHEEL_SLOT_BITS * level)) & WHEEL_SLOT_MASK;
+}
+
+// Advances the wheel to [now_ms]. Returns the expired timers as a list linked
+// through next.
+_Timer *_wheel_advance(TimerWheel *wheel, uint64_t now_ms) {
+  if (0 == wheel->num_pending) {
+    if (now_ms > wheel->current_ms) {
+      wheel->current_ms = now_ms;
+    }
+    return NULL;
+  }
+  _Timer *expired = NULL;
+  while (wheel->current_ms < now_ms) {
+    uint64_t tick = ++wheel->current_ms;
+    int level;
+    // Find the highest level that rolls over on this tick, then cascade from
+    // it downward.
+    for (level = 0; level < WHEEL_LEVELS - 1 && 0 == _level_slot(tick, level);
+         ++level) {
+    }
+    for (; level > 0; --level) {
+      _wheel_cascade(wheel, level, _level_slot(tick, level));
+    }
+    _Timer **slot = &wheel->slots[0][_level_slot(tick, 0)];
+    while (NULL != *slot) {
+      _Timer *timer = *slot;
+      _timer_unlink(timer);
+      if (timer->expiry_ms > tick) {
+        // Clamped into the wheel's range and still not due.
+        _wheel_place(wheel, timer);
+        continue;
+      }
+      map_remove(&wheel->timers, (void *)(uintptr_t)timer->id);
+      wheel->num_pending--;
+      timer->next = expired;
+      expired = timer;
+    }
+  }
+  return expired;
+}
+
+// How long the wheel can sleep before it has work to do.
+uint64_t _wheel_next_wait_ms(TimerWheel *wheel) {
+  uint64_t until_rollover =
+      WHEEL_SLOTS - (wheel->current_ms & WHEEL_SLOT_MASK);
+  uint64_t i;
+  for (i = 1; i < until_rollover; ++i) {
+    if (NULL != wheel->slots[0][(wheel->current_ms + i) & WHEEL_SLOT_MASK]) {
+      return i;
+    }
+  }
+  return until_rollover;
+}
+
+void *_timer_wheel_run(void *ptr) {
+  TimerWheel *wheel = (TimerWheel *)ptr;
+  mutex_lock(wheel->lock);
+  while (!wheel->is_shutdown) {
+    _Timer *expired = _wheel_advance(wheel, timer_wheel_now_ms());
+    if (NULL != expired) {
+      // Callbacks may add timers, so call them without the lock.
+      mutex_unlock(wheel->lock);
+      while (NULL != expired) {
+        _Timer *next = expired->next;
+        expired->fn(expired->arg);
+        DEALLOC(expired);
+        expired = next;
+      }
+      mutex_lock(wheel->lock);
+      continue;
+    }
+    if (0 == wheel->num_pending) {
+      mutex_condition_wait(wheel->cond);
+    } else {
+      mutex_condition_wait_timed(wheel->cond, _wheel_next_wait_ms(wheel));
+    }
+  }
+  mutex_unlock(wheel->lock);
+  return NULL;
+}
+
+TimerWheel *timer_wheel_create() {
+  TimerWheel *wheel = ALLOC2(TimerWheel);
+  wheel->lock = mutex_create();
+  wheel->cond = mutex_condition(wheel->lock);
+  wheel->is_shutdown = false;
+  wheel->current_ms = timer_wheel_now_ms();
+  int level, slot;
+  for (level = 0; level < WHEEL_LEVELS; ++level) {
+    for (slot = 0; slot < WHEEL_SLOTS; ++slot) {
+      wheel->slots[level][slot] = NULL;
+    }
+  }
+  map_init_default(&wheel->timers);
+  wheel->next_id = 1;
+  wheel->num_pending = 0;
+  wheel->thread = thread_create(AS_VOID_FN(_timer_wheel_run), wheel);
+  return wheel;
+}
+
+void timer_wheel_delete(TimerWheel *wheel) {
+  ASSERT(NOT_NULL(wheel));
+  SYNCHRONIZED(wheel->lock, {
+    wheel->is_shutdown = true;
+    mutex_condition_broadcast(wheel->cond);
+  });
+  thread_join(wheel->thread, INFINITE);
+  int level, slot;
+  for (level = 0; level < WHEEL_LEVELS; ++level) {
+    for (slot = 0; slot < WHEEL_SLOTS; ++slot) {
+      _Timer *timer = wheel->slots[level][slot];
+      while (NULL != timer) {
+        _Timer *next = timer->next;
+        DEALLOC(timer);
+        timer = next;
+      }
+    }
+  }
+  map_finalize(&wheel->timers);
+  mutex_condition_delete(wheel->cond);
+  mutex_close(wheel->lock);
+  DEALLOC(wheel);
+}
+
+TimerId timer_wheel_add(TimerWheel *wheel, uint64_t delay_ms, TimerFn fn,
+                        void *arg) {
+  ASSERT(NOT_NULL(wheel), NOT_NULL(fn));
+  _Timer *timer = ALLOC2(_Timer);
+  timer->fn = fn;
+  timer->arg = arg;
+  uint64_t now_ms = timer_wheel_now_ms();
+  TimerId id;
+  SYNCHRONIZED(wheel->lock, {
+    id = timer->id = wheel->next_id++;
+    timer->expiry_ms = now_ms + delay_ms;
+    // The slot for current_ms has already been expired.
+    if (timer->expiry_ms <= wheel->current_ms) {
+      timer->expiry_ms = wheel->current_ms + 1;
+    }
+    _wheel_place(wheel, timer);
+    map_insert(&wheel->timers, (void *)(uintptr_t)id, timer);
+    wheel->num_pending++;
+    // Let the thread recompute how long to sleep.
+    mutex_condition_signal(wheel->cond);
+  });
+  return id;
+}
+
+bool timer_wheel_cancel(TimerWheel *wheel, TimerId id) {
+  ASSERT(NOT_NULL(wheel));
+  _Timer *timer;
+  SYNCHRONIZED(wheel->lock, {
+    timer = (_Timer *)map_lookup(&wheel->timers, (void *)(uintptr_t)id);
+    if (NULL != timer) {
+      _timer_unlink(timer);
+      map_remove(&wheel->timers, (void *)(uintptr_t)id);
+      wheel->num_pending--;
+    }
+  });
+  if (NULL == timer) {
+    return false;
+  }
+  DEALLOC(timer);
+  return true;
+}
+
+uint32_t timer_wheel_num_pending(TimerWheel *wheel) {
+  uint32_t num_pending;
+  SYNCHRONIZED(wheel->lock, { num_pending = wheel->num_pending; });
+  return num_pending;
+}
@@ -0,0 +1,41 @@
+// timer_wheel.h
+//
+// Created on: Oct 18, 2026
+//     Author: Jeff Manzione
+//
+// Hierarchical timer wheel with millisecond resolution on the monotonic clock.
+//
+// A single thread owned by the wheel advances it and calls the callbacks of
+// expired timers, so callbacks must be quick and must not block. Each level
+// has 64 slots, so a timer costs O(1) to add and cancel and is moved down a
+// level at most 3 times before it fires.
+
+#ifndef UTIL_SYNC_TIMER_WHEEL_H_
+#define UTIL_SYNC_TIMER_WHEEL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct __TimerWheel TimerWheel;
+
+// Identifies a timer while it is pending. Never 0.
+typedef uint64_t TimerId;
+
+typedef void (*TimerFn)(void *arg);
+
+TimerWheel *timer_wheel_create();
+// Pending timers are dropped without being called.
+void timer_wheel_delete(TimerWheel *wheel);
+
+// Calls [fn] with [arg] on the wheel's thread once [delay_ms] have passed.
+TimerId timer_wheel_add(TimerWheel *wheel, uint64_t delay_ms, TimerFn fn,
+                        void *arg);
+// Returns false if the timer already fired or was cancelled.
+bool timer_wheel_cancel(TimerWheel *wheel, TimerId id);
+
+uint32_t timer_wheel_num_pending(TimerWheel *wheel);
+
+// Milliseconds on the monotonic clock.
+uint64_t timer_wheel_now_ms();
+
+#endif /* UTIL_SYNC_TIMER_WHEEL_H_ */
@@ -0,0 +1,330 @@
+// uring.c
+//
+// Created on: Oct 18, 2026
+//     Author: Jeff Manzione
+
+#include "util/uring.h"
+
+#include <stddef.h>
+
+#include "util/platform.h"
+
+#if defined(OS_LINUX) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+// Reads and writes at the current position need 5.6.
+#if defined(IORING_FEAT_RW_CUR_POS) && defined(__NR_io_uring_setup)
+#define URING_SUPPORTED
+#endif
+#endif
+#endif
+
+#if defined(URING_SUPPORTED)
+#include <errno.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "alloc/alloc.h"
+#include "debug/debug.h"
+#include "util/sync/mutex.h"
+#include "util/sync/thread.h"
+
+// The user_data of the no-op that wakes the thread up for shutdown.
+#define URING_WAKE 0
+
+typedef struct {
+  UringFn fn;
+  void *arg;
+} _UringOp;
+
+struct __Uring {
+  int fd;
+  void *sq_ring, *cq_ring;
+  size_t sq_ring_size, cq_ring_size;
+  struct io_uring_sqe *sqes;
+  uint32_t num_sqes;
+  // Pointers into the mapped rings.
+  _Atomic uint32_t *sq_head, *sq_tail, *cq_head, *cq_tail;
+  uint32_t *sq_array;
+  uint32_t sq_mask, cq_mask, cq_entries;
+  struct io_uring_cqe *cqes;
+
+  // Guards the submission queue and the counts.
+  Mutex lock;
+  // Queued but not yet submitted.
+  uint32_t num_queued;
+  // Queued or submitted but not yet reaped. Kept below cq_entries so the
+  // completion queue never overflows.
+  uint32_t num_in_flight;
+  bool is_shutdown;
+  ThreadHandle thread;
+};
+
+static inline int _io_uring_setup(uint32_t entries,
+                                  struct io_uring_params *params) {
+  return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static inline int _io_uring_enter(int fd, uint32_t to_submit,
+                                  uint32_t min_complete, uint32_t flags) {
+  return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                      NULL, 0);
+}
+
+// Must hold the lock.
+void _uring_submit(Uring *uring) {
+  while (uring->num_queued > 0) {
+    int submitted = _io_uring_enter(uring->fd, uring->num_queued, 0, 0);
+    if (submitted < 0) {
+      if (EINTR == errno) {
+        continue;
+      }
+      // Left queued for the next flush, e.g. on EAGAIN.
+      return;
+    }
+    uring->num_queued -= submitted;
+  }
+}
+
+// Must hold the lock. Returns the next free entry of the submission queue,
+// submitting what is queued if it is full.
+struct io_uring_sqe *_uring_next_sqe(Uring *uring) {
+  uint32_t tail = atomic_load_explicit(uring->sq_tail, memory_order_relaxed);
+  if (tail - atomic_load_explicit(uring->sq_head, memory_order_acquire) >=
+      uring->num_sqes) {
+    _uring_submit(uring);
+    if (tail - atomic_load_explicit(uring->sq_head, memory_order_acquire) >=
+        uring->num_sqes) {
+      return NULL;
+    }
+  }
+  uint32_t index = tail & uring->sq_mask;
+  struct io_uring_sqe *sqe = &uring->sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  uring->sq_array[index] = index;
+  return sqe;
+}
+
+// Must hold the lock. Makes the entry filled in by _uring_next_sqe() visible
+// to the kernel.
+void _uring_commit_sqe(Uring *uring) {
+  atomic_store_explicit(
+      uring->sq_tail,
+      atomic_load_explicit(uring->sq_tail, memory_order_relaxed) + 1,
+      memory_order_release);
+  uring->num_queued++;
+  uring->num_in_flight++;
+}
+
+bool _uring_queue(Uring *uring, uint8_t opcode, int fd, uint64_t addr,
+                  uint32_t len, int64_t offset, UringFn fn, void *arg) {
+  ASSERT(NOT_NULL(uring), NOT_NULL(fn), fd >= 0);
+  _UringOp *op = ALLOC2(_UringOp);
+  op->fn = fn;
+  op->arg = arg;
+  bool is_queued = false;
+  mutex_lock(uring->lock);
+  // One completion is kept free for the shutdown no-op.
+  struct io_uring_sqe *sqe =
+      uring->num_in_flight + 1 < uring->cq_entries ? _uring_next_sqe(uring)
+                                                   : NULL;
+  if (NULL != sqe) {
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = addr;
+    sqe->len = len;
+    sqe->off = (uint64_t)offset;
+    sqe->user_data = (uint64_t)(uintptr_t)op;
+    _uring_commit_sqe(uring);
+    is_queued = true;
+  }
+  mutex_unlock(uring->lock);
+  if (!is_queued) {
+    DEALLOC(op);
+  }
+  return is_queued;
+}
+
+void *_uring_run(void *ptr) {
+  Uring *uring = (Uring *)ptr;
+  for (;;) {
+    if (_io_uring_enter(uring->fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 &&
+        EINTR != errno) {
+      ERROR("io_uring_enter failed.");
+    }
+    uint32_t head = atomic_load_explicit(uring->cq_head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(uring->cq_tail, memory_order_acquire);
+    uint32_t num_reaped = 0;
+    bool is_woken = false;
+    for (; head != tail; ++head) {
+      struct io_uring_cqe *cqe = &uring->cqes[head & uring->cq_mask];
+      _UringOp *op = (_UringOp *)(uintptr_t)cqe->user_data;
+      int32_t result = cqe->res;
+      // Free the entry before calling back, since callbacks may queue more.
+      atomic_store_explicit(uring->cq_head, head + 1, memory_order_release);
+      ++num_reaped;
+      if (URING_WAKE == (uintptr_t)op) {
+        is_woken = true;
+        continue;
+      }
+      op->fn(op->arg, result);
+      DEALLOC(op);
+    }
+    bool is_shutdown;
+    SYNCHRONIZED(uring->lock, {
+      uring->num_in_flight -= num_reaped;
+      is_shutdown = uring->is_shutdown;
+    });
+    if (is_woken && is_shutdown) {
+      return NULL;
+    }
+  }
+}
+
+void _uring_unmap(Uring *uring) {
+  if (NULL != uring->sqes && MAP_FAILED != uring->sqes) {
+    munmap(uring->sqes, uring->num_sqes * sizeof(struct io_uring_sqe));
+  }
+  if (NULL != uring->cq_ring && MAP_FAILED != uring->cq_ring &&
+      uring->cq_ring != uring->sq_ring) {
+    munmap(uring->cq_ring, uring->cq_ring_size);
+  }
+  if (NULL != uring->sq_ring && MAP_FAILED != uring->sq_ring) {
+    munmap(uring->sq_ring, uring->sq_ring_size);
+  }
+}
+
+// Maps the rings set up for [params]. Returns false on failure.
+bool _uring_map(Uring *uring, const struct io_uring_params *params) {
+  uring->sq_ring_size =
+      params->sq_off.array + params->sq_entries * sizeof(uint32_t);
+  uring->cq_ring_size =
+      params->cq_off.cqes + params->cq_entries * sizeof(struct io_uring_cqe);
+  bool is_single_mmap = 0 != (params->features & IORING_FEAT_SINGLE_MMAP);
+  if (is_single_mmap && uring->cq_ring_size > uring->sq_ring_size) {
+    uring->sq_ring_size = uring->cq_ring_size;
+  }
+  uring->sq_ring =
+      mmap(NULL, uring->sq_ring_size, PROT_READ | PROT_WRITE,
+           MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQ_RING);
+  if (MAP_FAILED == uring->sq_ring) {
+    return false;
+  }
+  uring->cq_ring =
+      is_single_mmap
+          ? uring->sq_ring
+          : mmap(NULL, uring->cq_ring_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_CQ_RING);
+  if (MAP_FAILED == uring->cq_ring) {
+    return false;
+  }
+  uring->num_sqes = params->sq_entries;
+  uring->sqes = (struct io_uring_sqe *)mmap(
+      NULL, uring->num_sqes * sizeof(struct io_uring_sqe),
+      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->fd,
+      IORING_OFF_SQES);
+  if (MAP_FAILED == uring->sqes) {
+    return false;
+  }
+  char *sq = (char *)uring->sq_ring, *cq = (char *)uring->cq_ring;
+  uring->sq_head = (_Atomic uint32_t *)(sq + params->sq_off.head);
+  uring->sq_tail = (_Atomic uint32_t *)(sq + params->sq_off.tail);
+  uring->sq_mask = *(uint32_t *)(sq + params->sq_off.ring_mask);
+  uring->sq_array = (uint32_t *)(sq + params->sq_off.array);
+  uring->cq_head = (_Atomic uint32_t *)(cq + params->cq_off.head);
+  uring->cq_tail = (_Atomic uint32_t *)(cq + params->cq_off.tail);
+  uring->cq_mask = *(uint32_t *)(cq + params->cq_off.ring_mask);
+  uring->cq_entries = params->cq_entries;
+  uring->cqes = (struct io_uring_cqe *)(cq + params->cq_off.cqes);
+  return true;
+}
+
+Uring *uring_create(uint32_t entries) {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  // Fails with ENOSYS on old kernels and EPERM where it is disabled.
+  int fd = _io_uring_setup(entries, &params);
+  if (fd < 0) {
+    return NULL;
+  }
+  if (0 == (params.features & IORING_FEAT_RW_CUR_POS)) {
+    close(fd);
+    return NULL;
+  }
+  Uring *uring = ALLOC2(Uring);
+  memset(uring, 0, sizeof(Uring));
+  uring->fd = fd;
+  if (!_uring_map(uring, &params)) {
+    _uring_unmap(uring);
+    close(fd);
+    DEALLOC(uring);
+    return NULL;
+  }
+  uring->lock = mutex_create();
+  uring->num_queued = 0;
+  uring->num_in_flight = 0;
+  uring->is_shutdown = false;
+  uring->thread = thread_create(AS_VOID_FN(_uring_run), uring);
+  return uring;
+}
+
+void uring_delete(Uring *uring) {
+  ASSERT(NOT_NULL(uring));
+  SYNCHRONIZED(uring->lock, {
+    uring->is_shutdown = true;
+    struct io_uring_sqe *sqe = _uring_next_sqe(uring);
+    if (NULL == sqe) {
+      ERROR("Could not wake the io_uring thread.");
+    }
+    sqe->opcode = IORING_OP_NOP;
+    sqe->user_data = URING_WAKE;
+    _uring_commit_sqe(uring);
+    _uring_submit(uring);
+  });
+  thread_join(uring->thread, INFINITE);
+  // Closing the ring waits for whatever is still in flight.
+  close(uring->fd);
+  _uring_unmap(uring);
+  mutex_close(uring->lock);
+  DEALLOC(uring);
+}
+
+bool uring_read(Uring *uring, int fd, void *buf, uint32_t len, int64_t offset,
+                UringFn fn, void *arg) {
+  return _uring_queue(uring, IORING_OP_READ, fd, (uint64_t)(uintptr_t)buf, len,
+                      offset, fn, arg);
+}
+
+bool uring_write(Uring *uring, int fd, const void *buf, uint32_t len,
+                 int64_t offset, UringFn fn, void *arg) {
+  return _uring_queue(uring, IORING_OP_WRITE, fd, (uint64_t)(uintptr_t)buf,
+                      len, offset, fn, arg);
+}
+
+void uring_flush(Uring *uring) {
+  ASSERT(NOT_NULL(uring));
+  SYNCHRONIZED(uring->lock, { _uring_submit(uring); });
+}
+
+#else
+
+Uring *uring_create(uint32_t entries) { return NULL; }
+
+void uring_delete(Uring *uring) {}
+
+bool uring_read(Uring *uring, int fd, void *buf, uint32_t len, int64_t offset,
+                UringFn fn, void *arg) {
+  return false;
+}
+
+bool uring_write(Uring *uring, int fd, const void *buf, uint32_t len,
+                 int64_t offset, UringFn fn, void *arg) {
+  return false;
+}
+
+void uring_flush(Uring *uring) {}
+
+#endif
@@ -0,0 +1,42 @@
+// uring.h
+//
+// Created on: Oct 18, 2026
+//     Author: Jeff Manzione
+//
+// Runs reads and writes asynchronously through io_uring, so no thread has to
+// block on them. Only available on Linux 5.6 and later.
+//
+// Requests are queued and only handed to the kernel by uring_flush(), so a
+// caller can batch everything it issues in one go. A single thread owned by
+// the ring reaps completions and calls the callbacks, so callbacks must be
+// quick and must not block.
+
+#ifndef UTIL_URING_H_
+#define UTIL_URING_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct __Uring Uring;
+
+// [result] is the number of bytes transferred, or -errno on failure.
+typedef void (*UringFn)(void *arg, int32_t result);
+
+// Returns NULL if io_uring is not supported by this platform or kernel.
+Uring *uring_create(uint32_t entries);
+// Requests still in flight are dropped without being called.
+void uring_delete(Uring *uring);
+
+// Queues a read of up to [len] bytes from [fd] at [offset] into [buf], which
+// must stay valid until [fn] is called. An [offset] of -1 reads from, and
+// advances, the current position. Returns false if the ring is full.
+bool uring_read(Uring *uring, int fd, void *buf, uint32_t len, int64_t offset,
+                UringFn fn, void *arg);
+// Like uring_read(), but writes [len] bytes from [buf].
+bool uring_write(Uring *uring, int fd, const void *buf, uint32_t len,
+                 int64_t offset, UringFn fn, void *arg);
+
+// Submits every queued request to the kernel.
+void uring_flush(Uring *uring);
+
+#endif /* UTIL_URING_H_ */
@@ -18,6 +18,7 @@
 #include "entity/native/error.h"
 #include "entity/native/io.h"
 #include "entity/native/math.h"
+#include "entity/native/net.h"
 #include "entity/native/process.h"
 #include "entity/native/socket.h"
 #include "util/file.h"
@@ -51,7 +52,8 @@ void register_builtin(ModuleManager *mm, Heap *heap, const char *lib_location) {
       mm, find_file_by_name(lib_location, "process"), process_add_native);
   mm_register_module_with_callback(
       mm, find_file_by_name(lib_location, "socket"), socket_add_native);
-  mm_register_module(mm, find_file_by_name(lib_location, "net"));
+  mm_register_module_with_callback(mm, find_file_by_name(lib_location, "net"),
+                                   net_add_native);
 
   DIR *lib = opendir(lib_location);
   struct dirent *dir;
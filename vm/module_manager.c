@@ -100,6 +100,10 @@ inline const char *module_info_file_name(ModuleInfo *mi) {
   return mi->file_name;
 }
 
+Module *module_info_module(ModuleInfo *mi) {
+  return mi->is_loaded ? &mi->module : NULL;
+}
+
 ModuleInfo *_modulemanager_hydrate(ModuleManager *mm, Tape *tape,
                                    ModuleInfo *module_info) {
   ASSERT(NOT_NULL(mm), NOT_NULL(tape), NOT_NULL(module_info));
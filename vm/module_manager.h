@@ -42,5 +42,7 @@ void modulemanager_update_module(ModuleManager *mm, Module *m,
                                  Map *new_classes);
 
 const char *module_info_file_name(ModuleInfo *mi);
+// Returns the module if it has been loaded, otherwise NULL.
+Module *module_info_module(ModuleInfo *mi);
 
 #endif /* VM_MODULE_MANAGER_H_ */
\ No newline at end of file
@@ -88,6 +88,11 @@ Entity *context_lookup(Context *ctx, const char id[], Entity *tmp) {
   const Function *f = class_get_function(ctx->self.obj->_class, id);
   if (NULL != f) {
     Object *f_ref = wrap_function_in_ref(f, ctx->self.obj, task, ctx);
+    // Frozen objects are shared, so the ref cannot be cached on them.
+    if (object_is_frozen(ctx->self.obj)) {
+      *tmp = entity_object(f_ref);
+      return tmp;
+    }
     return object_set_member_obj(task->parent_process->heap, ctx->self.obj, id,
                                  f_ref);
   }
@@ -125,12 +130,12 @@ void context_let(Context *ctx, const char id[], const Entity *e) {
   object_set_member(_context_heap(ctx), ctx->member_obj, id, e);
 }
 
-void context_set(Context *ctx, const char id[], const Entity *e) {
+bool context_set(Context *ctx, const char id[], const Entity *e) {
   ASSERT(NOT_NULL(ctx), NOT_NULL(id), NOT_NULL(e));
   Entity *member = NULL;
   if (NULL != object_get(ctx->member_obj, id)) {
     object_set_member(_context_heap(ctx), ctx->member_obj, id, e);
-    return;
+    return true;
   }
   Context *parent_context = ctx->previous_context;
   while (NULL != parent_context &&
@@ -140,13 +145,17 @@ void context_set(Context *ctx, const char id[], const Entity *e) {
   if (NULL != member) {
     object_set_member(_context_heap(parent_context), parent_context->member_obj,
                       id, e);
-    return;
+    return true;
   }
   if (NULL != object_get(ctx->self.obj, id)) {
+    if (object_is_frozen(ctx->self.obj)) {
+      return false;
+    }
     object_set_member(_context_heap(ctx), ctx->self.obj, id, e);
-    return;
+    return true;
   }
   object_set_member(_context_heap(ctx), ctx->member_obj, id, e);
+  return true;
 }
 
 inline void context_set_function(Context *ctx, const Function *func) {
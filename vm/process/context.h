@@ -21,7 +21,8 @@ void context_set_function(Context *ctx, const Function *func);
 
 Entity *context_lookup(Context *ctx, const char id[], Entity *tmp);
 void context_let(Context *ctx, const char id[], const Entity *e);
-void context_set(Context *ctx, const char id[], const Entity *e);
+// Returns false if [id] is a field on a frozen self and was not set.
+bool context_set(Context *ctx, const char id[], const Entity *e);
 
 Context *task_get_context_for_index(Task *task, uint32_t index);
 
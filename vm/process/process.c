@@ -5,44 +5,188 @@
 
 #include "vm/process/process.h"
 
+#include "alloc/alloc.h"
 #include "alloc/arena/arena.h"
+#include "debug/debug.h"
 #include "entity/class/classes.h"
 #include "struct/struct_defaults.h"
 #include "util/sync/mutex.h"
 #include "vm/process/processes.h"
 #include "vm/process/task.h"
 
-void process_init(Process *process) {
+// Every this many pops, the priority that has waited longest is served instead
+// of the highest one, so low priority tasks cannot starve.
+#define STARVATION_INTERVAL 16
+#define TASK_HEAP_INITIAL_CAPACITY 16
+
+static inline uint64_t _task_deadline_key(const Task *task) {
+  return 0 == task->deadline_ms ? UINT64_MAX : task->deadline_ms;
+}
+
+static inline bool _task_runs_before(const Task *a, const Task *b) {
+  uint64_t a_key = _task_deadline_key(a), b_key = _task_deadline_key(b);
+  return a_key != b_key ? a_key < b_key : a->_queue_seq < b->_queue_seq;
+}
+
+void _task_heap_init(TaskHeap *heap) {
+  heap->tasks = NULL;
+  heap->size = 0;
+  heap->capacity = 0;
+}
+
+void _task_heap_finalize(TaskHeap *heap) {
+  uint32_t i;
+  for (i = 0; i < heap->size; ++i) {
+    task_finalize(heap->tasks[i]);
+  }
+  if (NULL != heap->tasks) {
+    DEALLOC(heap->tasks);
+  }
+}
+
+void _task_heap_push(TaskHeap *heap, Task *task) {
+  if (heap->size == heap->capacity) {
+    heap->capacity = 0 == heap->capacity ? TASK_HEAP_INITIAL_CAPACITY
+                                         : heap->capacity * 2;
+    heap->tasks = NULL == heap->tasks
+                      ? ALLOC_ARRAY(Task *, heap->capacity)
+                      : REALLOC(heap->tasks, Task *, heap->capacity);
+  }
+  uint32_t i = heap->size++;
+  while (i > 0) {
+    uint32_t parent = (i - 1) / 2;
+    if (!_task_runs_before(task, heap->tasks[parent])) {
+      break;
+    }
+    heap->tasks[i] = heap->tasks[parent];
+    i = parent;
+  }
+  heap->tasks[i] = task;
+}
+
+Task *_task_heap_pop(TaskHeap *heap) {
+  ASSERT(heap->size > 0);
+  Task *top = heap->tasks[0];
+  Task *last = heap->tasks[--heap->size];
+  uint32_t i = 0;
+  for (;;) {
+    uint32_t child = 2 * i + 1;
+    if (child >= heap->size) {
+      break;
+    }
+    if (child + 1 < heap->size &&
+        _task_runs_before(heap->tasks[child + 1], heap->tasks[child])) {
+      ++child;
+    }
+    if (!_task_runs_before(heap->tasks[child], last)) {
+      break;
+    }
+    heap->tasks[i] = heap->tasks[child];
+    i = child;
+  }
+  if (heap->size > 0) {
+    heap->tasks[i] = last;
+  }
+  return top;
+}
+
+void _task_queue_init(TaskQueue *queue) {
+  queue->lock = mutex_create();
+  queue->num_pops = 0;
+  int i;
+  for (i = 0; i < NUM_TASK_PRIORITIES; ++i) {
+    _task_heap_init(&queue->queues[i]);
+    queue->last_served[i] = 0;
+  }
+}
+
+void _task_queue_finalize(TaskQueue *queue) {
+  int i;
+  for (i = 0; i < NUM_TASK_PRIORITIES; ++i) {
+    _task_heap_finalize(&queue->queues[i]);
+  }
+  mutex_close(queue->lock);
+}
+
+uint32_t _task_queue_size(const TaskQueue *queue) {
+  uint32_t size = 0;
+  int i;
+  for (i = 0; i < NUM_TASK_PRIORITIES; ++i) {
+    size += queue->queues[i].size;
+  }
+  return size;
+}
+
+// Takes the highest priority task, or the one of the longest unserved
+// priority on every STARVATION_INTERVAL-th pop. Must hold queue->lock.
+Task *_task_queue_pop(TaskQueue *queue) {
+  int i, chosen = -1;
+  for (i = 0; i < NUM_TASK_PRIORITIES; ++i) {
+    if (queue->queues[i].size > 0) {
+      chosen = i;
+      break;
+    }
+  }
+  if (chosen < 0) {
+    return NULL;
+  }
+  ++queue->num_pops;
+  if (0 == queue->num_pops % STARVATION_INTERVAL) {
+    for (i = chosen + 1; i < NUM_TASK_PRIORITIES; ++i) {
+      if (queue->queues[i].size > 0 &&
+          queue->last_served[i] < queue->last_served[chosen]) {
+        chosen = i;
+      }
+    }
+  }
+  queue->last_served[chosen] = queue->num_pops;
+  return _task_heap_pop(&queue->queues[chosen]);
+}
+
+Heap *_process_heap_create() {
   HeapConf conf = {.mgraph_config = {.eager_delete_edges = true,
                                      .eager_delete_edges = true}};
-  process->heap = heap_create(&conf);
+  return heap_create(&conf);
+}
+
+void process_init(Process *process) {
+  process->heap = _process_heap_create();
   __arena_init(&process->task_arena, sizeof(Task), "Task");
   __arena_init(&process->context_arena, sizeof(Context), "Context");
   process->task_create_lock = mutex_create();
-  process->task_queue_lock = mutex_create();
+  process->heap_owner_lock = mutex_create();
   process->task_waiting_lock = mutex_create();
   process->task_wait_cond = mutex_condition(process->task_waiting_lock);
-  process->task_complete_lock = mutex_create();
-  Q_init(&process->queued_tasks);
-  set_init_default(&process->waiting_tasks);
+  _task_queue_init(&process->task_queue);
+  atomic_init(&process->num_live_tasks, 0);
+  atomic_init(&process->num_pending_completions, 0);
+  atomic_init(&process->num_background_calls, 0);
+  atomic_init(&process->next_queue_seq, 0);
+  atomic_init(&process->sched_state, PROCESS_PARKED);
+  process->is_retired = false;
+  process->wake_fn = NULL;
+  process->waiting_tasks = NULL;
+  mpsc_queue_init(&process->completions);
   set_init_default(&process->completed_tasks);
+  process->strings_interned = 0;
+  process->strings_deduped = 0;
+  process->string_bytes_saved = 0;
   process->_reflection = NULL;
 }
 
 void process_finalize(Process *process) {
-  Q_iter q_iter = Q_iterator(&process->queued_tasks);
-  for (; Q_has(&q_iter); Q_inc(&q_iter)) {
-    task_finalize(*(Task **)Q_value(&q_iter));
-  }
-  Q_finalize(&process->queued_tasks);
+  _task_queue_finalize(&process->task_queue);
 
-  M_iter m_iter = set_iter(&process->waiting_tasks);
-  for (; has(&m_iter); inc(&m_iter)) {
-    task_finalize((Task *)value(&m_iter));
+  Task *task = process->waiting_tasks;
+  while (NULL != task) {
+    Task *next = task->_next_waiting;
+    task_finalize(task);
+    task = next;
   }
-  set_finalize(&process->waiting_tasks);
+  // Completions not yet drained belong to unqueued tasks, which are freed
+  // with the task arena.
 
-  m_iter = set_iter(&process->completed_tasks);
+  M_iter m_iter = set_iter(&process->completed_tasks);
   for (; has(&m_iter); inc(&m_iter)) {
     task_finalize((Task *)value(&m_iter));
   }
@@ -51,10 +195,32 @@ void process_finalize(Process *process) {
   __arena_finalize(&process->context_arena);
   heap_delete(process->heap);
   mutex_close(process->task_create_lock);
-  mutex_close(process->task_queue_lock);
+  mutex_close(process->heap_owner_lock);
   mutex_condition_delete(process->task_wait_cond);
   mutex_close(process->task_waiting_lock);
-  mutex_close(process->task_complete_lock);
+}
+
+void process_reset(Process *process, const HeapLimits *limits) {
+  ASSERT(process_is_finished(process));
+  M_iter m_iter = set_iter(&process->completed_tasks);
+  for (; has(&m_iter); inc(&m_iter)) {
+    task_finalize((Task *)value(&m_iter));
+  }
+  set_finalize(&process->completed_tasks);
+  set_init_default(&process->completed_tasks);
+  process->waiting_tasks = NULL;
+  process->current_task = NULL;
+  __arena_finalize(&process->task_arena);
+  __arena_finalize(&process->context_arena);
+  __arena_init(&process->task_arena, sizeof(Task), "Task");
+  __arena_init(&process->context_arena, sizeof(Context), "Context");
+
+  heap_delete(process->heap);
+  process->heap = _process_heap_create();
+  heap_set_limits(process->heap, limits);
+  process->_reflection = heap_new(process->heap, Class_Process);
+  process->_reflection->_internal_obj = process;
+  heap_make_root(process->heap, process->_reflection);
 }
 
 void _task_add_reflection(Process *process, Task *task) {
@@ -80,41 +246,160 @@ Task *process_create_task(Process *process) {
   return task;
 }
 
-inline Task *process_pop_task(Process *process) {
+Task *process_pop_task(Process *process) {
   Task *task;
-  SYNCHRONIZED(process->task_queue_lock, {
-    if (0 == Q_size(&process->queued_tasks)) {
-      task = NULL;
-    } else {
-      task = Q_pop(&process->queued_tasks);
-    }
-  });
+  TaskQueue *queue = &process->task_queue;
+  SYNCHRONIZED(queue->lock, { task = _task_queue_pop(queue); });
   return task;
 }
 
-inline void process_enqueue_task(Process *process, Task *task) {
-  SYNCHRONIZED(process->task_queue_lock,
-               { *Q_add_last(&process->queued_tasks) = task; });
+void _process_push_task(Process *process, Task *task) {
+  task->_queue_seq = atomic_fetch_add(&process->next_queue_seq, 1);
+  TaskQueue *queue = &process->task_queue;
+  SYNCHRONIZED(queue->lock,
+               { _task_heap_push(&queue->queues[task->priority], task); });
+  process_wake(process);
+}
+
+void process_enqueue_task(Process *process, Task *task) {
+  atomic_fetch_add(&process->num_live_tasks, 1);
+  _process_push_task(process, task);
+}
+
+void process_resume_task(Process *process, Task *task) {
+  process_remove_waiting_task(process, task);
+  // Still live, it only moves from waiting to queued.
+  _process_push_task(process, task);
+}
+
+void process_retire_task(Process *process) {
+  atomic_fetch_sub(&process->num_live_tasks, 1);
+}
+
+bool process_is_done(Process *process) {
+  return 0 == atomic_load(&process->num_live_tasks);
+}
+
+bool process_is_finished(Process *process) {
+  return process_is_done(process) &&
+         0 == atomic_load(&process->num_pending_completions);
+}
+
+bool process_has_work(Process *process) {
+  return !mpsc_queue_is_empty(&process->completions) ||
+         process_queue_size(process) > 0;
+}
+
+void process_wake(Process *process) {
+  if (NULL != process->wake_fn) {
+    process->wake_fn(process);
+    return;
+  }
+  // process_run() checks for work under task_waiting_lock before it waits.
+  SYNCHRONIZED(process->task_waiting_lock,
+               { mutex_condition_broadcast(process->task_wait_cond); });
+}
+
+void process_post_completion(Process *process, Task *task) {
+  mpsc_queue_push(&process->completions, &task->_completion_node);
+  process_wake(process);
+}
+
+void process_expect_completion(Process *process) {
+  atomic_fetch_add(&process->num_pending_completions, 1);
+}
+
+void process_drop_completion(Process *process) {
+  atomic_fetch_sub(&process->num_pending_completions, 1);
+}
+
+Task *process_pop_completion(Process *process) {
+  MpscNode *node = mpsc_queue_pop(&process->completions);
+  if (NULL == node) {
+    return NULL;
+  }
+  process_drop_completion(process);
+  return MPSC_ITEM(node, Task, _completion_node);
 }
 
 size_t process_queue_size(Process *process) {
   size_t size;
-  SYNCHRONIZED(process->task_queue_lock,
-               { size = Q_size(&process->queued_tasks); });
+  TaskQueue *queue = &process->task_queue;
+  SYNCHRONIZED(queue->lock, { size = _task_queue_size(queue); });
   return size;
 }
 
+void process_for_each_queued_task(Process *process,
+                                  void (*fn)(Task *, void *), void *arg) {
+  TaskQueue *queue = &process->task_queue;
+  mutex_lock(queue->lock);
+  int priority;
+  uint32_t i;
+  for (priority = 0; priority < NUM_TASK_PRIORITIES; ++priority) {
+    TaskHeap *heap = &queue->queues[priority];
+    for (i = 0; i < heap->size; ++i) {
+      fn(heap->tasks[i], arg);
+    }
+  }
+  mutex_unlock(queue->lock);
+}
+
+void process_for_each_waiting_task(Process *process,
+                                   void (*fn)(Task *, void *), void *arg) {
+  Task *task;
+  for (task = process->waiting_tasks; NULL != task;
+       task = task->_next_waiting) {
+    fn(task, arg);
+  }
+}
+
 inline void process_insert_waiting_task(Process *process, Task *task) {
-  SYNCHRONIZED(process->task_waiting_lock,
-               { set_insert(&process->waiting_tasks, task); });
+  task->_prev_waiting = NULL;
+  task->_next_waiting = process->waiting_tasks;
+  if (NULL != process->waiting_tasks) {
+    process->waiting_tasks->_prev_waiting = task;
+  }
+  process->waiting_tasks = task;
 }
 
 inline void process_remove_waiting_task(Process *process, Task *task) {
-  SYNCHRONIZED(process->task_waiting_lock,
-               { set_remove(&process->waiting_tasks, task); });
+  if (NULL != task->_prev_waiting) {
+    task->_prev_waiting->_next_waiting = task->_next_waiting;
+  } else if (process->waiting_tasks == task) {
+    process->waiting_tasks = task->_next_waiting;
+  } else {
+    // Not waiting.
+    return;
+  }
+  if (NULL != task->_next_waiting) {
+    task->_next_waiting->_prev_waiting = task->_prev_waiting;
+  }
+  task->_prev_waiting = NULL;
+  task->_next_waiting = NULL;
 }
 
 inline void process_mark_task_complete(Process *process, Task *task) {
-  SYNCHRONIZED(process->task_complete_lock,
-               { set_insert(&process->completed_tasks, task); });
-}
\ No newline at end of file
+  set_insert(&process->completed_tasks, task);
+}
+
+void process_complete_task(Process *process, Task *task, bool is_error) {
+  process_mark_task_complete(process, task);
+  // Only requeue dependent tasks that are waiting.
+  M_iter dependent_tasks = set_iter(&task->dependent_tasks);
+  for (; has(&dependent_tasks); inc(&dependent_tasks)) {
+    Task *dependent_task = (Task *)value(&dependent_tasks);
+    if (NULL != dependent_task->on_dependency_complete) {
+      dependent_task->on_dependency_complete(dependent_task, task);
+      continue;
+    }
+    if (TASK_WAITING != dependent_task->state) {
+      continue;
+    }
+    dependent_task->waiting_on = NULL;
+    *task_mutable_resval(dependent_task) = *task_get_resval(task);
+    if (is_error) {
+      dependent_task->child_task_has_error = true;
+    }
+    process_resume_task(dependent_task->parent_process, dependent_task);
+  }
+}
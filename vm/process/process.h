@@ -6,19 +6,60 @@
 #ifndef VM_PROCESS_PROCESS_H_
 #define VM_PROCESS_PROCESS_H_
 
+#include <stdbool.h>
+
 #include "vm/process/processes.h"
 
 void process_init(Process *process);
 void process_finalize(Process *process);
+// Throws away everything on a Process that is done so it can be reused: its
+// heap, tasks and contexts. The new heap gets [limits]. Must be called by the
+// heap owner.
+void process_reset(Process *process, const HeapLimits *limits);
 Task *process_create_unqueued_task(Process *process);
 Task *process_create_task(Process *process);
 
+// Takes the next task to run. Returns NULL if no task is queued.
 Task *process_pop_task(Process *process);
+// Queues a new task. It counts as live until process_retire_task().
 void process_enqueue_task(Process *process, Task *task);
+// Moves a waiting task back onto the queue.
+void process_resume_task(Process *process, Task *task);
+// Called once a task run ends in anything other than waiting.
+void process_retire_task(Process *process);
+// Whether no task is queued, running or waiting.
+bool process_is_done(Process *process);
+// Whether the Process is done and no other thread can still post to it, so
+// it can be reset or freed.
+bool process_is_finished(Process *process);
+// Whether a task is queued or a completion is posted.
+bool process_has_work(Process *process);
+// Wakes process_run() if it is idle, or the Process itself if the Scheduler
+// has it parked.
+void process_wake(Process *process);
 size_t process_queue_size(Process *process);
+void process_for_each_queued_task(Process *process,
+                                  void (*fn)(Task *, void *), void *arg);
+
+// Called by the heap owner when it hands work to another thread that will
+// post a completion for it. Counted until the completion is popped.
+void process_expect_completion(Process *process);
+// For expected completions that will now never be posted.
+void process_drop_completion(Process *process);
+// Hands [task], which finished on another thread, to the heap owner. Safe to
+// call from any thread.
+void process_post_completion(Process *process, Task *task);
+// Must be called by the heap owner. Returns NULL if none is ready.
+Task *process_pop_completion(Process *process);
 
+// The waiting list and completed tasks are only touched by the heap owner.
+void process_for_each_waiting_task(Process *process,
+                                   void (*fn)(Task *, void *), void *arg);
 void process_insert_waiting_task(Process *process, Task *task);
 void process_remove_waiting_task(Process *process, Task *task);
 void process_mark_task_complete(Process *process, Task *task);
+// Records [task] as complete and resumes the tasks waiting on it with its
+// result. With [is_error], the result is an Error raised in each of them.
+void process_complete_task(Process *process, Task *task, bool is_error);
 
 #endif /* VM_PROCESS_PROCESS_H_ */
\ No newline at end of file
@@ -12,6 +12,7 @@
 #include "program/tape.h"
 #include "struct/alist.h"
 #include "struct/set.h"
+#include "util/sync/mpsc_queue.h"
 #include "util/sync/mutex.h"
 #include "util/sync/thread.h"
 
@@ -44,6 +45,15 @@ typedef enum {
   TASK_ERROR,
 } TaskState;
 
+// Scheduling class of a task. Lower values run first.
+typedef enum {
+  TASK_PRIORITY_HIGH,
+  TASK_PRIORITY_NORMAL,
+  TASK_PRIORITY_LOW,
+} TaskPriority;
+
+#define NUM_TASK_PRIORITIES 3
+
 typedef enum {
   NOT_WAITING,
   WAITING_TO_START,
@@ -68,9 +78,79 @@ struct __Task {
   bool child_task_has_error;
   bool is_finalized;
 
+  // Set when the task is created and inherited by the tasks it starts.
+  TaskPriority priority;
+  // Monotonic ms by which the task should run, or 0 for none. Within a
+  // priority, tasks with the earliest deadline run first.
+  uint64_t deadline_ms;
+  // Order in which the task was last queued, so tasks without a deadline run
+  // first in, first out.
+  uint64_t _queue_seq;
+
+  // The task this one waits on while it is TASK_WAITING.
+  Task *waiting_on;
+
+  // Set by Future.cancel(). Background natives read it from other threads to
+  // give up on what they are doing.
+  atomic_bool is_cancelled;
+  // The Cancelled error raised in this task at its next scheduling point.
+  Object *cancel_error;
+  bool is_cancel_raised;
+
+  // Set on tasks that never run, like the ones behind async.all(). Called
+  // instead of resuming this task when a task it waits on completes.
+  void (*on_dependency_complete)(Task *task, Task *dependency);
+  void *dependency_arg;
+  // Set on unqueued tasks finished on behalf of this Process by another one.
+  // Called by the heap owner when the task is drained from the completions,
+  // instead of completing it.
+  void (*on_completion_drained)(Task *task);
+  // Called when a task that never runs is cancelled, before it fails, to stop
+  // whatever would have completed it.
+  void (*on_cancel)(Task *task);
+
+  // Links in the Process's list of waiting tasks.
+  Task *_prev_waiting, *_next_waiting;
+  // Links in the Process's queue of tasks completed on other threads.
+  MpscNode _completion_node;
+
+  // The call a background native makes for this task, kept here instead of in
+  // a separate allocation.
+  const Function *_background_fn;
+  Context *_background_ctx;
+  Object *_background_self;
+  // Set while the native runs on _background_thread, so cancelling the task
+  // can interrupt it. Cleared under VM.interrupt_lock.
+  atomic_bool _in_background;
+  ThreadHandle _background_thread;
+
   Object *_reflection;
 };
 
+// Binary min-heap of tasks ordered by deadline, then by _queue_seq.
+typedef struct {
+  Task **tasks;
+  uint32_t size;
+  uint32_t capacity;
+} TaskHeap;
+
+// Runnable tasks of a Process, one heap per priority.
+typedef struct {
+  Mutex lock;
+  TaskHeap queues[NUM_TASK_PRIORITIES];
+  // Pops so far, and the pop on which each priority was last served. Used to
+  // keep lower priorities from starving.
+  uint64_t num_pops;
+  uint64_t last_served[NUM_TASK_PRIORITIES];
+} TaskQueue;
+
+// Where a Process run by the VM's Scheduler is. See vm/scheduler.h.
+typedef enum {
+  PROCESS_PARKED,
+  PROCESS_RUNNABLE,
+  PROCESS_RUNNING,
+} ProcessSchedState;
+
 struct __Process {
   VM *vm;
   Heap *heap;
@@ -78,20 +158,51 @@ struct __Process {
   __Arena task_arena;
   __Arena context_arena;
   Mutex task_create_lock;
-  Mutex task_queue_lock;
+  // Held by whichever thread is executing bytecode. Heaps and tasks are not
+  // thread-safe, so they are only touched by the holder of this lock. This
+  // includes the list of waiting tasks and completed_tasks.
+  Mutex heap_owner_lock;
 
+  // Guards the main Process going idle on task_wait_cond.
   Mutex task_waiting_lock;
   Condition *task_wait_cond;
 
-  Mutex task_complete_lock;
-
   Task *current_task;
-  Q queued_tasks;
-  Set waiting_tasks;
+  TaskQueue task_queue;
+  // Tasks that are queued, running or waiting. The Process is done when this
+  // reaches 0.
+  atomic_uint_fast32_t num_live_tasks;
+  // Work handed to other threads, like background natives, socket ops, timers
+  // and file ops, whose completions have not been drained yet.
+  atomic_uint_fast32_t num_pending_completions;
+  // Background natives of this Process still running on a pool thread. They
+  // may be reading String storage, so the GC's string dedup pass waits until
+  // none are.
+  atomic_uint_fast32_t num_background_calls;
+  // Source of Task._queue_seq.
+  atomic_uint_fast64_t next_queue_seq;
+  // Head of the intrusive list of waiting tasks.
+  Task *waiting_tasks;
+  // Tasks completed off the heap owner's thread, e.g. by background natives.
+  // They are marked complete by the next heap owner.
+  MpscQueue completions;
   Set completed_tasks;
 
+  // Storage released by String.intern() and the GC's string dedup pass.
+  uint32_t strings_interned;
+  uint32_t strings_deduped;
+  uint64_t string_bytes_saved;
+
+  // Changed under the Scheduler's lock, but read without it so waking a
+  // Process that is not parked stays off that lock. Unused by the main
+  // Process.
+  _Atomic ProcessSchedState sched_state;
+  // Set by scheduler_retire(), guarded by the Scheduler's lock.
+  bool is_retired;
+  // Called after a task is enqueued, if set.
+  void (*wake_fn)(Process *);
+
   Object *_reflection;
-  ThreadHandle thread;  // Null if main thread.
 };
 
 #endif /* VM_PROCESS_PROCESSES_H_ */
\ No newline at end of file
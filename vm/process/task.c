@@ -38,6 +38,23 @@ void task_init(Task *task) {
   task->current = NULL;
   task->_reflection = NULL;
   task->is_finalized = false;
+  task->_prev_waiting = NULL;
+  task->_next_waiting = NULL;
+  task->on_dependency_complete = NULL;
+  task->dependency_arg = NULL;
+  task->on_completion_drained = NULL;
+  task->on_cancel = NULL;
+  task->_background_fn = NULL;
+  task->_background_ctx = NULL;
+  task->_background_self = NULL;
+  atomic_init(&task->_in_background, false);
+  task->waiting_on = NULL;
+  atomic_init(&task->is_cancelled, false);
+  task->cancel_error = NULL;
+  task->is_cancel_raised = false;
+  task->priority = TASK_PRIORITY_NORMAL;
+  task->deadline_ms = 0;
+  task->_queue_seq = 0;
 }
 
 void task_finalize(Task *task) {
@@ -106,3 +123,15 @@ inline Entity *task_pushstack(Task *task) {
 inline const Entity *task_get_resval(Task *task) { return &task->resval; }
 
 inline Entity *task_mutable_resval(Task *task) { return &task->resval; }
+
+inline bool task_is_cancelled(Task *task) {
+  return atomic_load(&task->is_cancelled);
+}
+
+Object *task_take_cancel_error(Task *task) {
+  if (NULL == task->cancel_error || task->is_cancel_raised) {
+    return NULL;
+  }
+  task->is_cancel_raised = true;
+  return task->cancel_error;
+}
@@ -27,4 +27,11 @@ Entity *task_pushstack(Task *task);
 const Entity *task_get_resval(Task *task);
 Entity *task_mutable_resval(Task *task);
 
+// Whether the task has been cancelled. Safe to call from any thread, e.g. by a
+// background native after its blocking call was interrupted.
+bool task_is_cancelled(Task *task);
+// Returns the Cancelled error the first time it is called on a cancelled task,
+// otherwise NULL.
+Object *task_take_cancel_error(Task *task);
+
 #endif /* VM_PROCESS_TASK_H_ */
\ No newline at end of file
@@ -0,0 +1,155 @@
+// scheduler.c
+//
+// Created on: Oct 18, 2026
+//     Author: Jeff Manzione
+
+#include "vm/scheduler.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "alloc/alloc.h"
+#include "debug/debug.h"
+#include "struct/q.h"
+#include "util/sync/mutex.h"
+#include "util/sync/thread.h"
+#include "vm/process/process.h"
+
+struct _Scheduler {
+  ProcessSliceFn run_slice;
+  ProcessDeleteFn delete_process;
+  uint32_t num_threads;
+  ThreadHandle *threads;
+
+  // Guards runnable, is_shutdown and changes to the sched_state of every
+  // Process.
+  Mutex lock;
+  Condition *runnable_cond;
+  Q runnable;
+  bool is_shutdown;
+};
+
+Process *_scheduler_next(Scheduler *scheduler) {
+  Process *process = NULL;
+  SYNCHRONIZED(scheduler->lock, {
+    while (!scheduler->is_shutdown && Q_is_empty(&scheduler->runnable)) {
+      mutex_condition_wait(scheduler->runnable_cond);
+    }
+    if (!scheduler->is_shutdown) {
+      process = (Process *)Q_pop(&scheduler->runnable);
+      atomic_store(&process->sched_state, PROCESS_RUNNING);
+    }
+  });
+  return process;
+}
+
+void _scheduler_after_slice(Scheduler *scheduler, Process *process) {
+  bool is_deleted = false;
+  SYNCHRONIZED(scheduler->lock, {
+    if (process_has_work(process)) {
+      // Go to the back of the line so other Processes get a turn.
+      atomic_store(&process->sched_state, PROCESS_RUNNABLE);
+      *Q_add_last(&scheduler->runnable) = process;
+    } else if (process->is_retired && process_is_finished(process)) {
+      // Left RUNNING, so nothing can make it runnable again.
+      is_deleted = true;
+    } else {
+      // Parked before looking for work again. Wakes that still saw it
+      // RUNNING added their work before this second look, and later ones
+      // see it parked and take the lock after this block.
+      atomic_store(&process->sched_state, PROCESS_PARKED);
+      atomic_thread_fence(memory_order_seq_cst);
+      if (process_has_work(process)) {
+        atomic_store(&process->sched_state, PROCESS_RUNNABLE);
+        *Q_add_last(&scheduler->runnable) = process;
+      }
+    }
+  });
+  if (is_deleted) {
+    scheduler->delete_process(process);
+  }
+}
+
+void *_scheduler_run(void *ptr) {
+  Scheduler *scheduler = (Scheduler *)ptr;
+  Process *process;
+  while (NULL != (process = _scheduler_next(scheduler))) {
+    scheduler->run_slice(process);
+    _scheduler_after_slice(scheduler, process);
+  }
+  return NULL;
+}
+
+Scheduler *scheduler_create(uint32_t num_threads, ProcessSliceFn run_slice,
+                            ProcessDeleteFn delete_process) {
+  ASSERT(num_threads > 0, NOT_NULL(run_slice), NOT_NULL(delete_process));
+  Scheduler *scheduler = ALLOC2(Scheduler);
+  scheduler->run_slice = run_slice;
+  scheduler->delete_process = delete_process;
+  scheduler->num_threads = num_threads;
+  scheduler->lock = mutex_create();
+  scheduler->runnable_cond = mutex_condition(scheduler->lock);
+  Q_init(&scheduler->runnable);
+  scheduler->is_shutdown = false;
+  scheduler->threads = ALLOC_ARRAY2(ThreadHandle, num_threads);
+  uint32_t i;
+  for (i = 0; i < num_threads; ++i) {
+    scheduler->threads[i] =
+        thread_create(AS_VOID_FN(_scheduler_run), scheduler);
+  }
+  return scheduler;
+}
+
+void scheduler_delete(Scheduler *scheduler) {
+  ASSERT(NOT_NULL(scheduler));
+  SYNCHRONIZED(scheduler->lock, {
+    scheduler->is_shutdown = true;
+    mutex_condition_broadcast(scheduler->runnable_cond);
+  });
+  // Like the background pool, Processes still running are abandoned.
+  uint32_t i;
+  for (i = 0; i < scheduler->num_threads; ++i) {
+    thread_close(scheduler->threads[i]);
+  }
+  DEALLOC(scheduler->threads);
+  Q_finalize(&scheduler->runnable);
+  mutex_condition_delete(scheduler->runnable_cond);
+  mutex_close(scheduler->lock);
+  DEALLOC(scheduler);
+}
+
+void scheduler_wake(Scheduler *scheduler, Process *process) {
+  ASSERT(NOT_NULL(scheduler), NOT_NULL(process));
+  // Orders the work just added before the load, pairing with the Process
+  // parking before its last look for work in _scheduler_after_slice().
+  atomic_thread_fence(memory_order_seq_cst);
+  // Most wakes find the Process already runnable or running.
+  if (PROCESS_PARKED != atomic_load(&process->sched_state)) {
+    return;
+  }
+  SYNCHRONIZED(scheduler->lock, {
+    if (PROCESS_PARKED == atomic_load(&process->sched_state)) {
+      atomic_store(&process->sched_state, PROCESS_RUNNABLE);
+      *Q_add_last(&scheduler->runnable) = process;
+      mutex_condition_signal(scheduler->runnable_cond);
+    }
+  });
+}
+
+void scheduler_retire(Scheduler *scheduler, Process *process) {
+  ASSERT(NOT_NULL(scheduler), NOT_NULL(process));
+  SYNCHRONIZED(scheduler->lock, {
+    process->is_retired = true;
+    // A parked Process gets one more slice, after which it is deleted if it
+    // is done.
+    if (PROCESS_PARKED == atomic_load(&process->sched_state)) {
+      atomic_store(&process->sched_state, PROCESS_RUNNABLE);
+      *Q_add_last(&scheduler->runnable) = process;
+      mutex_condition_signal(scheduler->runnable_cond);
+    }
+  });
+}
+
+LockStats scheduler_lock_stats(Scheduler *scheduler) {
+  return mutex_stats(scheduler->lock);
+}
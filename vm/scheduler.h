@@ -0,0 +1,43 @@
+// scheduler.h
+//
+// Created on: Oct 18, 2026
+//     Author: Jeff Manzione
+//
+// Multiplexes Processes onto a fixed pool of threads. A Process with queued
+// tasks is runnable and is picked up by the next free thread, which runs a
+// slice of its tasks. A Process with nothing queued is parked and holds no
+// thread until a task is enqueued on it again.
+//
+// A Process is only ever run by one thread at a time, so its tasks never run
+// in parallel with each other. Work is spread across cores by running it in
+// several Processes.
+
+#ifndef VM_SCHEDULER_H_
+#define VM_SCHEDULER_H_
+
+#include <stdint.h>
+
+#include "util/sync/mutex.h"
+#include "vm/process/processes.h"
+
+typedef struct _Scheduler Scheduler;
+
+// Runs some of the queued tasks of [process]. Called on a scheduler thread,
+// never on more than one thread for the same Process at a time.
+typedef void (*ProcessSliceFn)(Process *process);
+// Frees a retired Process once it is done. Called on a scheduler thread.
+typedef void (*ProcessDeleteFn)(Process *process);
+
+Scheduler *scheduler_create(uint32_t num_threads, ProcessSliceFn run_slice,
+                            ProcessDeleteFn delete_process);
+void scheduler_delete(Scheduler *scheduler);
+
+// Makes [process] runnable if it is parked. Safe to call from any thread.
+void scheduler_wake(Scheduler *scheduler, Process *process);
+// Has [process] deleted once it has nothing queued, running or waiting.
+// Nothing but the work it already has may be added to it afterwards.
+void scheduler_retire(Scheduler *scheduler, Process *process);
+
+LockStats scheduler_lock_stats(Scheduler *scheduler);
+
+#endif /* VM_SCHEDULER_H_ */
@@ -7,6 +7,7 @@
 
 #include <stdarg.h>
 
+#include "alloc/alloc.h"
 #include "alloc/arena/intern.h"
 #include "entity/array/array.h"
 #include "entity/class/classes.h"
@@ -30,7 +31,11 @@
 #include "vm/process/processes.h"
 #include "vm/process/task.h"
 
-#define DEFAULT_THREADPOOL_SIZE 6
+#define DEFAULT_IO_THREADS 6
+// Max tasks a scheduler thread runs before moving on to another Process.
+#define PROCESS_SLICE_TASKS 64
+// Size of the io_uring submission queue.
+#define URING_ENTRIES 256
 
 bool _call_function_base(Task *task, Context *context, const Function *func,
                          Object *self, Context *parent_context);
@@ -297,9 +302,18 @@ void _add_filename_method(VM *vm) {
 
 VM *vm_create(const char *lib_location) {
   VM *vm = ALLOC2(VM);
-  alist_init(&vm->processes, Process, DEFAULT_ARRAY_SZ);
+  alist_init(&vm->processes, Process *, DEFAULT_ARRAY_SZ);
   vm->process_create_lock = mutex_create();
-  vm->background_pool = threadpool_create(DEFAULT_THREADPOOL_SIZE);
+  vm->io_pool = threadpool_create(DEFAULT_IO_THREADS);
+  vm->cpu_pool = threadpool_create(thread_num_processors());
+  vm->interrupt_lock = mutex_create();
+  vm->timers = timer_wheel_create();
+  vm->reactor = reactor_create();
+  vm->uring = uring_create(URING_ENTRIES);
+  vm->heap_limits.max_objects = 0;
+  vm->heap_limits.max_bytes = 0;
+  vm->scheduler = NULL;
+  vm->scheduler_threads = 0;
   vm->main = create_process_no_reflection(vm);
   modulemanager_init(&vm->mm, vm->main->heap);
   register_builtin(&vm->mm, vm->main->heap, lib_location);
@@ -312,14 +326,28 @@ VM *vm_create(const char *lib_location) {
 
 void vm_delete(VM *vm) {
   ASSERT(NOT_NULL(vm));
+  // Timers, the reactor and the ring wake processes, so stop them first.
+  timer_wheel_delete(vm->timers);
+  if (NULL != vm->reactor) {
+    reactor_delete(vm->reactor);
+  }
+  if (NULL != vm->uring) {
+    uring_delete(vm->uring);
+  }
+  if (NULL != vm->scheduler) {
+    scheduler_delete(vm->scheduler);
+  }
   AL_iter iter = alist_iter(&vm->processes);
   for (; al_has(&iter); al_inc(&iter)) {
-    Process *proc = (Process *)al_value(&iter);
+    Process *proc = *(Process **)al_value(&iter);
     process_finalize(proc);
+    DEALLOC(proc);
   }
   alist_finalize(&vm->processes);
   mutex_close(vm->process_create_lock);
-  threadpool_delete(vm->background_pool);
+  threadpool_delete(vm->io_pool);
+  threadpool_delete(vm->cpu_pool);
+  mutex_close(vm->interrupt_lock);
   modulemanager_finalize(&vm->mm);
   DEALLOC(vm);
 }
@@ -408,9 +436,9 @@ inline void _execute_RES(VM *vm, Task *task, Context *context,
     *task_mutable_resval(task) = entity_primitive(ins->val);
     break;
   case INSTRUCTION_STRING:
-    str = heap_new(task->parent_process->heap, Class_String);
     // TODO: Maybe precompute the length of the string?
-    __string_init(str, ins->str + 1, strlen(ins->str) - 2);
+    str = string_new(task->parent_process->heap, ins->str + 1,
+                     strlen(ins->str) - 2);
     *task_mutable_resval(task) = entity_object(str);
     break;
   default:
@@ -461,9 +489,9 @@ inline void _execute_PUSH(VM *vm, Task *task, Context *context,
     *task_pushstack(task) = entity_primitive(ins->val);
     break;
   case INSTRUCTION_STRING:
-    str = heap_new(task->parent_process->heap, Class_String);
     // TODO: Maybe precompute the length of the string?
-    __string_init(str, ins->str + 1, strlen(ins->str) - 2);
+    str = string_new(task->parent_process->heap, ins->str + 1,
+                     strlen(ins->str) - 2);
     *task_pushstack(task) = entity_object(str);
     break;
   default:
@@ -501,6 +529,11 @@ inline void _execute_FLD(VM *vm, Task *task, Context *context,
     return;
   }
   Entity obj = task_popstack(task);
+  if (object_is_frozen(resval->obj)) {
+    raise_error(task, context, "Cannot set field '%s' on a frozen object.",
+                ins->id);
+    return;
+  }
   object_set_member(task->parent_process->heap, resval->obj, ins->id, &obj);
 }
 
@@ -519,7 +552,11 @@ inline void _execute_SET(VM *vm, Task *task, Context *context,
                          const Instruction *ins) {
   switch (ins->type) {
   case INSTRUCTION_ID:
-    context_set(context, ins->id, task_get_resval(context->parent_task));
+    if (!context_set(context, ins->id,
+                     task_get_resval(context->parent_task))) {
+      raise_error(task, context, "Cannot set field '%s' on a frozen object.",
+                  ins->id);
+    }
     break;
   default:
     ERROR("Invalid arg type=%d for SET.", ins->type);
@@ -558,31 +595,56 @@ inline void _execute_GTSH(VM *vm, Task *task, Context *context,
 
 Context *_execute_as_new_task(Task *task, Object *self, Module *m,
                               uint32_t ins_pos) {
-  Task *new_task = process_create_task(task->parent_process);
+  Task *new_task = process_create_unqueued_task(task->parent_process);
   new_task->parent_task = task;
+  // Set before queueing so the task lands in the right place.
+  new_task->priority = task->priority;
+  new_task->deadline_ms = task->deadline_ms;
+  process_enqueue_task(task->parent_process, new_task);
   Context *ctx = task_create_context(new_task, self, m, ins_pos);
   *task_mutable_resval(new_task) = *task_get_resval(task);
   return ctx;
 }
 
-typedef struct {
-  Task *task;
-  Context *context;
-  const Function *func;
-  Object *self;
-} BackgroundThreadArgs;
-
-void _execute_in_background(BackgroundThreadArgs *args) {
-  NativeFn native_fn = (NativeFn)args->func->_native_fn;
-  *task_mutable_resval(args->task) =
-      native_fn(args->task, args->context, args->self,
-                (Entity *)task_get_resval(args->task));
+void _execute_in_background(Task *task) {
+  NativeFn native_fn = (NativeFn)task->_background_fn->_native_fn;
+  task->_background_thread = thread_self();
+  atomic_store(&task->_in_background, true);
+  // Cancelled before it started.
+  if (!task_is_cancelled(task)) {
+    *task_mutable_resval(task) =
+        native_fn(task, task->_background_ctx, task->_background_self,
+                  (Entity *)task_get_resval(task));
+  }
+  SYNCHRONIZED(task->parent_process->vm->interrupt_lock,
+               { atomic_store(&task->_in_background, false); });
+  atomic_fetch_sub(&task->parent_process->num_background_calls, 1);
 }
 
-void _execute_in_background_callback(BackgroundThreadArgs *args) {
-  args->task->state = TASK_COMPLETE;
-  _mark_task_complete(args->task->parent_process, args->task);
-  DEALLOC(args);
+void _execute_in_background_callback(Task *task) {
+  // Waking dependents touches their stacks, so leave it to the heap owner
+  // instead of waiting for it here.
+  process_post_completion(task->parent_process, task);
+}
+
+Object *vm_call_in_background(Task *task, Context *context,
+                              const Function *func, Object *self,
+                              const Entity *args) {
+  ASSERT(func->_is_background, func->_is_async);
+  Task *new_task = process_create_unqueued_task(task->parent_process);
+  new_task->parent_task = task;
+  *task_mutable_resval(new_task) = *args;
+  new_task->_background_fn = func;
+  new_task->_background_ctx = context;
+  new_task->_background_self = self;
+  Object *future = future_create(new_task);
+  process_expect_completion(task->parent_process);
+  atomic_fetch_add(&task->parent_process->num_background_calls, 1);
+  threadpool_execute(
+      vm_background_pool(task->parent_process->vm, func->_background_pool),
+      (VoidFnPtr)_execute_in_background,
+      (VoidFnPtr)_execute_in_background_callback, (VoidPtr)new_task);
+  return future;
 }
 
 // VERY IMPORTANT: context is only necessary for native functions!
@@ -594,20 +656,8 @@ bool _call_function_base(Task *task, Context *context, const Function *func,
       ERROR("Invalid native function.");
     }
     if (func->_is_background) {
-      Task *new_task = process_create_unqueued_task(task->parent_process);
-      new_task->parent_task = task;
-      ASSERT(func->_is_async);
-      *task_mutable_resval(new_task) = *task_get_resval(task);
-      *task_mutable_resval(task) = entity_object(future_create(new_task));
-      BackgroundThreadArgs *args = ALLOC2(BackgroundThreadArgs);
-      args->task = new_task;
-      args->context = context;
-      args->func = func;
-      args->self = self;
-      threadpool_execute(task->parent_process->vm->background_pool,
-                         (VoidFnPtr)_execute_in_background,
-                         (VoidFnPtr)_execute_in_background_callback,
-                         (VoidPtr)args);
+      *task_mutable_resval(task) = entity_object(vm_call_in_background(
+          task, context, func, self, task_get_resval(task)));
       return false;
     }
     *task_mutable_resval(task) =
@@ -626,6 +676,7 @@ bool _call_function_base(Task *task, Context *context, const Function *func,
     return false;
   }
   set_insert(&fn_ctx->parent_task->dependent_tasks, task);
+  task->waiting_on = fn_ctx->parent_task;
   return true;
 }
 
@@ -735,13 +786,24 @@ bool _execute_WAIT(VM *vm, Task *task, Context *context,
       Class_Future != resval->obj->_class) {
     return false;
   }
+  // Waiting is where a cancelled task finds out.
+  Object *cancel_error = task_take_cancel_error(task);
+  if (NULL != cancel_error) {
+    raise_error_with_object(task, context, cancel_error);
+    return false;
+  }
   Future *future = (Future *)resval->obj->_internal_obj;
   if (!future_is_complete(future)) {
     set_insert(&future_get_task(future)->dependent_tasks, task);
+    task->waiting_on = future_get_task(future);
     return true;
   }
+  Object *future_obj = resval->obj;
   *task_mutable_resval(task) =
-      *future_get_value(task->parent_process->heap, resval->obj);
+      *future_get_value(task->parent_process->heap, future_obj);
+  if (future_is_error(future)) {
+    raise_error_with_object(task, context, task_get_resval(task)->obj);
+  }
   return false;
 }
 
@@ -936,6 +998,10 @@ bool _execute_ASET(VM *vm, Task *task, Context *context,
   }
 
   if (Class_Array == arr_entity.obj->_class) {
+    if (object_is_frozen(arr_entity.obj)) {
+      raise_error(task, context, "Cannot modify a frozen Array.");
+      return false;
+    }
     if (NULL == index || PRIMITIVE != index->type ||
         INT != ptype(&index->pri)) {
       raise_error(task, context, "Cannot index with non-int.");
@@ -1095,6 +1161,7 @@ bool _execute_LMDL(VM *vm, Task *task, Context *context,
   }
   Context *new_ctx = _execute_as_new_task(task, module->_reflection, module, 0);
   set_insert(&new_ctx->parent_task->dependent_tasks, task);
+  task->waiting_on = new_ctx->parent_task;
   return true;
 }
 
@@ -1131,6 +1198,25 @@ bool _attemp_catch_error(Task *task, Context *ctx) {
   return true;
 }
 
+// Called between instructions once an allocation has pushed the process heap
+// over its budget, so every live object is reachable from the task.
+void _enforce_heap_budget(Task *task, Context *context) {
+  Heap *heap = task->parent_process->heap;
+  collect_garbage(task->parent_process);
+  if (!heap_over_budget(heap)) {
+    return;
+  }
+  HeapUsage usage;
+  heap_usage(heap, &usage);
+  // Neither the error nor whatever handles it may trip the budget again
+  // before the heap is back under it.
+  heap_hold_budget(heap);
+  raise_error(task, context,
+              "Out of memory: process heap is over its budget with %u "
+              "objects and %llu bytes live.",
+              usage.num_objects, (unsigned long long)usage.num_bytes);
+}
+
 // Please forgive me father, for I have sinned.
 TaskState vm_execute_task(VM *vm, Task *task) {
   task->state = TASK_RUNNING;
@@ -1141,12 +1227,16 @@ TaskState vm_execute_task(VM *vm, Task *task) {
   }
   Context *context = task->current;
 
+  Object *cancel_error;
   if (task->child_task_has_error) {
     const Entity *error_e = task_get_resval(task);
     ASSERT(NOT_NULL(error_e), OBJECT == error_e->type,
-           Class_Error == error_e->obj->_class);
+           inherits_from(error_e->obj->_class, Class_Error));
     context->error = error_e->obj;
     task->child_task_has_error = false;
+  } else if (NULL != (cancel_error = task_take_cancel_error(task))) {
+    // Cancelled before it started or while it was queued.
+    raise_error_with_object(task, context, cancel_error);
   }
   for (;;) {
     if (NULL != context->error) {
@@ -1338,99 +1428,177 @@ TaskState vm_execute_task(VM *vm, Task *task) {
       ERROR("Unknown instruction: %s", op_to_str(ins->op));
     }
     context->ins++;
+    if (heap_take_budget_exceeded(task->parent_process->heap)) {
+      _enforce_heap_budget(task, context);
+    }
   }
 end_of_loop:
   return task->state;
 }
 
 void _mark_task_complete(Process *process, Task *task) {
-  process_mark_task_complete(process, task);
-  // Only requeue parent task if it is waiting.
-  M_iter dependent_tasks = set_iter(&task->dependent_tasks);
-  for (; has(&dependent_tasks); inc(&dependent_tasks)) {
-    Task *dependent_task = (Task *)value(&dependent_tasks);
-    if (TASK_WAITING != dependent_task->state) {
+  process_complete_task(process, task, /*is_error=*/false);
+}
+
+// Marks tasks finished by background natives as complete. Must be called by
+// the heap owner.
+void _process_drain_completions(Process *process) {
+  Task *task;
+  while (NULL != (task = process_pop_completion(process))) {
+    if (NULL != task->on_completion_drained) {
+      task->on_completion_drained(task);
+      continue;
+    }
+    // Already finished by Future.cancel().
+    if (TASK_COMPLETE == task->state || TASK_ERROR == task->state) {
+      continue;
+    }
+    if (NULL != task->cancel_error) {
+      // Whatever the native returned is dropped.
+      *task_mutable_resval(task) = entity_object(task->cancel_error);
+      task->state = TASK_ERROR;
+      process_complete_task(process, task, /*is_error=*/true);
       continue;
     }
-    *task_mutable_resval(dependent_task) = *task_get_resval(task);
-    process_enqueue_task(dependent_task->parent_process, dependent_task);
-    process_remove_waiting_task(dependent_task->parent_process, dependent_task);
-    mutex_condition_broadcast(process->task_wait_cond);
+    task->state = TASK_COMPLETE;
+    _mark_task_complete(process, task);
   }
 }
 
-bool _process_is_done(Process *process) {
-  bool is_done = false;
-  SYNCHRONIZED(process->task_waiting_lock, {
-    SYNCHRONIZED(process->task_queue_lock, {
-      if (set_size(&process->waiting_tasks) == 0 &&
-          Q_size(&process->queued_tasks) == 0) {
-        is_done = true;
-      }
-    });
-  });
-  return is_done;
+void _process_run_task(Process *process, Task *task) {
+  process->current_task = task;
+  TaskState task_state = vm_execute_task(process->vm, task);
+#ifdef DEBUG
+  fprintf(stdout, "<-- ");
+  entity_print(task_get_resval(task), stdout);
+  fprintf(stdout, "\n");
+#endif
+  DEBUGF("TaskState=%s", task_state_str(task_state));
+  switch (task_state) {
+  case TASK_WAITING:
+    process_insert_waiting_task(process, task);
+    break;
+  case TASK_ERROR:
+    if (NULL != task->cancel_error && OBJECT == task_get_resval(task)->type &&
+        task_get_resval(task)->obj == task->cancel_error) {
+      // Only whoever waits on a cancelled task hears about it.
+      process_complete_task(process, task, /*is_error=*/true);
+    } else if (NULL == task->parent_task) {
+      Object *errorln = module_lookup(Module_io, intern("errorln"));
+      ASSERT(NOT_NULL(errorln), Class_Function == errorln->_class);
+      _call_function(task, (Context *)NULL, errorln->_function_obj);
+    } else {
+      task->parent_task->child_task_has_error = true;
+      _mark_task_complete(process, task);
+    }
+    break;
+  case TASK_COMPLETE:
+    _mark_task_complete(process, task);
+    break;
+  default:
+    ERROR("Some unknown TaskState.");
+  }
+  if (TASK_WAITING != task_state) {
+    process_retire_task(process);
+  }
+}
+
+// File I/O issued by tasks is queued on the VM's ring and handed to the
+// kernel in one batch per scheduling quantum.
+void _process_flush_io(Process *process) {
+  if (NULL != process->vm->uring) {
+    uring_flush(process->vm->uring);
+  }
 }
 
 void process_run(Process *process) {
-  VM *vm = process->vm;
-  Task *task;
-top_of_fn:
-  while (NULL != (task = process_pop_task(process))) {
-    process->current_task = task;
-    TaskState task_state = vm_execute_task(vm, task);
-#ifdef DEBUG
-    fprintf(stdout, "<-- ");
-    entity_print(task_get_resval(task), stdout);
-    fprintf(stdout, "\n");
-#endif
-    DEBUGF("TaskState=%s", task_state_str(task_state));
-    switch (task_state) {
-    case TASK_WAITING:
-      process_insert_waiting_task(process, task);
-      break;
-    case TASK_ERROR:
-      if (NULL == task->parent_task) {
-        Object *errorln = module_lookup(Module_io, intern("errorln"));
-        ASSERT(NOT_NULL(errorln), Class_Function == errorln->_class);
-        _call_function(task, (Context *)NULL, errorln->_function_obj);
-      } else {
-        task->parent_task->child_task_has_error = true;
-        _mark_task_complete(process, task);
+  uint32_t tasks_since_flush = 0;
+  for (;;) {
+    if (!mpsc_queue_is_empty(&process->completions)) {
+      SYNCHRONIZED(process->heap_owner_lock,
+                   { _process_drain_completions(process); });
+    }
+    Task *task = process_pop_task(process);
+    if (NULL != task) {
+      SYNCHRONIZED(process->heap_owner_lock,
+                   { _process_run_task(process, task); });
+      if (++tasks_since_flush >= PROCESS_SLICE_TASKS) {
+        _process_flush_io(process);
+        tasks_since_flush = 0;
       }
-      break;
-    case TASK_COMPLETE:
-      _mark_task_complete(process, task);
-      break;
-    default:
-      ERROR("Some unknown TaskState.");
+      continue;
+    }
+    _process_flush_io(process);
+    tasks_since_flush = 0;
+    bool is_done = false;
+    SYNCHRONIZED(process->task_waiting_lock, {
+      while (!(is_done = process_is_done(process)) &&
+             !process_has_work(process)) {
+        mutex_condition_wait(process->task_wait_cond);
+      }
+    });
+    if (is_done) {
+      return;
     }
   }
+}
 
-  if (_process_is_done(process)) {
-    return;
+// Runs up to PROCESS_SLICE_TASKS queued tasks on a scheduler thread, one at a
+// time like process_run() does for main. Tasks left waiting are resumed by
+// whoever completes what they wait on, which enqueues them and wakes the
+// process again.
+void _process_run_slice(Process *process) {
+  SYNCHRONIZED(process->heap_owner_lock,
+               { _process_drain_completions(process); });
+  Task *task;
+  int i;
+  for (i = 0; i < PROCESS_SLICE_TASKS &&
+              NULL != (task = process_pop_task(process));
+       ++i) {
+    SYNCHRONIZED(process->heap_owner_lock,
+                 { _process_run_task(process, task); });
   }
+  _process_flush_io(process);
+}
+
+void _process_wake(Process *process) {
+  scheduler_wake(process->vm->scheduler, process);
+}
 
-  int waiting_task_count;
-  SYNCHRONIZED(process->task_waiting_lock,
-               { waiting_task_count = set_size(&process->waiting_tasks); });
-  SYNCHRONIZED(process->task_waiting_lock, {
-    while (set_size(&process->waiting_tasks) != 0 &&
-           set_size(&process->waiting_tasks) == waiting_task_count &&
-           process_queue_size(process) == 0) {
-      mutex_condition_wait(process->task_wait_cond);
+// Called by the Scheduler once a retired Process is done.
+void _process_delete(Process *process) {
+  VM *vm = process->vm;
+  uint32_t i;
+  SYNCHRONIZED(vm->process_create_lock, {
+    uint32_t len = alist_len(&vm->processes);
+    for (i = 0; i < len; ++i) {
+      Process **slot = (Process **)alist_get(&vm->processes, i);
+      if (*slot == process) {
+        *slot = *(Process **)alist_get(&vm->processes, len - 1);
+        alist_remove_last(&vm->processes);
+        break;
+      }
     }
   });
-  goto top_of_fn;
+  process_finalize(process);
+  DEALLOC(process);
 }
 
-void *_process_run_return_void_ptr(void *ptr) {
-  ASSERT(NOT_NULL(ptr));
-  process_run((Process *)ptr);
-  return NULL;
+void process_start(Process *process) {
+  VM *vm = process->vm;
+  SYNCHRONIZED(vm->process_create_lock, {
+    if (NULL == vm->scheduler) {
+      vm->scheduler = scheduler_create(0 == vm->scheduler_threads
+                                           ? thread_num_processors()
+                                           : vm->scheduler_threads,
+                                       _process_run_slice, _process_delete);
+    }
+  });
+  process->wake_fn = _process_wake;
+  _process_wake(process);
 }
 
-ThreadHandle process_run_in_new_thread(Process *process) {
-  return process->thread =
-             thread_create(AS_VOID_FN(_process_run_return_void_ptr), process);
+void process_retire(Process *process) {
+  ASSERT(NOT_NULL(process->vm->scheduler));
+  scheduler_retire(process->vm->scheduler, process);
 }
\ No newline at end of file
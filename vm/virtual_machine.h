@@ -17,7 +17,19 @@ void vm_delete(VM *vm);
 Process *vm_create_process(VM *vm);
 Process *vm_main_process(VM *vm);
 
+// Runs [process] to completion on the calling thread.
 void process_run(Process *process);
-ThreadHandle process_run_in_new_thread(Process *process);
+// Hands [process] to the VM's Scheduler, which runs it in the background.
+void process_start(Process *process);
+// Frees a started [process] once its remaining work is done. Nothing new may
+// be given to it afterwards.
+void process_retire(Process *process);
+
+// Calls the background native [func] on its pool, like calling it from
+// bytecode, and returns the Future to its result. Lets a native hand work it
+// cannot do without blocking to a background one.
+Object *vm_call_in_background(Task *task, Context *context,
+                              const Function *func, Object *self,
+                              const Entity *args);
 
 #endif /* VM_VIRTUAL_MACHINE_H_ */
\ No newline at end of file
@@ -5,14 +5,19 @@
 
 #include "vm/vm.h"
 
+#include "alloc/alloc.h"
+#include "debug/debug.h"
 #include "entity/class/classes.h"
+#include "util/sync/thread.h"
 #include "vm/process/context.h"
 #include "vm/process/process.h"
 
 Process *create_process_no_reflection(VM *vm) {
-  Process *process = alist_add(&vm->processes);
+  Process *process = ALLOC2(Process);
+  *(Process **)alist_add(&vm->processes) = process;
   process_init(process);
   process->vm = vm;
+  heap_set_limits(process->heap, &vm->heap_limits);
   return process;
 }
 
@@ -24,6 +29,43 @@ void add_reflection_to_process(Process *process) {
 
 inline ModuleManager *vm_module_manager(VM *vm) { return &vm->mm; }
 
+void vm_set_scheduler_threads(VM *vm, uint32_t num_threads) {
+  SYNCHRONIZED(vm->process_create_lock,
+               { vm->scheduler_threads = num_threads; });
+}
+
+void vm_set_background_threads(VM *vm, uint32_t io_threads,
+                               uint32_t cpu_threads) {
+  ASSERT(io_threads > 0);
+  if (0 == cpu_threads) {
+    cpu_threads = thread_num_processors();
+  }
+  SYNCHRONIZED(vm->process_create_lock, {
+    if (io_threads != threadpool_stats(vm->io_pool).num_threads) {
+      threadpool_delete(vm->io_pool);
+      vm->io_pool = threadpool_create(io_threads);
+    }
+    if (cpu_threads != threadpool_stats(vm->cpu_pool).num_threads) {
+      threadpool_delete(vm->cpu_pool);
+      vm->cpu_pool = threadpool_create(cpu_threads);
+    }
+  });
+}
+
+inline ThreadPool *vm_background_pool(VM *vm, BackgroundPool pool) {
+  return BACKGROUND_CPU == pool ? vm->cpu_pool : vm->io_pool;
+}
+
+void vm_set_heap_limits(VM *vm, const HeapLimits *limits) {
+  SYNCHRONIZED(vm->process_create_lock, {
+    vm->heap_limits = *limits;
+    AL_iter iter = alist_iter(&vm->processes);
+    for (; al_has(&iter); al_inc(&iter)) {
+      heap_set_limits((*(Process **)al_value(&iter))->heap, limits);
+    }
+  });
+}
+
 Process *vm_create_process(VM *vm) {
   Process *process;
   SYNCHRONIZED(vm->process_create_lock, {
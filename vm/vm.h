@@ -7,21 +7,55 @@
 #define VM_VM_H_
 
 #include "struct/alist.h"
+#include "util/reactor.h"
 #include "util/sync/mutex.h"
 #include "util/sync/threadpool.h"
+#include "util/sync/timer_wheel.h"
+#include "util/uring.h"
 #include "vm/module_manager.h"
 #include "vm/process/processes.h"
+#include "vm/scheduler.h"
 
 typedef struct _VM {
   ModuleManager mm;
 
+  // Process *, each allocated separately so they never move.
   AList processes;
   Mutex process_create_lock;
   Process *main;
-  ThreadPool *background_pool;
+  // Run background natives, chosen by Function._background_pool.
+  ThreadPool *io_pool;
+  ThreadPool *cpu_pool;
+  // Keeps a cancelled background native from being interrupted after it has
+  // returned.
+  Mutex interrupt_lock;
+  // Drives sleeps and timeouts for every Process.
+  TimerWheel *timers;
+  // Wakes tasks waiting on non-blocking sockets. NULL where unsupported.
+  Reactor *reactor;
+  // Runs file reads and writes without tying up io_pool. NULL where
+  // unsupported.
+  Uring *uring;
+  // Runs every Process but main. Created with the first of them.
+  Scheduler *scheduler;
+  // Threads for the scheduler, 0 for one per processor.
+  uint32_t scheduler_threads;
+  // Applied to the heap of every Process unless overridden.
+  HeapLimits heap_limits;
 } VM;
 
 ModuleManager *vm_module_manager(VM *vm);
+// Sets the default heap limits for all current and future processes.
+void vm_set_heap_limits(VM *vm, const HeapLimits *limits);
+// Sets the number of threads running processes other than main. Only has an
+// effect before the first such process is started.
+void vm_set_scheduler_threads(VM *vm, uint32_t num_threads);
+// Resizes the pools running background natives. 0 for [cpu_threads] means one
+// per processor. Must be called before any background native runs.
+void vm_set_background_threads(VM *vm, uint32_t io_threads,
+                               uint32_t cpu_threads);
+// The pool that runs background natives of kind [pool].
+ThreadPool *vm_background_pool(VM *vm, BackgroundPool pool);
 Process *vm_create_process(VM *vm);
 Process *create_process_no_reflection(VM *vm);
 void add_reflection_to_process(Process *process);